@@ -0,0 +1,147 @@
+#include "atlas.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int atlas_packer_init(struct atlas_packer *p, const int width, const int height) {
+    *p = (struct atlas_packer){
+        .width = width,
+        .height = height,
+        .capacity = 16,
+    };
+
+    p->nodes = malloc(p->capacity * sizeof(*p->nodes));
+    if (!p->nodes) {
+        return -1;
+    }
+
+    atlas_packer_reset(p);
+
+    return 0;
+}
+
+void atlas_packer_deinit(struct atlas_packer *p) {
+    free(p->nodes);
+    p->nodes = NULL;
+    p->count = 0;
+    p->capacity = 0;
+}
+
+void atlas_packer_reset(struct atlas_packer *p) {
+    p->nodes[0] = (struct atlas_skyline){0, 0, p->width};
+    p->count = 1;
+}
+
+// y where a `w` wide rectangle would rest when its left edge is at node `i`, -1 if it does not fit
+static int skyline_fit(const struct atlas_packer *p, int i, const int w, const int h) {
+    const int x = p->nodes[i].x;
+    if (x + w > p->width) {
+        return -1;
+    }
+
+    int y = 0;
+    int left = w;
+    while (left > 0) {
+        if (p->nodes[i].y > y) {
+            y = p->nodes[i].y;
+        }
+
+        if (y + h > p->height) {
+            return -1;
+        }
+
+        left -= p->nodes[i].width;
+        i++;
+    }
+
+    return y;
+}
+
+static bool skyline_insert(struct atlas_packer *p, const int index, const struct atlas_skyline node) {
+    if (p->count == p->capacity) {
+        const int new_cap = p->capacity * 2;
+        struct atlas_skyline *new_nodes = realloc(p->nodes, new_cap * sizeof(*p->nodes));
+        if (!new_nodes) {
+            return false;
+        }
+
+        p->nodes = new_nodes;
+        p->capacity = new_cap;
+    }
+
+    memmove(&p->nodes[index + 1], &p->nodes[index], (p->count - index) * sizeof(*p->nodes));
+    p->nodes[index] = node;
+    p->count++;
+
+    return true;
+}
+
+static void skyline_remove(struct atlas_packer *p, const int index) {
+    memmove(&p->nodes[index], &p->nodes[index + 1], (p->count - index - 1) * sizeof(*p->nodes));
+    p->count--;
+}
+
+bool atlas_packer_pack(struct atlas_packer *p, const int w, const int h, struct vec2i *out) {
+    if (w <= 0 || h <= 0) {
+        return false;
+    }
+
+    // bottom left: lowest resting y, ties go to the narrower segment to keep gaps small
+    int best = -1;
+    int best_y = p->height;
+    int best_width = p->width + 1;
+
+    for (int i = 0; i < p->count; i++) {
+        const int y = skyline_fit(p, i, w, h);
+        if (y < 0) {
+            continue;
+        }
+
+        if (y < best_y || (y == best_y && p->nodes[i].width < best_width)) {
+            best = i;
+            best_y = y;
+            best_width = p->nodes[i].width;
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+
+    const struct atlas_skyline node = {p->nodes[best].x, best_y + h, w};
+    if (!skyline_insert(p, best, node)) {
+        return false;
+    }
+
+    // the new segment covers the start of the following ones, cut them back
+    for (int i = best + 1; i < p->count; i++) {
+        const int end = p->nodes[i - 1].x + p->nodes[i - 1].width;
+        if (p->nodes[i].x >= end) {
+            break;
+        }
+
+        const int shrink = end - p->nodes[i].x;
+        p->nodes[i].x += shrink;
+        p->nodes[i].width -= shrink;
+
+        if (p->nodes[i].width > 0) {
+            break;
+        }
+
+        skyline_remove(p, i);
+        i--;
+    }
+
+    // neighbours at the same height become one segment
+    for (int i = 0; i < p->count - 1; i++) {
+        if (p->nodes[i].y == p->nodes[i + 1].y) {
+            p->nodes[i].width += p->nodes[i + 1].width;
+            skyline_remove(p, i + 1);
+            i--;
+        }
+    }
+
+    *out = (struct vec2i){node.x, best_y};
+
+    return true;
+}
@@ -0,0 +1,35 @@
+// skyline rectangle packer used by the texture and glyph atlases, no gl in here
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <stdbool.h>
+
+#include "cmath.h"
+
+struct atlas_skyline {
+    int x;
+    int y;
+    int width;
+};
+
+struct atlas_packer {
+    int width;
+    int height;
+
+    // the top edge of everything packed so far, sorted by x and covering the whole width
+    struct atlas_skyline *nodes;
+    int count;
+    int capacity;
+};
+
+int atlas_packer_init(struct atlas_packer *p, int width, int height);
+
+void atlas_packer_deinit(struct atlas_packer *p);
+
+// forgets everything packed so far
+void atlas_packer_reset(struct atlas_packer *p);
+
+// finds the lowest spot for a `w` x `h` rectangle, false when it does not fit anymore
+bool atlas_packer_pack(struct atlas_packer *p, int w, int h, struct vec2i *out);
+
+#endif // ATLAS_H
@@ -0,0 +1,106 @@
+#include "bitstream.h"
+
+#include <math.h>
+
+void bitstream_writer(struct bitstream *b, uint8_t *data, const uint32_t cap) {
+    *b = (struct bitstream){.data = data, .cap = cap};
+}
+
+void bitstream_reader(struct bitstream *b, const uint8_t *data, const uint32_t len) {
+    *b = (struct bitstream){.data = (uint8_t *) data, .cap = len};
+}
+
+void bitstream_write(struct bitstream *b, const uint32_t value, const uint32_t count) {
+    b->acc |= (uint64_t) value << b->count;
+    b->count += count;
+
+    while (b->count >= 8) {
+        if (b->len < b->cap) {
+            b->data[b->len++] = (uint8_t) b->acc;
+        } else {
+            b->error = true;
+        }
+        b->acc >>= 8;
+        b->count -= 8;
+    }
+}
+
+uint32_t bitstream_read(struct bitstream *b, const uint32_t count) {
+    while (b->count < count) {
+        if (b->len < b->cap) {
+            b->acc |= (uint64_t) b->data[b->len++] << b->count;
+        } else {
+            b->error = true;
+        }
+        b->count += 8;
+    }
+
+    const uint32_t value = (uint32_t) (b->acc & ((1ull << count) - 1));
+    b->acc >>= count;
+    b->count -= count;
+
+    return value;
+}
+
+void bitstream_write_var(struct bitstream *b, const uint32_t value) {
+    const uint32_t n = value ? 32 - (uint32_t) __builtin_clz(value) : 0;
+
+    bitstream_write(b, n, BITSTREAM_VAR_BITS);
+    if (n > 1) {
+        bitstream_write(b, value & ((1u << (n - 1)) - 1), n - 1);
+    }
+}
+
+uint32_t bitstream_read_var(struct bitstream *b) {
+    const uint32_t n = bitstream_read(b, BITSTREAM_VAR_BITS);
+
+    if (n == 0) {
+        return 0;
+    }
+    if (n > 32) {
+        b->error = true;
+        return 0;
+    }
+
+    return (1u << (n - 1)) | (n > 1 ? bitstream_read(b, n - 1) : 0);
+}
+
+void bitstream_write_float(struct bitstream *b, const double value, const double min, const double max,
+                           const uint32_t bits) {
+    const double steps = (double) (uint32_t) ((1ull << bits) - 1);
+    double t = (value - min) / (max - min);
+
+    // NaN lands on min too
+    if (!(t > 0.0)) {
+        t = 0.0;
+    } else if (t > 1.0) {
+        t = 1.0;
+    }
+
+    bitstream_write(b, (uint32_t) lround(t * steps), bits);
+}
+
+double bitstream_read_float(struct bitstream *b, const double min, const double max, const uint32_t bits) {
+    const double steps = (double) (uint32_t) ((1ull << bits) - 1);
+
+    return min + (double) bitstream_read(b, bits) * (max - min) / steps;
+}
+
+uint64_t bitstream_remaining(const struct bitstream *b) {
+    return (uint64_t) (b->cap - b->len) * 8 + b->count;
+}
+
+uint32_t bitstream_bytes(struct bitstream *b) {
+    if (!b->count) {
+        return b->len;
+    }
+
+    if (b->len >= b->cap) {
+        b->error = true;
+        return b->len;
+    }
+
+    b->data[b->len] = (uint8_t) b->acc;
+
+    return b->len + 1;
+}
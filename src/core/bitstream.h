@@ -0,0 +1,48 @@
+// bit packing for net messages, least significant bit first. no allocation in here, the caller owns the buffer
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// bits of the length in front of every varint
+#define BITSTREAM_VAR_BITS 6
+
+struct bitstream {
+    // only read from when the stream is a reader
+    uint8_t *data;
+    uint32_t cap;
+    // whole bytes written or consumed, the bits of the next one wait in acc
+    uint32_t len;
+    uint64_t acc;
+    uint32_t count;
+    // ran past cap when writing or past the end when reading, sticks until the next init
+    bool error;
+};
+
+void bitstream_writer(struct bitstream *b, uint8_t *data, uint32_t cap);
+
+void bitstream_reader(struct bitstream *b, const uint8_t *data, uint32_t len);
+
+// count is at most 32, value must fit in it
+void bitstream_write(struct bitstream *b, uint32_t value, uint32_t count);
+
+uint32_t bitstream_read(struct bitstream *b, uint32_t count);
+
+// the bit length then the bits below the top one, 6 bits for 0 and 37 for the largest values
+void bitstream_write_var(struct bitstream *b, uint32_t value);
+
+uint32_t bitstream_read_var(struct bitstream *b);
+
+// `value` clamped to [min, max] and rounded to one of 2^bits evenly spaced steps, bits is 1 to 32
+void bitstream_write_float(struct bitstream *b, double value, double min, double max, uint32_t bits);
+
+double bitstream_read_float(struct bitstream *b, double min, double max, uint32_t bits);
+
+// bits the reader has left
+uint64_t bitstream_remaining(const struct bitstream *b);
+
+// bytes written so far, a partly filled last byte is stored without ending it so writing can go on
+uint32_t bitstream_bytes(struct bitstream *b);
+
+#endif // BITSTREAM_H
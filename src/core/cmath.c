@@ -4,6 +4,10 @@
 
 #include <math.h>
 
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 struct vec2 math_vec2_add(struct vec2 a, struct vec2 b) {
     return (struct vec2){a.x + b.x, a.y + b.y};
 }
@@ -107,6 +111,185 @@ void math_matrix_get_orthographic(struct render_context* r, struct matrix *m) {
     float half_w = (r->width / r->camera.zoom) * 0.5f;
     float half_h = (r->height / r->camera.zoom) * 0.5f;
 
+    const struct vec2 c = r->camera.pos;
+    math_matrix_orthographic(m, c.x - half_w, c.x + half_w, c.y - half_h, c.y + half_h, -1.0f, 1.0f);
+}
+
+void math_matrix_get_screen_orthographic(struct render_context* r, struct matrix *m) {
+    float half_w = r->width * 0.5f;
+    float half_h = r->height * 0.5f;
+
     math_matrix_orthographic(m, -half_w, half_w, -half_h, half_h, -1.0f, 1.0f);
 }
 
+
+/* sin/cos polynomials (cephes sinf/cosf), valid for |r| <= pi/4 */
+#define SIN_C1 -1.6666654611e-1f
+#define SIN_C2 8.3321608736e-3f
+#define SIN_C3 -1.9515295891e-4f
+#define COS_C1 4.166664568298827e-2f
+#define COS_C2 -1.388731625493765e-3f
+#define COS_C3 2.443315711809948e-5f
+#define DEG2RAD_F 0.017453292519943295f
+
+/* the reduction is done in degrees so multiples of 90 stay exact */
+static void sincos_deg(float angle, float *s, float *c) {
+    const float q = nearbyintf(angle * (1.0f / 90.0f));
+    const float r = (angle - q * 90.0f) * DEG2RAD_F;
+    const float z = r * r;
+
+    const float sr = r + r * z * (SIN_C1 + z * (SIN_C2 + z * SIN_C3));
+    const float cr = 1.0f - 0.5f * z + z * z * (COS_C1 + z * (COS_C2 + z * COS_C3));
+
+    const int quadrant = (int)q & 3;
+    *s = (quadrant & 1) ? cr : sr;
+    *c = (quadrant & 1) ? sr : cr;
+    if (quadrant & 2) *s = -*s;
+    if ((quadrant + 1) & 2) *c = -*c;
+}
+
+struct affine2d math_affine_make(struct vec2 pos, struct vec2 scale, float rotation) {
+    float s, c;
+    sincos_deg(rotation, &s, &c);
+
+    /* see math_matrix_rotate_2d, rotation is clockwise for positive angles */
+    return (struct affine2d){
+        .a = scale.x * c, .b = -scale.y * s,
+        .c = scale.x * s, .d = scale.y * c,
+        .tx = pos.x, .ty = pos.y,
+    };
+}
+
+#define AFFINE_AT(out, stride, i) ((struct affine2d *)((char *)(out) + (i) * (stride)))
+
+#if defined(__AVX__) || defined(__SSE2__)
+
+/* writes 4 transforms given as one register per field */
+static inline void affine_store4(struct affine2d *out, size_t stride, __m128 a, __m128 b, __m128 c, __m128 d,
+                          const float *px, const float *py) {
+    /* rows become (a, b, c, d) of one quad each */
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    _mm_storeu_ps(&AFFINE_AT(out, stride, 0)->a, a);
+    _mm_storeu_ps(&AFFINE_AT(out, stride, 1)->a, b);
+    _mm_storeu_ps(&AFFINE_AT(out, stride, 2)->a, c);
+    _mm_storeu_ps(&AFFINE_AT(out, stride, 3)->a, d);
+
+    for (int i = 0; i < 4; i++) {
+        AFFINE_AT(out, stride, i)->tx = px[i];
+        AFFINE_AT(out, stride, i)->ty = py[i];
+    }
+}
+
+#endif
+
+#if defined(__AVX__)
+
+#define AFFINE_LANES 8
+
+static void affine_lanes(struct affine2d *out, size_t stride, const float *px, const float *py,
+                         const float *sx, const float *sy, const float *rot) {
+    const __m256 angle = _mm256_loadu_ps(rot);
+    const __m256 q = _mm256_round_ps(_mm256_mul_ps(angle, _mm256_set1_ps(1.0f / 90.0f)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 r = _mm256_mul_ps(_mm256_sub_ps(angle, _mm256_mul_ps(q, _mm256_set1_ps(90.0f))),
+                                   _mm256_set1_ps(DEG2RAD_F));
+    const __m256 z = _mm256_mul_ps(r, r);
+
+    __m256 sp = _mm256_add_ps(_mm256_set1_ps(SIN_C2), _mm256_mul_ps(z, _mm256_set1_ps(SIN_C3)));
+    sp = _mm256_add_ps(_mm256_set1_ps(SIN_C1), _mm256_mul_ps(z, sp));
+    const __m256 sr = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, z), sp));
+
+    __m256 cp = _mm256_add_ps(_mm256_set1_ps(COS_C2), _mm256_mul_ps(z, _mm256_set1_ps(COS_C3)));
+    cp = _mm256_add_ps(_mm256_set1_ps(COS_C1), _mm256_mul_ps(z, cp));
+    const __m256 cr = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), z)),
+                                    _mm256_mul_ps(_mm256_mul_ps(z, z), cp));
+
+    /* quadrant = q mod 4, kept in floats since avx1 has no 256 bit integer ops */
+    const __m256 quadrant = _mm256_sub_ps(q, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(q, _mm256_set1_ps(0.25f))),
+                                                           _mm256_set1_ps(4.0f)));
+    const __m256 odd = _mm256_or_ps(_mm256_cmp_ps(quadrant, _mm256_set1_ps(1.0f), _CMP_EQ_OQ),
+                                    _mm256_cmp_ps(quadrant, _mm256_set1_ps(3.0f), _CMP_EQ_OQ));
+    const __m256 sin_neg = _mm256_cmp_ps(quadrant, _mm256_set1_ps(2.0f), _CMP_GE_OQ);
+    const __m256 cos_neg = _mm256_and_ps(_mm256_cmp_ps(quadrant, _mm256_set1_ps(1.0f), _CMP_GE_OQ),
+                                         _mm256_cmp_ps(quadrant, _mm256_set1_ps(3.0f), _CMP_LT_OQ));
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    __m256 s = _mm256_blendv_ps(sr, cr, odd);
+    __m256 c = _mm256_blendv_ps(cr, sr, odd);
+    s = _mm256_xor_ps(s, _mm256_and_ps(sin_neg, sign));
+    c = _mm256_xor_ps(c, _mm256_and_ps(cos_neg, sign));
+
+    const __m256 vsx = _mm256_loadu_ps(sx);
+    const __m256 vsy = _mm256_loadu_ps(sy);
+
+    const __m256 a = _mm256_mul_ps(vsx, c);
+    const __m256 b = _mm256_xor_ps(_mm256_mul_ps(vsy, s), sign);
+    const __m256 cc = _mm256_mul_ps(vsx, s);
+    const __m256 d = _mm256_mul_ps(vsy, c);
+
+    affine_store4(out, stride, _mm256_castps256_ps128(a), _mm256_castps256_ps128(b),
+                  _mm256_castps256_ps128(cc), _mm256_castps256_ps128(d), px, py);
+    affine_store4(AFFINE_AT(out, stride, 4), stride, _mm256_extractf128_ps(a, 1), _mm256_extractf128_ps(b, 1),
+                  _mm256_extractf128_ps(cc, 1), _mm256_extractf128_ps(d, 1), px + 4, py + 4);
+}
+
+#elif defined(__SSE2__)
+
+#define AFFINE_LANES 4
+
+static void affine_lanes(struct affine2d *out, size_t stride, const float *px, const float *py,
+                         const float *sx, const float *sy, const float *rot) {
+    const __m128 angle = _mm_loadu_ps(rot);
+    const __m128i qi = _mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(1.0f / 90.0f)));
+    const __m128 q = _mm_cvtepi32_ps(qi);
+    const __m128 r = _mm_mul_ps(_mm_sub_ps(angle, _mm_mul_ps(q, _mm_set1_ps(90.0f))), _mm_set1_ps(DEG2RAD_F));
+    const __m128 z = _mm_mul_ps(r, r);
+
+    __m128 sp = _mm_add_ps(_mm_set1_ps(SIN_C2), _mm_mul_ps(z, _mm_set1_ps(SIN_C3)));
+    sp = _mm_add_ps(_mm_set1_ps(SIN_C1), _mm_mul_ps(z, sp));
+    const __m128 sr = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), sp));
+
+    __m128 cp = _mm_add_ps(_mm_set1_ps(COS_C2), _mm_mul_ps(z, _mm_set1_ps(COS_C3)));
+    cp = _mm_add_ps(_mm_set1_ps(COS_C1), _mm_mul_ps(z, cp));
+    const __m128 cr = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), z)),
+                                 _mm_mul_ps(_mm_mul_ps(z, z), cp));
+
+    const __m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qi, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    const __m128 sin_neg = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(qi, _mm_set1_epi32(2)), 30));
+    const __m128 cos_neg = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qi, _mm_set1_epi32(1)),
+                                                                         _mm_set1_epi32(2)), 30));
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    /* no blendv before sse4.1 */
+    __m128 s = _mm_or_ps(_mm_and_ps(odd, cr), _mm_andnot_ps(odd, sr));
+    __m128 c = _mm_or_ps(_mm_and_ps(odd, sr), _mm_andnot_ps(odd, cr));
+    s = _mm_xor_ps(s, sin_neg);
+    c = _mm_xor_ps(c, cos_neg);
+
+    const __m128 vsx = _mm_loadu_ps(sx);
+    const __m128 vsy = _mm_loadu_ps(sy);
+
+    affine_store4(out, stride, _mm_mul_ps(vsx, c), _mm_xor_ps(_mm_mul_ps(vsy, s), sign),
+                  _mm_mul_ps(vsx, s), _mm_mul_ps(vsy, c), px, py);
+}
+
+#endif
+
+void math_affine_batch(struct affine2d *out, size_t stride,
+                       const float *pos_x, const float *pos_y,
+                       const float *scale_x, const float *scale_y,
+                       const float *rotation, size_t n) {
+    size_t i = 0;
+
+#ifdef AFFINE_LANES
+    for (; i + AFFINE_LANES <= n; i += AFFINE_LANES) {
+        affine_lanes(AFFINE_AT(out, stride, i), stride, pos_x + i, pos_y + i,
+                     scale_x + i, scale_y + i, rotation + i);
+    }
+#endif
+
+    for (; i < n; i++) {
+        *AFFINE_AT(out, stride, i) = math_affine_make((struct vec2){pos_x[i], pos_y[i]},
+                                                      (struct vec2){scale_x[i], scale_y[i]}, rotation[i]);
+    }
+}
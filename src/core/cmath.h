@@ -2,6 +2,8 @@
 #ifndef CMAHTH_H
 #define CMAHTH_H
 
+#include <stddef.h>
+
 #define RAD2DEG(x) (x * 180.0f / M_PI)
 #define DEG2RAD(x) (x * M_PI / 180.0f)
 
@@ -19,6 +21,14 @@ struct matrix {
     float m[16];
 };
 
+/* 2d affine transform, columns (a, b) (c, d) (tx, ty):
+   x' = a * x + c * y + tx
+   y' = b * x + d * y + ty */
+struct affine2d {
+    float a, b, c, d;
+    float tx, ty;
+};
+
 struct render_context;
 
 struct vec2 math_vec2_add(struct vec2 a, struct vec2 b);
@@ -45,6 +55,18 @@ void math_matrix_rotate_2d(struct matrix* m, float angle);
 void math_matrix_mul(struct matrix* out, struct matrix* a, struct matrix* b);
 void math_matrix_orthographic(struct matrix* m, float left, float right, float bottom, float top, float near, float far);
 void math_matrix_get_orthographic(struct render_context *r, struct matrix* m);
+/* Pixels around the screen center, the camera does not apply */
+void math_matrix_get_screen_orthographic(struct render_context *r, struct matrix* m);
+
+/* Angle in degrees, same result as translate * scale * rotate_2d but without the 4x4 matrices */
+struct affine2d math_affine_make(struct vec2 pos, struct vec2 scale, float rotation);
+
+/* Batch version of math_affine_make, uses sse2/avx when compiled in.
+   out[i] is written every `stride` bytes so it can fill a field of a larger struct */
+void math_affine_batch(struct affine2d *out, size_t stride,
+                       const float *pos_x, const float *pos_y,
+                       const float *scale_x, const float *scale_y,
+                       const float *rotation, size_t n);
 
 
 
@@ -5,11 +5,22 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#ifdef SERVER
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
 #include <luajit-2.1/lua.h>
 
 #include "archive.h"
 #include "local.h"
 #include "lua.h"
+#include "lua_api.h"
 #include "renderer.h"
 
 #ifdef SERVER
@@ -18,6 +29,28 @@
 #define ENTRY SAUSAGES_ENTRY_CLIENT
 #endif
 
+#ifdef SERVER
+// ticks per second unless SAUSAGES_TICK_RATE says otherwise
+#define TICK_RATE 60
+// seconds between looks at the archive mtime and between tick reports
+#define RELOAD_INTERVAL 1.0
+#define REPORT_INTERVAL 60.0
+#define WAIT_EVENTS 16
+
+// reset after every report
+struct tick_stats {
+    uint64_t ticks;
+    // deadlines that passed while the previous tick was still running, those ticks are skipped
+    uint64_t overruns;
+    // updates run early because datagrams arrived between ticks
+    uint64_t packet_wakes;
+    // how long after its deadline a tick started
+    double late_sum;
+    double late_max;
+    double update_max;
+};
+#endif
+
 static lua_State *L;
 
 static void resize_callback(GLFWwindow *window, const int width, const int height) {
@@ -27,6 +60,114 @@ static void resize_callback(GLFWwindow *window, const int width, const int heigh
     glViewport(0, 0, width, height);
 }
 
+#ifdef SERVER
+static double monotonic(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static struct timespec timespec_of(const double t) {
+    const time_t sec = (time_t) t;
+    return (struct timespec){.tv_sec = sec, .tv_nsec = (long) ((t - (double) sec) * 1e9)};
+}
+
+static void tick_report(const struct tick_stats *stats, const int rate) {
+    printf("tick %d hz: %llu ticks, %llu overruns, late mean %.3f ms max %.3f ms, update max %.3f ms, "
+           "%llu packet wakes\n",
+           rate, (unsigned long long) stats->ticks, (unsigned long long) stats->overruns,
+           stats->ticks ? stats->late_sum / (double) stats->ticks * 1e3 : 0.0, stats->late_max * 1e3,
+           stats->update_max * 1e3, (unsigned long long) stats->packet_wakes);
+    fflush(stdout);
+}
+
+// sleeps in epoll until a tick is due, a server socket has datagrams or SIGINT / SIGTERM arrive
+static void server_loop(const int poll_fd, const int signal_fd) {
+    const char *rate_env = getenv("SAUSAGES_TICK_RATE");
+    const int rate = rate_env && atoi(rate_env) > 0 ? atoi(rate_env) : TICK_RATE;
+    const double period = 1.0 / rate;
+
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        perror("timerfd_create");
+        return;
+    }
+
+    // absolute deadlines, so lateness is measured against the schedule and not the last wakeup
+    double deadline = monotonic() + period;
+    const struct itimerspec spec = {.it_interval = timespec_of(period), .it_value = timespec_of(deadline)};
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = timer_fd};
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0 ||
+        epoll_ctl(poll_fd, EPOLL_CTL_ADD, timer_fd, &event) != 0) {
+        perror("server timer");
+        close(timer_fd);
+        return;
+    }
+
+    struct tick_stats stats = {0};
+    double last_time = monotonic();
+    double next_reload = last_time + RELOAD_INTERVAL;
+    double next_report = last_time + REPORT_INTERVAL;
+    bool quit = false;
+
+    while (!quit) {
+        struct epoll_event events[WAIT_EVENTS];
+        const int n = epoll_wait(poll_fd, events, WAIT_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        bool tick = false;
+        for (int i = 0; i < n; i++) {
+            tick = tick || events[i].data.fd == timer_fd;
+            quit = quit || events[i].data.fd == signal_fd;
+        }
+
+        const double current_time = monotonic();
+        uint64_t expired = 0;
+
+        if (tick && read(timer_fd, &expired, sizeof(expired)) == sizeof(expired) && expired) {
+            // the newest deadline that passed, the ones before it were missed
+            const double late = current_time - (deadline + (double) (expired - 1) * period);
+            deadline += (double) expired * period;
+
+            stats.ticks++;
+            stats.overruns += expired - 1;
+            stats.late_sum += late;
+            stats.late_max = late > stats.late_max ? late : stats.late_max;
+        } else if (!quit) {
+            stats.packet_wakes++;
+        }
+
+        if (current_time >= next_reload) {
+            L = lua_reload(L, SAUSAGES_DATA, ENTRY);
+            next_reload = current_time + RELOAD_INTERVAL;
+        }
+
+        lua_call_update(L, current_time - last_time);
+        last_time = current_time;
+
+        if (expired) {
+            const double update = monotonic() - current_time;
+            stats.update_max = update > stats.update_max ? update : stats.update_max;
+        }
+
+        if (current_time >= next_report || quit) {
+            tick_report(&stats, rate);
+            stats = (struct tick_stats){0};
+            next_report = current_time + REPORT_INTERVAL;
+        }
+    }
+
+    close(timer_fd);
+}
+#endif
+
 int main(void) {
     FILE *test = fopen(SAUSAGES_DATA, "rb");
     if (!test) {
@@ -64,28 +205,44 @@ int main(void) {
 
     // TODO: any calls to renderer in server would segfault
     renderer_init(&render_context);
+#else
+    // taken through a signalfd so the loop can quit cleanly, blocked before the io thread inherits the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+
+    const int poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    const int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = signal_fd};
+
+    if (poll_fd < 0 || signal_fd < 0 || epoll_ctl(poll_fd, EPOLL_CTL_ADD, signal_fd, &event) != 0) {
+        perror("server event loop");
+        return EXIT_FAILURE;
+    }
+
+    // before lua_init so the sockets game_init opens are watched
+    lua_api_watch(poll_fd);
 #endif
 
     L = lua_init(SAUSAGES_DATA, ENTRY);
     if (!L) {
         fprintf(stderr, "lua_init() failed\n");
+#ifndef SERVER
         glfwTerminate();
+#endif
         return EXIT_FAILURE;
     }
     lua_call_init(L);
 
 #ifdef SERVER
-    double last_time = glfwGetTime();
-    while (1) {
-        const double current_time = glfwGetTime();
-        const double delta_time = current_time - last_time;
-        last_time = current_time;
+    server_loop(poll_fd, signal_fd);
 
-        L = lua_reload(L, SAUSAGES_DATA, ENTRY);
-        lua_call_update(L, delta_time);
-
-        usleep(1000);
-    }
+    lua_call_quit(L);
+    lua_quit(L);
+    close(signal_fd);
+    close(poll_fd);
 #else
     glfwSwapInterval(0);
 
@@ -114,12 +271,12 @@ int main(void) {
             usleep((unsigned int) ((1.0 / 240.0 - elapsed) * 1e6));
         }
     }
-#endif
 
     renderer_deinit(&render_context);
     lua_quit(L);
     glfwDestroyWindow(render_context.window);
     glfwTerminate();
+#endif
 
     return EXIT_SUCCESS;
 }
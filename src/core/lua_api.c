@@ -1,5 +1,9 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <sys/epoll.h>
 
 #include <luajit-2.1/lauxlib.h>
 #include <luajit-2.1/lua.h>
@@ -9,7 +13,9 @@
 
 #include "archive.h"
 #include "local.h"
+#include "bitstream.h"
 #include "net.h"
+#include "snapshot.h"
 #include "cmath.h"
 #include "ui.h"
 #include "collision.h"
@@ -17,6 +23,13 @@
 // metatables
 #define SERVER_MT "net_server"
 #define CLIENT_MT "net_client"
+#define SNAPSHOT_MT "snapshot"
+#define WRITER_MT "bitstream_writer"
+#define READER_MT "bitstream_reader"
+#define SCHEMA_MT "schema"
+
+// snapshot fields are stored as value * scale, rounded. a hundredth of a pixel by default
+#define SNAPSHOT_SCALE 100.0
 
 static struct vec2 check_vec2(lua_State *L, const int idx) {
     struct vec2 v;
@@ -96,12 +109,67 @@ static int l_get_screen_dimensions(lua_State *L) {
     return 1;
 }
 
+static int l_get_render_stats(lua_State *L) {
+    const struct render_stats *stats = &render_context.stats;
+
+    lua_newtable(L);
+    lua_pushinteger(L, stats->quads);
+    lua_setfield(L, -2, "quads");
+
+    lua_pushinteger(L, stats->culled);
+    lua_setfield(L, -2, "culled");
+
+    lua_pushinteger(L, stats->draw_calls);
+    lua_setfield(L, -2, "draw_calls");
+
+    lua_pushinteger(L, stats->program_skipped);
+    lua_setfield(L, -2, "program_skipped");
+
+    lua_pushinteger(L, stats->texture_skipped);
+    lua_setfield(L, -2, "texture_skipped");
+
+    lua_pushinteger(L, stats->proj_skipped);
+    lua_setfield(L, -2, "proj_skipped");
+
+    lua_pushinteger(L, stats->upload_bytes);
+    lua_setfield(L, -2, "upload_bytes");
+
+    lua_pushinteger(L, stats->fence_waits);
+    lua_setfield(L, -2, "fence_waits");
+
+    lua_pushinteger(L, stats->glyphs_rasterized);
+    lua_setfield(L, -2, "glyphs_rasterized");
+
+    lua_pushinteger(L, stats->glyph_evictions);
+    lua_setfield(L, -2, "glyph_evictions");
+
+    lua_pushinteger(L, stats->glyph_upload_bytes);
+    lua_setfield(L, -2, "glyph_upload_bytes");
+
+    lua_pushinteger(L, stats->text_cache_hits);
+    lua_setfield(L, -2, "text_cache_hits");
+
+    lua_pushinteger(L, stats->text_cache_misses);
+    lua_setfield(L, -2, "text_cache_misses");
+
+    return 1;
+}
+
+static int l_set_camera(lua_State *L) {
+    const struct vec2 pos = check_vec2(L, 1);
+    const float zoom = (float) luaL_optnumber(L, 2, render_context.camera.zoom);
+
+    renderer_set_camera(&render_context, pos, zoom);
+
+    return 0;
+}
+
 static int l_push_rect(lua_State *L) {
     const struct vec2 pos = check_vec2(L, 1);
     const struct vec2 scale = check_vec2(L, 2);
     const struct color3 color = check_color3(L, 3);
 
-    renderer_push_rect(&render_context, pos, scale, 0.0f, color, ANCHOR_CENTER);
+    renderer_push_rect(&render_context, pos, scale, 0.0f, color, ANCHOR_CENTER, RENDERER_LAYER_DEFAULT);
 
     return 0;
 }
@@ -112,8 +180,9 @@ static int l_push_rect_ex(lua_State *L) {
     const float rotation = luaL_checknumber(L, 3);
     const struct color3 color = check_color3(L, 4);
     const int anchor = luaL_checkint(L, 5);
+    const int layer = luaL_optint(L, 6, RENDERER_LAYER_DEFAULT);
 
-    renderer_push_rect(&render_context, pos, scale, rotation, color, anchor);
+    renderer_push_rect(&render_context, pos, scale, rotation, color, anchor, layer);
 
     return 0;
 }
@@ -123,7 +192,7 @@ static int l_push_texture(lua_State *L) {
     const struct vec2 scale = check_vec2(L, 2);
     const texture_id tex = luaL_checkint(L, 3);
 
-    renderer_push_texture(&render_context, pos, scale, 0.0f, tex, ANCHOR_CENTER);
+    renderer_push_texture(&render_context, pos, scale, 0.0f, tex, ANCHOR_CENTER, RENDERER_LAYER_DEFAULT);
 
     return 0;
 }
@@ -134,8 +203,9 @@ static int l_push_texture_ex(lua_State *L) {
     const float rotation = luaL_checknumber(L, 3);
     const texture_id tex = luaL_checkint(L, 4);
     const int anchor = luaL_checkint(L, 5);
+    const int layer = luaL_optint(L, 6, RENDERER_LAYER_DEFAULT);
 
-    renderer_push_texture(&render_context, pos, scale, rotation, tex, anchor);
+    renderer_push_texture(&render_context, pos, scale, rotation, tex, anchor, layer);
 
     return 0;
 }
@@ -147,7 +217,7 @@ static int l_push_text(lua_State *L) {
     float scale = luaL_checknumber(L, 4);
     const struct color3 color = check_color3(L, 5);
     
-    renderer_push_text(&render_context, pos, scale, color, font, text, ANCHOR_BOTTOM_LEFT);
+    renderer_push_text(&render_context, pos, scale, color, font, text, ANCHOR_BOTTOM_LEFT, RENDERER_LAYER_DEFAULT);
 
     return 0;
 }
@@ -159,14 +229,44 @@ static int l_push_text_ex(lua_State *L) {
     float scale = luaL_checknumber(L, 4);
     const struct color3 color = check_color3(L, 5);
     const int anchor = luaL_checkint(L, 6);
+    const int layer = luaL_optint(L, 7, RENDERER_LAYER_DEFAULT);
     
-    renderer_push_text(&render_context, pos, scale, color, font, text, anchor);
+    renderer_push_text(&render_context, pos, scale, color, font, text, anchor, layer);
 
     return 0;
 }
 
+static int l_layer_begin(lua_State *L) {
+    const int id = luaL_optint(L, 1, -1);
+
+    lua_pushboolean(L, renderer_layer_begin(&render_context, id));
+    return 1;
+}
+
+static int l_layer_end(lua_State *L) {
+    lua_pushinteger(L, renderer_layer_end(&render_context));
+    return 1;
+}
+
+static int l_layer_draw(lua_State *L) {
+    const int id = luaL_checkint(L, 1);
+    const struct vec2 offset = lua_isnoneornil(L, 2) ? (struct vec2){0.0f, 0.0f} : check_vec2(L, 2);
+
+    renderer_layer_draw(&render_context, id, offset);
+
+    return 0;
+}
+
+static int l_layer_free(lua_State *L) {
+    renderer_layer_free(&render_context, luaL_checkint(L, 1));
+    return 0;
+}
+
 static int l_load_texture(lua_State *L) {
-    const texture_id tex = renderer_load_texture(luaL_checkstring(L, 1));
+    const char *path = luaL_checkstring(L, 1);
+    const bool atlas = lua_isnoneornil(L, 2) ? true : lua_toboolean(L, 2);
+
+    const texture_id tex = renderer_load_texture(&render_context, path, atlas);
     lua_pushinteger(L, tex);
     return 1;
 }
@@ -174,9 +274,14 @@ static int l_load_texture(lua_State *L) {
 static int l_load_font(lua_State *L) {
     const char* text = luaL_checkstring(L, 1);
     const int font_size = luaL_checkint(L, 2);
-    const struct vec2i range = check_vec2i(L, 3);
 
-    const font_id font = renderer_load_font(&render_context, text, font_size, range);
+    const font_id font = renderer_load_font(&render_context, text, font_size);
+
+    /* glyphs are rasterized when first drawn, a range only warms them up front */
+    if (!lua_isnoneornil(L, 3)) {
+        renderer_preload_glyphs(&render_context, font, check_vec2i(L, 3));
+    }
+
     lua_pushinteger(L, font);
     return 1;
 }
@@ -311,20 +416,800 @@ static int push_event(lua_State *L, const struct net_event *event) {
     return 1;
 }
 
+static int push_io_stats(lua_State *L, const struct net_io_stats *stats) {
+    lua_newtable(L);
+    lua_pushinteger(L, stats->recv_calls);
+    lua_setfield(L, -2, "recv_calls");
+
+    lua_pushinteger(L, stats->recv_packets);
+    lua_setfield(L, -2, "recv_packets");
+
+    lua_pushinteger(L, stats->send_calls);
+    lua_setfield(L, -2, "send_calls");
+
+    lua_pushinteger(L, stats->send_packets);
+    lua_setfield(L, -2, "send_packets");
+
+    lua_pushinteger(L, stats->recv_queue);
+    lua_setfield(L, -2, "recv_queue");
+
+    lua_pushinteger(L, stats->recv_queue_max);
+    lua_setfield(L, -2, "recv_queue_max");
+
+    lua_pushinteger(L, stats->send_queue);
+    lua_setfield(L, -2, "send_queue");
+
+    lua_pushinteger(L, stats->send_queue_max);
+    lua_setfield(L, -2, "send_queue_max");
+
+    lua_pushinteger(L, stats->send_dropped);
+    lua_setfield(L, -2, "send_dropped");
+
+    lua_pushinteger(L, stats->recv_stalls);
+    lua_setfield(L, -2, "recv_stalls");
+
+    lua_pushinteger(L, stats->kernel_dropped);
+    lua_setfield(L, -2, "kernel_dropped");
+
+    return 1;
+}
+
+// round trip times in seconds
+static int push_peer_stats(lua_State *L, const struct net_peer_stats *stats) {
+    lua_newtable(L);
+    lua_pushinteger(L, stats->packets_in);
+    lua_setfield(L, -2, "packets_in");
+
+    lua_pushinteger(L, stats->bytes_in);
+    lua_setfield(L, -2, "bytes_in");
+
+    lua_pushinteger(L, stats->packets_out);
+    lua_setfield(L, -2, "packets_out");
+
+    lua_pushinteger(L, stats->bytes_out);
+    lua_setfield(L, -2, "bytes_out");
+
+    lua_pushinteger(L, stats->retransmits);
+    lua_setfield(L, -2, "retransmits");
+
+    lua_pushinteger(L, stats->duplicates);
+    lua_setfield(L, -2, "duplicates");
+
+    lua_pushinteger(L, stats->out_of_order);
+    lua_setfield(L, -2, "out_of_order");
+
+    lua_pushinteger(L, stats->sequenced_dropped);
+    lua_setfield(L, -2, "sequenced_dropped");
+
+    lua_pushinteger(L, stats->send_dropped);
+    lua_setfield(L, -2, "send_dropped");
+
+    lua_pushinteger(L, stats->fragments_dropped);
+    lua_setfield(L, -2, "fragments_dropped");
+
+    lua_pushnumber(L, stats->srtt);
+    lua_setfield(L, -2, "srtt");
+
+    lua_pushnumber(L, stats->rttvar);
+    lua_setfield(L, -2, "rttvar");
+
+    lua_pushinteger(L, stats->send_queue);
+    lua_setfield(L, -2, "send_queue");
+
+    return 1;
+}
+
+enum {
+    SEND_UNRELIABLE,
+    SEND_RELIABLE,
+    SEND_SEQUENCED,
+};
+
+static const char *const send_modes[] = {"unreliable", "reliable", "sequenced", NULL};
+
+static uint32_t check_channel(lua_State *L, const int arg) {
+    const int channel = luaL_optint(L, arg, 0);
+    luaL_argcheck(L, channel >= 0 && channel < NET_SEQUENCED_CHANNELS, arg, "channel out of range");
+
+    return (uint32_t) channel;
+}
+
+// bitstream
+
+// reused across messages, the buffer only grows
+struct lua_writer {
+    struct bitstream b;
+};
+
+// reads straight out of the lua string it was reset to, which it keeps alive through a registry ref
+struct lua_reader {
+    struct bitstream b;
+    int ref;
+    // set when reading a writer, its buffer moves when it grows so every read looks it up again
+    struct lua_writer *source;
+};
+
+// room for `bits` more, luaL_error when out of memory
+static void writer_reserve(lua_State *L, struct lua_writer *lw, const uint64_t bits) {
+    // the partial byte bitstream_bytes stores is counted in
+    const uint64_t need = lw->b.len + (lw->b.count + bits + 7) / 8 + 1;
+    if (need <= lw->b.cap) {
+        return;
+    }
+
+    uint64_t cap = lw->b.cap ? lw->b.cap : 256;
+    while (cap < need) {
+        cap *= 2;
+    }
+
+    uint8_t *data = cap <= UINT32_MAX ? realloc(lw->b.data, cap) : NULL;
+    if (!data) {
+        luaL_error(L, "bitstream: out of memory");
+        return;
+    }
+
+    lw->b.data = data;
+    lw->b.cap = (uint32_t) cap;
+}
+
+// the writer at `arg`, NULL for anything else
+static struct lua_writer *test_writer(lua_State *L, const int arg) {
+    struct lua_writer *lw = lua_touserdata(L, arg);
+
+    if (!lw || !lua_getmetatable(L, arg)) {
+        return NULL;
+    }
+
+    luaL_getmetatable(L, WRITER_MT);
+    const bool writer = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+
+    return writer ? lw : NULL;
+}
+
+static uint32_t check_bits(lua_State *L, const int arg) {
+    const int bits = luaL_checkint(L, arg);
+    luaL_argcheck(L, bits >= 1 && bits <= 32, arg, "bits must be 1 to 32");
+
+    return (uint32_t) bits;
+}
+
+static uint32_t check_uint(lua_State *L, const int arg) {
+    const lua_Number value = luaL_checknumber(L, arg);
+    luaL_argcheck(L, value >= 0 && value <= UINT32_MAX, arg, "not a 32 bit unsigned integer");
+
+    return (uint32_t) value;
+}
+
+// bits needed for max - min
+static uint32_t range_bits(lua_State *L, const int arg, const lua_Integer min, const lua_Integer max) {
+    luaL_argcheck(L, min < max && max - min <= UINT32_MAX, arg, "empty or too wide range");
+
+    return 32 - (uint32_t) __builtin_clz((uint32_t) (max - min));
+}
+
+// core.bitstream.writer()
+static int l_writer_new(lua_State *L) {
+    struct lua_writer *lw = lua_newuserdata(L, sizeof(*lw));
+    bitstream_writer(&lw->b, NULL, 0);
+
+    luaL_getmetatable(L, WRITER_MT);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+// writer:reset(), empty again but keeps its buffer
+static int l_writer_reset(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    bitstream_writer(&lw->b, lw->b.data, lw->b.cap);
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// every write returns the writer so they chain, w:uint(1, 3):bool(true)
+static int l_writer_bool(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    writer_reserve(L, lw, 1);
+    bitstream_write(&lw->b, lua_toboolean(L, 2), 1);
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// writer:uint(value, bits)
+static int l_writer_uint(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    const uint32_t value = check_uint(L, 2);
+    const uint32_t bits = check_bits(L, 3);
+    luaL_argcheck(L, bits == 32 || value < 1u << bits, 2, "does not fit in bits");
+
+    writer_reserve(L, lw, bits);
+    bitstream_write(&lw->b, value, bits);
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// writer:int(value, min, max), as many bits as the range needs
+static int l_writer_int(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    const lua_Integer value = luaL_checkinteger(L, 2);
+    const lua_Integer min = luaL_checkinteger(L, 3);
+    const lua_Integer max = luaL_checkinteger(L, 4);
+    const uint32_t bits = range_bits(L, 3, min, max);
+    luaL_argcheck(L, value >= min && value <= max, 2, "out of range");
+
+    writer_reserve(L, lw, bits);
+    bitstream_write(&lw->b, (uint32_t) (value - min), bits);
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// writer:varint(value), unsigned, 6 bits for 0 and fewer than 16 up to 1023
+static int l_writer_varint(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    const uint32_t value = check_uint(L, 2);
+
+    writer_reserve(L, lw, BITSTREAM_VAR_BITS + 31);
+    bitstream_write_var(&lw->b, value);
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// writer:float(value, min, max, bits), clamped to the range
+static int l_writer_float(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    const double value = luaL_checknumber(L, 2);
+    const double min = luaL_checknumber(L, 3);
+    const double max = luaL_checknumber(L, 4);
+    const uint32_t bits = check_bits(L, 5);
+    luaL_argcheck(L, min < max, 3, "empty range");
+
+    writer_reserve(L, lw, bits);
+    bitstream_write_float(&lw->b, value, min, max, bits);
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// writer:string(s), varint length then the bytes
+static int l_writer_string(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    size_t len;
+    const char *str = luaL_checklstring(L, 2, &len);
+    luaL_argcheck(L, len <= UINT32_MAX / 8, 2, "too long");
+
+    writer_reserve(L, lw, BITSTREAM_VAR_BITS + 31 + (uint64_t) len * 8);
+    bitstream_write_var(&lw->b, (uint32_t) len);
+    for (size_t i = 0; i < len; i++) {
+        bitstream_write(&lw->b, (uint8_t) str[i], 8);
+    }
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// writer:bytes(), what a send would put on the wire
+static int l_writer_bytes(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    lua_pushinteger(L, lw->b.len + (lw->b.count != 0));
+
+    return 1;
+}
+
+static int l_writer_gc(lua_State *L) {
+    struct lua_writer *lw = luaL_checkudata(L, 1, WRITER_MT);
+    free(lw->b.data);
+    lw->b.data = NULL;
+
+    return 0;
+}
+
+static const luaL_Reg writer_methods[] = {
+    {"reset", l_writer_reset},
+    {"bool", l_writer_bool},
+    {"uint", l_writer_uint},
+    {"int", l_writer_int},
+    {"varint", l_writer_varint},
+    {"float", l_writer_float},
+    {"string", l_writer_string},
+    {"bytes", l_writer_bytes},
+    {"__gc", l_writer_gc},
+    {NULL, NULL}
+};
+
+// the reader at `arg`, pointed at the current bytes of the writer it reads if any
+static struct lua_reader *check_reader(lua_State *L, const int arg) {
+    struct lua_reader *lr = luaL_checkudata(L, arg, READER_MT);
+
+    if (lr->source) {
+        writer_reserve(L, lr->source, 0);
+        lr->b.cap = bitstream_bytes(&lr->source->b);
+        lr->b.data = lr->source->b.data;
+    }
+
+    return lr;
+}
+
+// core.bitstream.reader()
+static int l_reader_new(lua_State *L) {
+    struct lua_reader *lr = lua_newuserdata(L, sizeof(*lr));
+    bitstream_reader(&lr->b, NULL, 0);
+    lr->ref = LUA_NOREF;
+    lr->source = NULL;
+
+    luaL_getmetatable(L, READER_MT);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+// reader:reset(data), starts reading a received message without copying it.
+// data may also be a writer, its bytes are read as they are at each read
+static int l_reader_reset(lua_State *L) {
+    struct lua_reader *lr = luaL_checkudata(L, 1, READER_MT);
+    struct lua_writer *lw = test_writer(L, 2);
+    size_t len = 0;
+    const char *data = NULL;
+
+    if (!lw) {
+        data = luaL_checklstring(L, 2, &len);
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, lr->ref);
+    lua_pushvalue(L, 2);
+    lr->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    bitstream_reader(&lr->b, (const uint8_t *) data, (uint32_t) len);
+    lr->source = lw;
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// reads past the end give 0 and make ok() false
+static int l_reader_bool(lua_State *L) {
+    struct lua_reader *lr = check_reader(L, 1);
+    lua_pushboolean(L, bitstream_read(&lr->b, 1));
+
+    return 1;
+}
+
+static int l_reader_uint(lua_State *L) {
+    struct lua_reader *lr = check_reader(L, 1);
+    lua_pushnumber(L, bitstream_read(&lr->b, check_bits(L, 2)));
+
+    return 1;
+}
+
+static int l_reader_int(lua_State *L) {
+    struct lua_reader *lr = check_reader(L, 1);
+    const lua_Integer min = luaL_checkinteger(L, 2);
+    const lua_Integer max = luaL_checkinteger(L, 3);
+    const uint32_t value = bitstream_read(&lr->b, range_bits(L, 2, min, max));
+
+    // a corrupt message may hold more than the range
+    if (value > (uint64_t) (max - min)) {
+        lr->b.error = true;
+    }
+    lua_pushinteger(L, min + (lua_Integer) value);
+
+    return 1;
+}
+
+static int l_reader_varint(lua_State *L) {
+    struct lua_reader *lr = check_reader(L, 1);
+    lua_pushnumber(L, bitstream_read_var(&lr->b));
+
+    return 1;
+}
+
+static int l_reader_float(lua_State *L) {
+    struct lua_reader *lr = check_reader(L, 1);
+    const double min = luaL_checknumber(L, 2);
+    const double max = luaL_checknumber(L, 3);
+    lua_pushnumber(L, bitstream_read_float(&lr->b, min, max, check_bits(L, 4)));
+
+    return 1;
+}
+
+static int l_reader_string(lua_State *L) {
+    struct lua_reader *lr = check_reader(L, 1);
+    const uint32_t len = bitstream_read_var(&lr->b);
+    luaL_Buffer buf;
+
+    if (lr->b.error || (uint64_t) len * 8 > bitstream_remaining(&lr->b)) {
+        lr->b.error = true;
+        lua_pushliteral(L, "");
+        return 1;
+    }
+
+    luaL_buffinit(L, &buf);
+    for (uint32_t i = 0; i < len; i++) {
+        luaL_addchar(&buf, (char) bitstream_read(&lr->b, 8));
+    }
+    luaL_pushresult(&buf);
+
+    return 1;
+}
+
+// reader:ok(), false once a read went past the end or found garbage
+static int l_reader_ok(lua_State *L) {
+    struct lua_reader *lr = check_reader(L, 1);
+    lua_pushboolean(L, !lr->b.error);
+
+    return 1;
+}
+
+static int l_reader_gc(lua_State *L) {
+    struct lua_reader *lr = luaL_checkudata(L, 1, READER_MT);
+    luaL_unref(L, LUA_REGISTRYINDEX, lr->ref);
+    lr->ref = LUA_NOREF;
+    lr->source = NULL;
+
+    return 0;
+}
+
+static const luaL_Reg reader_methods[] = {
+    {"reset", l_reader_reset},
+    {"bool", l_reader_bool},
+    {"uint", l_reader_uint},
+    {"int", l_reader_int},
+    {"varint", l_reader_varint},
+    {"float", l_reader_float},
+    {"string", l_reader_string},
+    {"ok", l_reader_ok},
+    {"__gc", l_reader_gc},
+    {NULL, NULL}
+};
+
+// schema
+
+enum {
+    SCHEMA_BOOL,
+    SCHEMA_UINT,
+    SCHEMA_INT,
+    SCHEMA_VARINT,
+    SCHEMA_FLOAT,
+    SCHEMA_STRING,
+};
+
+static const char *const schema_types[] = {"bool", "uint", "int", "varint", "float", "string", NULL};
+
+// one field of a declared message, the arguments the matching writer method takes
+struct schema_field {
+    int type;
+    uint32_t bits;
+    double min;
+    double max;
+};
+
+// the field names live in the userdata's environment table, same order, already interned
+struct lua_schema {
+    uint32_t count;
+    // fixed size fields, strings are reserved for when they are written
+    uint64_t bits;
+    struct schema_field fields[];
+};
+
+static double field_number(lua_State *L, const int decl, const int index, const int field) {
+    lua_rawgeti(L, decl, index);
+    if (!lua_isnumber(L, -1)) {
+        luaL_error(L, "core.schema.new: field %d needs a number at %d", field, index);
+    }
+
+    const double value = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    return value;
+}
+
+static uint32_t field_bits(lua_State *L, const int decl, const int index, const int field) {
+    const double bits = field_number(L, decl, index, field);
+    if (!(bits >= 1 && bits <= 32)) {
+        luaL_error(L, "core.schema.new: field %d bits must be 1 to 32", field);
+    }
+
+    return (uint32_t) bits;
+}
+
+// core.schema.new({{"x", "float", min, max, bits}, {"id", "varint"}, ...}),
+// each field is a name, a type and whatever the writer method of that type takes after the value
+static int l_schema_new(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    const int count = (int) lua_objlen(L, 1);
+
+    struct lua_schema *schema = lua_newuserdata(L, sizeof(*schema) + (size_t) count * sizeof(schema->fields[0]));
+    schema->count = (uint32_t) count;
+    schema->bits = 0;
+
+    lua_createtable(L, count, 0);
+
+    for (int i = 1; i <= count; i++) {
+        struct schema_field *f = &schema->fields[i - 1];
+        *f = (struct schema_field){0};
+
+        lua_rawgeti(L, 1, i);
+        const int decl = lua_gettop(L);
+        if (!lua_istable(L, decl)) {
+            return luaL_error(L, "core.schema.new: field %d is not a table", i);
+        }
+
+        lua_rawgeti(L, decl, 1);
+        if (lua_type(L, -1) != LUA_TSTRING) {
+            return luaL_error(L, "core.schema.new: field %d has no name", i);
+        }
+        lua_rawseti(L, -3, i);
+
+        lua_rawgeti(L, decl, 2);
+        const char *type = lua_tostring(L, -1);
+        f->type = -1;
+        for (int t = 0; type && schema_types[t]; t++) {
+            if (!strcmp(type, schema_types[t])) {
+                f->type = t;
+            }
+        }
+        lua_pop(L, 1);
+
+        switch (f->type) {
+        case SCHEMA_BOOL:
+            f->bits = 1;
+            break;
+        case SCHEMA_UINT:
+            f->bits = field_bits(L, decl, 3, i);
+            break;
+        case SCHEMA_INT:
+            f->min = field_number(L, decl, 3, i);
+            f->max = field_number(L, decl, 4, i);
+            if (floor(f->min) != f->min || floor(f->max) != f->max) {
+                return luaL_error(L, "core.schema.new: field %d needs integer bounds", i);
+            }
+            if (!(f->max - f->min >= 1 && f->max - f->min <= UINT32_MAX)) {
+                return luaL_error(L, "core.schema.new: field %d has an empty or too wide range", i);
+            }
+            f->bits = 32 - (uint32_t) __builtin_clz((uint32_t) (f->max - f->min));
+            break;
+        case SCHEMA_VARINT:
+        case SCHEMA_STRING:
+            f->bits = BITSTREAM_VAR_BITS + 31;
+            break;
+        case SCHEMA_FLOAT:
+            f->min = field_number(L, decl, 3, i);
+            f->max = field_number(L, decl, 4, i);
+            f->bits = field_bits(L, decl, 5, i);
+            if (!(f->min < f->max)) {
+                return luaL_error(L, "core.schema.new: field %d has an empty range", i);
+            }
+            break;
+        default:
+            return luaL_error(L, "core.schema.new: field %d has an unknown type", i);
+        }
+
+        schema->bits += f->bits;
+        lua_pop(L, 1);
+    }
+
+    lua_setfenv(L, -2);
+
+    luaL_getmetatable(L, SCHEMA_MT);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+// schema:encode(writer, t), appends the fields of `t` in declared order and returns the writer
+static int l_schema_encode(lua_State *L) {
+    struct lua_schema *schema = luaL_checkudata(L, 1, SCHEMA_MT);
+    struct lua_writer *lw = luaL_checkudata(L, 2, WRITER_MT);
+    luaL_checktype(L, 3, LUA_TTABLE);
+
+    lua_getfenv(L, 1);
+    const int names = lua_gettop(L);
+    writer_reserve(L, lw, schema->bits);
+
+    for (uint32_t i = 0; i < schema->count; i++) {
+        const struct schema_field *f = &schema->fields[i];
+
+        lua_rawgeti(L, names, (int) i + 1);
+        lua_rawget(L, 3);
+
+        if (f->type == SCHEMA_BOOL) {
+            bitstream_write(&lw->b, lua_toboolean(L, -1), 1);
+            lua_pop(L, 1);
+            continue;
+        }
+
+        if (f->type == SCHEMA_STRING ? lua_type(L, -1) != LUA_TSTRING : !lua_isnumber(L, -1)) {
+            lua_rawgeti(L, names, (int) i + 1);
+            return luaL_error(L, "schema:encode: field %s is not a %s", lua_tostring(L, -1), schema_types[f->type]);
+        }
+
+        const double value = lua_tonumber(L, -1);
+
+        switch (f->type) {
+        case SCHEMA_UINT:
+        case SCHEMA_VARINT:
+            if (!(value >= 0 && value <= UINT32_MAX) || (f->type == SCHEMA_UINT && f->bits < 32 && value >= (double) (1u << f->bits))) {
+                lua_rawgeti(L, names, (int) i + 1);
+                return luaL_error(L, "schema:encode: field %s out of range", lua_tostring(L, -1));
+            }
+            if (f->type == SCHEMA_UINT) {
+                bitstream_write(&lw->b, (uint32_t) value, f->bits);
+            } else {
+                bitstream_write_var(&lw->b, (uint32_t) value);
+            }
+            break;
+        case SCHEMA_INT:
+            if (floor(value) != value) {
+                lua_rawgeti(L, names, (int) i + 1);
+                return luaL_error(L, "schema:encode: field %s is not an integer", lua_tostring(L, -1));
+            }
+            if (!(value >= f->min && value <= f->max)) {
+                lua_rawgeti(L, names, (int) i + 1);
+                return luaL_error(L, "schema:encode: field %s out of range", lua_tostring(L, -1));
+            }
+            bitstream_write(&lw->b, (uint32_t) (value - f->min), f->bits);
+            break;
+        case SCHEMA_FLOAT:
+            bitstream_write_float(&lw->b, value, f->min, f->max, f->bits);
+            break;
+        case SCHEMA_STRING: {
+            size_t len;
+            const char *str = lua_tolstring(L, -1, &len);
+            if (len > UINT32_MAX / 8) {
+                return luaL_error(L, "schema:encode: string too long");
+            }
+
+            writer_reserve(L, lw, (uint64_t) len * 8);
+            bitstream_write_var(&lw->b, (uint32_t) len);
+            for (size_t c = 0; c < len; c++) {
+                bitstream_write(&lw->b, (uint8_t) str[c], 8);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        lua_pop(L, 1);
+    }
+
+    lua_settop(L, 2);
+
+    return 1;
+}
+
+// schema:decode(reader, [t]), fills `t` or a new table. nil when the message was short or malformed
+static int l_schema_decode(lua_State *L) {
+    struct lua_schema *schema = luaL_checkudata(L, 1, SCHEMA_MT);
+    struct lua_reader *lr = check_reader(L, 2);
+
+    if (lua_istable(L, 3)) {
+        lua_settop(L, 3);
+    } else {
+        lua_settop(L, 2);
+        lua_createtable(L, 0, (int) schema->count);
+    }
+
+    lua_getfenv(L, 1);
+    const int names = lua_gettop(L);
+
+    for (uint32_t i = 0; i < schema->count && !lr->b.error; i++) {
+        const struct schema_field *f = &schema->fields[i];
+
+        lua_rawgeti(L, names, (int) i + 1);
+
+        switch (f->type) {
+        case SCHEMA_BOOL:
+            lua_pushboolean(L, bitstream_read(&lr->b, 1));
+            break;
+        case SCHEMA_UINT:
+            lua_pushnumber(L, bitstream_read(&lr->b, f->bits));
+            break;
+        case SCHEMA_INT: {
+            const uint32_t value = bitstream_read(&lr->b, f->bits);
+            if (value > f->max - f->min) {
+                lr->b.error = true;
+            }
+            lua_pushnumber(L, f->min + value);
+            break;
+        }
+        case SCHEMA_VARINT:
+            lua_pushnumber(L, bitstream_read_var(&lr->b));
+            break;
+        case SCHEMA_FLOAT:
+            lua_pushnumber(L, bitstream_read_float(&lr->b, f->min, f->max, f->bits));
+            break;
+        case SCHEMA_STRING: {
+            const uint32_t len = bitstream_read_var(&lr->b);
+            luaL_Buffer buf;
+
+            if (lr->b.error || (uint64_t) len * 8 > bitstream_remaining(&lr->b)) {
+                lr->b.error = true;
+                lua_pushliteral(L, "");
+                break;
+            }
+
+            luaL_buffinit(L, &buf);
+            for (uint32_t c = 0; c < len; c++) {
+                luaL_addchar(&buf, (char) bitstream_read(&lr->b, 8));
+            }
+            luaL_pushresult(&buf);
+            break;
+        }
+        default:
+            lua_pushnil(L);
+            break;
+        }
+
+        lua_rawset(L, 3);
+    }
+
+    if (lr->b.error) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_settop(L, 3);
+
+    return 1;
+}
+
+static const luaL_Reg schema_methods[] = {
+    {"encode", l_schema_encode},
+    {"decode", l_schema_decode},
+    {NULL, NULL}
+};
+
+// a string or a core.bitstream writer, the writer's buffer goes to the net layer as is.
+// sequenced messages are not fragmented, over NET_SEQUENCED_PAYLOAD bytes they raise
+static const char *check_payload(lua_State *L, const int arg, const int mode, size_t *len) {
+    struct lua_writer *lw = test_writer(L, arg);
+    const char *data;
+
+    if (lw) {
+        writer_reserve(L, lw, 0);
+        *len = bitstream_bytes(&lw->b);
+        data = (const char *) lw->b.data;
+    } else {
+        data = luaL_checklstring(L, arg, len);
+    }
+    luaL_argcheck(L, mode != SEND_SEQUENCED || *len <= NET_SEQUENCED_PAYLOAD, arg,
+                  "sequenced message over core.net_sequenced_payload bytes");
+
+    return data;
+}
+
 // server
 
+// the core's epoll set, server sockets wake its main loop. -1 when nothing waits on them
+static int watch_fd = -1;
+
+static void watch(const int op, const int fd) {
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+
+    if (watch_fd >= 0 && fd >= 0 && epoll_ctl(watch_fd, op, fd, &event) != 0) {
+        perror("epoll_ctl");
+    }
+}
+
 static int l_server_new(lua_State *L) {
     const char* ip = luaL_checkstring(L, 1);
     const uint16_t port = (uint16_t) luaL_checkint(L, 2);
     const uint32_t n = (uint32_t) luaL_optint(L, 3, 32);
+    const uint32_t max_message = (uint32_t) luaL_optint(L, 4, 0);
 
-    struct net_server *server = net_server_create(ip, port, n);
+    struct net_server *server = net_server_create(ip, port, n, max_message);
     if (!server) {
         luaL_error(L, "core.server.new: failed on port %d", port);
     }
 
     struct net_server **sp = lua_newuserdata(L, sizeof(*sp));
     *sp = server;
+    watch(EPOLL_CTL_ADD, net_server_fd(server));
 
     luaL_getmetatable(L, SERVER_MT);
     lua_setmetatable(L, -2);
@@ -332,6 +1217,28 @@ static int l_server_new(lua_State *L) {
     return 1;
 }
 
+// type, id, data (nil unless a data event). with a reader as upvalue 1 the data is that reader pointed
+// at the message where it lies, valid until the loop moves on. without one the message is copied into a string
+static int push_view(lua_State *L, const struct net_view *view) {
+    lua_pushinteger(L, view->type);
+    lua_pushinteger(L, view->client_id);
+
+    if (view->type != NET_EVENT_DATA) {
+        lua_pushnil(L);
+    } else if (lua_isnil(L, lua_upvalueindex(1))) {
+        lua_pushlstring(L, (const char *) view->data, view->len);
+    } else {
+        struct lua_reader *lr = lua_touserdata(L, lua_upvalueindex(1));
+        luaL_unref(L, LUA_REGISTRYINDEX, lr->ref);
+        lr->ref = LUA_NOREF;
+        lr->source = NULL;
+        bitstream_reader(&lr->b, view->data, view->len);
+        lua_pushvalue(L, lua_upvalueindex(1));
+    }
+
+    return 3;
+}
+
 static int l_server_poll(lua_State *L) {
     struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
     struct net_event event;
@@ -345,9 +1252,34 @@ static int l_server_poll(lua_State *L) {
     return 1;
 }
 
+static int l_server_events_next(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    const struct net_view *view = *sp ? net_server_poll_view(*sp) : NULL;
+
+    return view ? push_view(L, view) : 0;
+}
+
+// for type, id, data in server:events([reader]) do ... end
+// no table per event, the views are read straight out of the receive batch. given a reader, data is
+// that reader reset onto the message without a copy, otherwise a string. the batch is kept in the server,
+// a loop left through break or an error resumes with the next view on the next call
+static int l_server_events(lua_State *L) {
+    luaL_checkudata(L, 1, SERVER_MT);
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checkudata(L, 2, READER_MT);
+    }
+
+    lua_settop(L, 2);
+    lua_pushcclosure(L, l_server_events_next, 1);
+    lua_pushvalue(L, 1);
+
+    return 2;
+}
+
 static int l_server_close(lua_State *L) {
     struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
     if (*sp) {
+        watch(EPOLL_CTL_DEL, net_server_fd(*sp));
         net_server_destroy(*sp);
         *sp = NULL;
     }
@@ -355,35 +1287,177 @@ static int l_server_close(lua_State *L) {
     return 0;
 }
 
+// server:send(id, data, [mode], [channel]), mode is "unreliable" (default), "reliable" or "sequenced",
+// returns false when a reliable message does not fit the peer's queue.
+// sequenced messages older than the newest on their channel are dropped by the receiver, they are not
+// fragmented and raise over core.net_sequenced_payload bytes
 static int l_server_send(lua_State *L) {
     struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
     const uint32_t client_id = (uint32_t) luaL_checkint(L, 2);
+    const int mode = luaL_checkoption(L, 4, "unreliable", send_modes);
     size_t len;
-    const char *data = luaL_checklstring(L, 3, &len);
-
-    if (*sp) {
+    const char *data = check_payload(L, 3, mode, &len);
+    bool sent = false;
+
+    if (*sp && mode == SEND_RELIABLE) {
+        sent = net_server_send_reliable(*sp, client_id, data, (uint32_t) len);
+    } else if (*sp && mode == SEND_SEQUENCED) {
+        sent = net_server_send_sequenced(*sp, client_id, check_channel(L, 5), data, (uint32_t) len);
+    } else if (*sp) {
         net_server_send(*sp, client_id, data, (uint32_t) len);
+        sent = true;
     }
 
-    return 0;
+    lua_pushboolean(L, sent);
+
+    return 1;
 }
 
 static int l_server_broadcast(lua_State *L) {
     struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    const int mode = luaL_checkoption(L, 3, "unreliable", send_modes);
     size_t len;
-    const char *data = luaL_checklstring(L, 2, &len);
+    const char *data = check_payload(L, 2, mode, &len);
 
-    if (*sp) {
+    if (*sp && mode == SEND_RELIABLE) {
+        net_server_broadcast_reliable(*sp, data, (uint32_t) len);
+    } else if (*sp && mode == SEND_SEQUENCED) {
+        net_server_broadcast_sequenced(*sp, check_channel(L, 4), data, (uint32_t) len);
+    } else if (*sp) {
         net_server_broadcast(*sp, data, (uint32_t) len);
     }
 
     return 0;
 }
 
+// server:set_position(id, {x, y}, [view]), where the peer is for broadcast_near and how far it sees
+static int l_server_set_position(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    const uint32_t client_id = (uint32_t) luaL_checkint(L, 2);
+    const struct vec2 pos = check_vec2(L, 3);
+    const bool placed = *sp && net_server_set_position(*sp, client_id, pos.x, pos.y);
+
+    if (placed && !lua_isnoneornil(L, 4)) {
+        net_server_set_view(*sp, client_id, luaL_checknumber(L, 4));
+    }
+    lua_pushboolean(L, placed);
+
+    return 1;
+}
+
+// server:broadcast_near({x, y}, radius, data, [mode], [channel]), to the peers whose view reaches the circle
+static int l_server_broadcast_near(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    const struct vec2 pos = check_vec2(L, 2);
+    const double radius = luaL_checknumber(L, 3);
+    const int mode = luaL_checkoption(L, 5, "unreliable", send_modes);
+    size_t len;
+    const char *data = check_payload(L, 4, mode, &len);
+
+    if (*sp && mode == SEND_RELIABLE) {
+        net_server_broadcast_near_reliable(*sp, pos.x, pos.y, radius, data, (uint32_t) len);
+    } else if (*sp && mode == SEND_SEQUENCED) {
+        net_server_broadcast_near_sequenced(*sp, pos.x, pos.y, radius, check_channel(L, 6), data, (uint32_t) len);
+    } else if (*sp) {
+        net_server_broadcast_near(*sp, pos.x, pos.y, radius, data, (uint32_t) len);
+    }
+
+    return 0;
+}
+
+static int l_server_flush(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    if (*sp) {
+        net_server_flush(*sp);
+    }
+
+    return 0;
+}
+
+static int l_server_start_thread(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    const int fd = *sp ? net_server_fd(*sp) : -1;
+    const bool started = *sp && net_server_start_thread(*sp);
+
+    // the thread reads the socket now, the main loop only wakes for ticks
+    if (started) {
+        watch(EPOLL_CTL_DEL, fd);
+    }
+    lua_pushboolean(L, started);
+
+    return 1;
+}
+
+static int l_server_io_stats(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    if (!*sp) {
+        return 0;
+    }
+
+    return push_io_stats(L, net_server_io_stats(*sp));
+}
+
+// what broadcast_near left out, bytes_skipped is the bandwidth saved against a plain broadcast
+static int l_server_aoi_stats(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    if (!*sp) {
+        return 0;
+    }
+
+    const struct net_aoi_stats *stats = net_server_aoi_stats(*sp);
+    lua_newtable(L);
+    lua_pushinteger(L, stats->broadcasts);
+    lua_setfield(L, -2, "broadcasts");
+
+    lua_pushinteger(L, stats->sent);
+    lua_setfield(L, -2, "sent");
+
+    lua_pushinteger(L, stats->skipped);
+    lua_setfield(L, -2, "skipped");
+
+    lua_pushinteger(L, stats->bytes_sent);
+    lua_setfield(L, -2, "bytes_sent");
+
+    lua_pushinteger(L, stats->bytes_skipped);
+    lua_setfield(L, -2, "bytes_skipped");
+
+    return 1;
+}
+
+// server:stats([id]), one connected peer or, without an id, every peer since the server started
+static int l_server_stats(lua_State *L) {
+    struct net_server **sp = luaL_checkudata(L, 1, SERVER_MT);
+    if (!*sp) {
+        return 0;
+    }
+
+    if (lua_isnoneornil(L, 2)) {
+        struct net_peer_stats total;
+        net_server_total_stats(*sp, &total);
+
+        return push_peer_stats(L, &total);
+    }
+
+    const struct net_peer_stats *stats = net_server_peer_stats(*sp, (uint32_t) luaL_checkint(L, 2));
+    if (!stats) {
+        return 0;
+    }
+
+    return push_peer_stats(L, stats);
+}
+
 static const luaL_Reg server_methods[] = {
     {"poll", l_server_poll},
+    {"events", l_server_events},
     {"send", l_server_send},
     {"broadcast", l_server_broadcast},
+    {"set_position", l_server_set_position},
+    {"broadcast_near", l_server_broadcast_near},
+    {"flush", l_server_flush},
+    {"start_thread", l_server_start_thread},
+    {"io_stats", l_server_io_stats},
+    {"aoi_stats", l_server_aoi_stats},
+    {"stats", l_server_stats},
     {"close", l_server_close},
     {"__gc", l_server_close},
     {NULL,NULL},
@@ -422,6 +1496,26 @@ static int l_client_poll(lua_State *L) {
     return 1;
 }
 
+static int l_client_events_next(lua_State *L) {
+    struct net_client **cp = luaL_checkudata(L, 1, CLIENT_MT);
+    const struct net_view *view = *cp ? net_client_poll_view(*cp) : NULL;
+
+    return view ? push_view(L, view) : 0;
+}
+
+static int l_client_events(lua_State *L) {
+    luaL_checkudata(L, 1, CLIENT_MT);
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checkudata(L, 2, READER_MT);
+    }
+
+    lua_settop(L, 2);
+    lua_pushcclosure(L, l_client_events_next, 1);
+    lua_pushvalue(L, 1);
+
+    return 2;
+}
+
 static int l_client_connected(lua_State *L) {
     struct net_client **cp = luaL_checkudata(L, 1, CLIENT_MT);
     lua_pushboolean(L, *cp && (*cp)->connected);
@@ -439,27 +1533,228 @@ static int l_client_close(lua_State *L) {
     return 0;
 }
 
+// client:send(data, [mode], [channel]), same modes as server:send
 static int l_client_send(lua_State *L) {
     struct net_client **cp = luaL_checkudata(L, 1, CLIENT_MT);
+    const int mode = luaL_checkoption(L, 3, "unreliable", send_modes);
     size_t len;
-    const char *data = luaL_checklstring(L, 2, &len);
-
-    if (*cp && (*cp)->connected) {
+    const char *data = check_payload(L, 2, mode, &len);
+    bool sent = false;
+
+    if (*cp && (*cp)->connected && mode == SEND_RELIABLE) {
+        sent = net_client_send_reliable(*cp, data, (uint32_t) len);
+    } else if (*cp && (*cp)->connected && mode == SEND_SEQUENCED) {
+        sent = net_client_send_sequenced(*cp, check_channel(L, 4), data, (uint32_t) len);
+    } else if (*cp && (*cp)->connected) {
         net_client_send(*cp, data, (uint32_t) len);
+        sent = true;
+    }
+
+    lua_pushboolean(L, sent);
+
+    return 1;
+}
+
+static int l_client_flush(lua_State *L) {
+    struct net_client **cp = luaL_checkudata(L, 1, CLIENT_MT);
+    if (*cp) {
+        net_client_flush(*cp);
     }
 
     return 0;
 }
 
+static int l_client_start_thread(lua_State *L) {
+    struct net_client **cp = luaL_checkudata(L, 1, CLIENT_MT);
+    lua_pushboolean(L, *cp && net_client_start_thread(*cp));
+
+    return 1;
+}
+
+static int l_client_io_stats(lua_State *L) {
+    struct net_client **cp = luaL_checkudata(L, 1, CLIENT_MT);
+    if (!*cp) {
+        return 0;
+    }
+
+    return push_io_stats(L, net_client_io_stats(*cp));
+}
+
+// client:stats(), traffic with the server since the last connect
+static int l_client_stats(lua_State *L) {
+    struct net_client **cp = luaL_checkudata(L, 1, CLIENT_MT);
+    if (!*cp) {
+        return 0;
+    }
+
+    return push_peer_stats(L, net_client_peer_stats(*cp));
+}
+
 static const luaL_Reg client_methods[] = {
     {"poll", l_client_poll},
+    {"events", l_client_events},
     {"send", l_client_send},
+    {"flush", l_client_flush},
+    {"start_thread", l_client_start_thread},
+    {"io_stats", l_client_io_stats},
+    {"stats", l_client_stats},
     {"connected", l_client_connected},
     {"close", l_client_close},
     {"__gc", l_client_close},
     {NULL, NULL}
 };
 
+// snapshot
+
+// the server's recent world states, or on a client what it decoded of them
+struct lua_snapshot {
+    struct snapshot_history history;
+    double scale;
+    // the tick add() fills, sorted by the first encode
+    uint32_t tick;
+    bool open;
+};
+
+// core.snapshot.new([scale])
+static int l_snapshot_new(lua_State *L) {
+    const double scale = luaL_optnumber(L, 1, SNAPSHOT_SCALE);
+    luaL_argcheck(L, scale > 0.0, 1, "scale must be positive");
+
+    struct lua_snapshot *ls = lua_newuserdata(L, sizeof(*ls));
+    memset(ls, 0, sizeof(*ls));
+    ls->scale = scale;
+
+    luaL_getmetatable(L, SNAPSHOT_MT);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+// snapshot:begin(), starts the next tick and returns it
+static int l_snapshot_begin(lua_State *L) {
+    struct lua_snapshot *ls = luaL_checkudata(L, 1, SNAPSHOT_MT);
+
+    snapshot_begin(&ls->history, ++ls->tick);
+    ls->open = true;
+    lua_pushinteger(L, ls->tick);
+
+    return 1;
+}
+
+// snapshot:add(id, ...), up to SNAPSHOT_FIELDS numbers
+static int l_snapshot_add(lua_State *L) {
+    struct lua_snapshot *ls = luaL_checkudata(L, 1, SNAPSHOT_MT);
+    const uint32_t id = (uint32_t) luaL_checknumber(L, 2);
+    int32_t fields[SNAPSHOT_FIELDS] = {0};
+
+    if (!ls->open) {
+        return luaL_error(L, "snapshot:add: call begin first");
+    }
+
+    for (int f = 0; f < SNAPSHOT_FIELDS; f++) {
+        fields[f] = (int32_t) lround(luaL_optnumber(L, 3 + f, 0.0) * ls->scale);
+    }
+
+    if (!snapshot_add(&ls->history.ticks[ls->tick & (SNAPSHOT_HISTORY - 1)], id, fields)) {
+        return luaL_error(L, "snapshot:add: out of memory");
+    }
+
+    return 0;
+}
+
+// snapshot:encode(writer, [acked]), appends the current tick as changes since `acked`, in full when
+// that tick is gone
+static int l_snapshot_encode(lua_State *L) {
+    struct lua_snapshot *ls = luaL_checkudata(L, 1, SNAPSHOT_MT);
+    struct lua_writer *lw = luaL_checkudata(L, 2, WRITER_MT);
+    const uint32_t acked = (uint32_t) luaL_optnumber(L, 3, 0);
+    struct snapshot *s = &ls->history.ticks[ls->tick & (SNAPSHOT_HISTORY - 1)];
+
+    if (!ls->tick) {
+        return luaL_error(L, "snapshot:encode: call begin first");
+    }
+
+    if (ls->open) {
+        snapshot_end(s);
+        ls->open = false;
+    }
+
+    const struct snapshot *baseline = snapshot_find(&ls->history, acked);
+    writer_reserve(L, lw, (uint64_t) snapshot_bound(baseline, s) * 8);
+    snapshot_encode(baseline, s, &lw->b);
+    lua_settop(L, 2);
+
+    return 1;
+}
+
+// snapshot:decode(reader), the tick it held or nil when its baseline is gone
+static int l_snapshot_decode(lua_State *L) {
+    struct lua_snapshot *ls = luaL_checkudata(L, 1, SNAPSHOT_MT);
+    struct lua_reader *lr = check_reader(L, 2);
+
+    const uint32_t tick = snapshot_decode(&ls->history, &lr->b);
+    if (!tick) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, tick);
+
+    return 1;
+}
+
+static int l_snapshot_entities_next(lua_State *L) {
+    struct lua_snapshot *ls = luaL_checkudata(L, 1, SNAPSHOT_MT);
+    const uint32_t tick = (uint32_t) lua_tointeger(L, lua_upvalueindex(1));
+    const uint32_t i = (uint32_t) lua_tointeger(L, lua_upvalueindex(2));
+
+    // looked up every step, a decode in the loop body may reuse the slot
+    const struct snapshot *s = snapshot_find(&ls->history, tick);
+    if (!s || i >= s->count) {
+        return 0;
+    }
+
+    lua_pushinteger(L, i + 1);
+    lua_replace(L, lua_upvalueindex(2));
+
+    lua_pushinteger(L, s->entities[i].id);
+    for (int f = 0; f < SNAPSHOT_FIELDS; f++) {
+        lua_pushnumber(L, s->entities[i].fields[f] / ls->scale);
+    }
+
+    return 1 + SNAPSHOT_FIELDS;
+}
+
+// for id, x, y in snapshot:entities(tick) do ... end
+static int l_snapshot_entities(lua_State *L) {
+    luaL_checkudata(L, 1, SNAPSHOT_MT);
+    const lua_Integer tick = luaL_checkinteger(L, 2);
+
+    lua_pushinteger(L, tick);
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, l_snapshot_entities_next, 2);
+    lua_pushvalue(L, 1);
+
+    return 2;
+}
+
+static int l_snapshot_gc(lua_State *L) {
+    struct lua_snapshot *ls = luaL_checkudata(L, 1, SNAPSHOT_MT);
+    snapshot_history_deinit(&ls->history);
+
+    return 0;
+}
+
+static const luaL_Reg snapshot_methods[] = {
+    {"begin", l_snapshot_begin},
+    {"add", l_snapshot_add},
+    {"encode", l_snapshot_encode},
+    {"decode", l_snapshot_decode},
+    {"entities", l_snapshot_entities},
+    {"__gc", l_snapshot_gc},
+    {NULL, NULL}
+};
+
 static void meta(lua_State *L, const char *name, const luaL_Reg *methods) {
     luaL_newmetatable(L, name);
     lua_pushvalue(L, -1);
@@ -514,6 +1809,12 @@ static const luaL_Reg api[] = {
     {"load_texture", l_load_texture},
     {"load_font", l_load_font},
     {"get_screen_dimensions", l_get_screen_dimensions},
+    {"get_render_stats", l_get_render_stats},
+    {"set_camera", l_set_camera},
+    {"layer_begin", l_layer_begin},
+    {"layer_end", l_layer_end},
+    {"layer_draw", l_layer_draw},
+    {"layer_free", l_layer_free},
 
     /* ui */
     {"button", l_button},
@@ -645,9 +1946,17 @@ static void loader_init(lua_State *L) {
     lua_pop(L, 2);
 }
 
+void lua_api_watch(const int poll_fd) {
+    watch_fd = poll_fd;
+}
+
 void lua_api_init(lua_State *L) {
     meta(L, SERVER_MT, server_methods);
     meta(L, CLIENT_MT, client_methods);
+    meta(L, SNAPSHOT_MT, snapshot_methods);
+    meta(L, WRITER_MT, writer_methods);
+    meta(L, READER_MT, reader_methods);
+    meta(L, SCHEMA_MT, schema_methods);
 
     lua_newtable(L);
     for (const luaL_Reg *f = api; f->name; f++) {
@@ -667,6 +1976,26 @@ void lua_api_init(lua_State *L) {
     lua_setfield(L, -2, "new");
     lua_setfield(L, -2, "client");
 
+    /* core.bitstream */
+    lua_newtable(L);
+    lua_pushcfunction(L, l_writer_new);
+    lua_setfield(L, -2, "writer");
+    lua_pushcfunction(L, l_reader_new);
+    lua_setfield(L, -2, "reader");
+    lua_setfield(L, -2, "bitstream");
+
+    /* core.schema */
+    lua_newtable(L);
+    lua_pushcfunction(L, l_schema_new);
+    lua_setfield(L, -2, "new");
+    lua_setfield(L, -2, "schema");
+
+    /* core.snapshot */
+    lua_newtable(L);
+    lua_pushcfunction(L, l_snapshot_new);
+    lua_setfield(L, -2, "new");
+    lua_setfield(L, -2, "snapshot");
+
     /* core.net_event */
     lua_newtable(L);
     lua_pushinteger(L, NET_EVENT_CONNECT);
@@ -677,6 +2006,14 @@ void lua_api_init(lua_State *L) {
     lua_setfield(L, -2, "data");
     lua_setfield(L, -2, "net_event");
 
+    /* core.net_channels, number of sequenced channels */
+    lua_pushinteger(L, NET_SEQUENCED_CHANNELS);
+    lua_setfield(L, -2, "net_channels");
+
+    /* core.net_sequenced_payload, largest sequenced message in bytes */
+    lua_pushinteger(L, NET_SEQUENCED_PAYLOAD);
+    lua_setfield(L, -2, "net_sequenced_payload");
+
     /* core.anchor */
     lua_newtable(L);
     lua_pushinteger(L, ANCHOR_TOP_LEFT);
@@ -687,6 +2024,18 @@ void lua_api_init(lua_State *L) {
     lua_setfield(L, -2, "center");
     lua_setfield(L, -2, "anchor");
 
+    /* core.layer */
+    lua_newtable(L);
+    lua_pushinteger(L, RENDERER_LAYER_MIN);
+    lua_setfield(L, -2, "min");
+    lua_pushinteger(L, RENDERER_LAYER_DEFAULT);
+    lua_setfield(L, -2, "default");
+    lua_pushinteger(L, RENDERER_LAYER_UI);
+    lua_setfield(L, -2, "ui");
+    lua_pushinteger(L, RENDERER_LAYER_MAX);
+    lua_setfield(L, -2, "max");
+    lua_setfield(L, -2, "layer");
+
     lua_setglobal(L, "core");
 
     keys_init(L);
@@ -5,4 +5,7 @@
 
 void lua_api_init(lua_State * L);
 
+/* every core.server socket is added to this epoll set while the io thread does not own it */
+void lua_api_watch(int poll_fd);
+
 #endif /* CORE_LUA_API_H */
\ No newline at end of file
@@ -1,21 +1,51 @@
+#define _GNU_SOURCE
+
 #include "net.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <pthread.h>
 #include <time.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define HEADER 5
+// kind and length in front of every message in a PACKET_BATCH
+#define RECORD 3
+
+// older libc headers predate udp gso
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
 
 enum {
     PACKET_CONNECT,
     PACKET_CONNECT_ACKNOWLEDGMENT,
     PACKET_DISCONNECT,
     PACKET_DATA,
+    PACKET_RELIABLE,
+    PACKET_ACK,
+    PACKET_SEQUENCED,
+    // records of kind, u16 length and body, each one a PACKET_DATA or PACKET_SEQUENCED without its header
+    PACKET_BATCH,
+    // message id, index and count, then up to NET_FRAGMENT_PAYLOAD bytes of a large PACKET_DATA
+    PACKET_FRAGMENT,
+    // a PACKET_RELIABLE whose message continues in the next sequence
+    PACKET_RELIABLE_FRAGMENT,
 };
 
 static double net_time(void) {
@@ -75,383 +105,2451 @@ static uint32_t resolve(const char *host, const uint16_t port, struct net_addr *
     return 1;
 }
 
-static void udp_send(const int fd, const struct net_addr *to, const void *data, const uint32_t len) {
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = to->port,
-        .sin_addr.s_addr = to->host,
-    };
+#define DATAGRAM (HEADER + NET_PAYLOAD)
+// the kernel splits at most this many segments out of one gso send
+#define GSO_SEGMENTS 64
+
+// one datagram in a ring between the io thread and the game
+struct net_slot {
+    struct net_addr addr;
+    uint32_t len;
+    // when the io thread received it
+    double time;
+    uint8_t data[DATAGRAM];
+};
 
-    sendto(fd, data, len, 0, (struct sockaddr *) &addr, sizeof(addr));
-}
+// single producer, single consumer. head is only written by the producer, tail only by the consumer,
+// both only ever grow and wrap through the NET_RING slots
+struct net_ring {
+    struct net_slot *slots;
+    uint32_t head;
+    // keeps tail off head's cache line, the two sides write them from different cores
+    uint8_t pad[64];
+    uint32_t tail;
+};
 
-static int udp_recv(const int fd, struct net_addr *from, void *buf, const uint32_t max) {
-    struct sockaddr_in addr;
-    socklen_t alen = sizeof(addr);
+struct net_io {
+    int fd;
+    // UDP_SEGMENT works on this socket, cleared if the kernel refuses it later
+    bool gso;
+
+    // filled by one recvmmsg, handed out one at a time
+    uint8_t recv_buf[NET_BATCH][DATAGRAM];
+    struct sockaddr_in recv_addr[NET_BATCH];
+    struct iovec recv_iov[NET_BATCH];
+    struct mmsghdr recv_msgs[NET_BATCH];
+    uint32_t recv_count;
+    uint32_t recv_next;
+
+    // handed out by the poll_batch calls, data points into recv_buf
+    struct net_view views[NET_BATCH];
+    // views in the batch and how many of them were handed out, the next batch is only read once all were
+    uint32_t views_count;
+    uint32_t views_next;
+    // a view points into a reassembly buffer the next fragment may reuse, the batch ends there
+    bool hold;
+
+    // the rest of the PACKET_BATCH being unpacked, one record per event
+    const uint8_t *unpack;
+    uint32_t unpack_len;
+    struct net_addr unpack_from;
+    double unpack_time;
+
+    uint8_t send_buf[NET_BATCH][DATAGRAM];
+    struct net_addr send_to[NET_BATCH];
+    uint32_t send_len[NET_BATCH];
+    uint32_t send_count;
+
+    struct net_io_stats stats;
+
+    // with the io thread running the socket belongs to it, the game only touches the rings.
+    // the thread sleeps in poll on the socket and wake_fd
+    bool threaded;
+    pthread_t thread;
+    int wake_fd;
+    bool stop;
+    bool sleeping;
+
+    // socket to game and game to socket
+    struct net_ring in;
+    struct net_ring out;
+    // game side: next slot to read, the head the last refill saw, next slot to fill and the tail last seen
+    uint32_t in_read;
+    uint32_t in_end;
+    uint32_t out_write;
+    uint32_t out_tail;
+    // written instead of a slot when the send ring is full
+    uint8_t spill[DATAGRAM];
+
+    // what the thread counted, copied into stats by io_stats
+    struct net_io_stats shared;
+};
 
-    const int n = (int) recvfrom(fd, buf, max, 0, (struct sockaddr *) &addr, &alen);
-    if (n <= 0) {
-        return -1;
+static struct net_io *io_create(const int fd) {
+    struct net_io *io = calloc(1, sizeof(*io));
+    if (!io) {
+        return NULL;
     }
 
-    *from = (struct net_addr){
-        .host = addr.sin_addr.s_addr,
-        .port = addr.sin_port,
-    };
+    io->fd = fd;
+    io->wake_fd = -1;
 
-    return n;
+    for (uint32_t i = 0; i < NET_BATCH; i++) {
+        io->recv_iov[i] = (struct iovec){
+            .iov_base = io->recv_buf[i],
+            .iov_len = DATAGRAM,
+        };
+    }
+
+    // kernels without udp gso reject the option entirely
+    int segment = 0;
+    socklen_t len = sizeof(segment);
+    io->gso = NET_BATCH > 1 && getsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, &len) == 0;
+
+    return io;
 }
 
-static void packet_pack(uint8_t *buf, const uint32_t type) {
-    const uint32_t id = NET_PROTOCOL_ID;
-    buf[0] = (uint8_t) id;
-    buf[1] = (uint8_t) (id >> 8);
-    buf[2] = (uint8_t) (id >> 16);
-    buf[3] = (uint8_t) (id >> 24);
-    buf[4] = (uint8_t) type;
+static uint32_t addr_eq(const struct net_addr *a, const struct net_addr *b) {
+    return a->host == b->host && a->port == b->port;
 }
 
-static uint32_t packet_check(const uint8_t *buf, const int n, uint32_t *type) {
-    if (n < HEADER) {
-        return 0;
-    }
+// datagrams from `first` that can go out as one gso send: same peer, same size, only the last may be shorter
+static uint32_t io_gso_run(const struct net_io *io, const struct net_addr *to, const uint32_t *len,
+                           const uint32_t count, const uint32_t first) {
+    const uint32_t size = len[first];
+    uint32_t total = size;
+    uint32_t n = 1;
 
-    const uint32_t id = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
-    if (id != NET_PROTOCOL_ID) {
-        return 0;
+    if (!io->gso) {
+        return 1;
     }
 
-    *type = buf[4];
+    while (first + n < count && n < GSO_SEGMENTS) {
+        const uint32_t i = first + n;
 
-    return 1;
-}
+        if (!addr_eq(&to[i], &to[first]) || len[i] > size || len[i - 1] != size ||
+            total + len[i] > UINT16_MAX - 64) {
+            break;
+        }
 
-static void packet_send(const int fd, const struct net_addr *to, const uint32_t type) {
-    uint8_t buf[HEADER];
-    packet_pack(buf, type);
-    udp_send(fd, to, buf, HEADER);
+        total += len[i];
+        n++;
+    }
+
+    return n;
 }
 
-static void send_acknowledgment(const int fd, const struct net_addr *to, const uint32_t id) {
-    uint8_t buf[HEADER + 4];
-    packet_pack(buf, PACKET_CONNECT_ACKNOWLEDGMENT);
-    buf[5] = id & 0xff;
-    buf[6] = id >> 8 & 0xff;
-    buf[7] = id >> 16 & 0xff;
-    buf[8] = id >> 24 & 0xff;
+// sends `count` datagrams with as few sendmmsg calls as gso allows
+static void io_sendmmsg(struct net_io *io, struct net_io_stats *stats, uint8_t *const *bufs,
+                        const struct net_addr *to, const uint32_t *len, const uint32_t count_total) {
+    struct mmsghdr msgs[NET_BATCH];
+    struct iovec iov[NET_BATCH];
+    struct sockaddr_in addrs[NET_BATCH];
+    // uint64_t keeps the cmsg header aligned
+    uint64_t control[NET_BATCH][(CMSG_SPACE(sizeof(uint16_t)) + 7) / 8];
+    uint32_t first[NET_BATCH];
+
+    uint32_t sent = 0;
+    while (sent < count_total) {
+        uint32_t count = 0;
+
+        for (uint32_t i = sent; i < count_total; count++) {
+            const uint32_t run = io_gso_run(io, to, len, count_total, i);
+
+            addrs[count] = (struct sockaddr_in){
+                .sin_family = AF_INET,
+                .sin_port = to[i].port,
+                .sin_addr.s_addr = to[i].host,
+            };
+
+            for (uint32_t j = 0; j < run; j++) {
+                iov[i + j] = (struct iovec){
+                    .iov_base = bufs[i + j],
+                    .iov_len = len[i + j],
+                };
+            }
 
-    udp_send(fd, to, buf, HEADER + 4);
-}
+            msgs[count] = (struct mmsghdr){
+                .msg_hdr = {
+                    .msg_name = &addrs[count],
+                    .msg_namelen = sizeof(addrs[count]),
+                    .msg_iov = &iov[i],
+                    .msg_iovlen = run,
+                },
+            };
+
+            if (run > 1) {
+                msgs[count].msg_hdr.msg_control = control[count];
+                msgs[count].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+                struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[count].msg_hdr);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+                const uint16_t segment = (uint16_t) len[i];
+                memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+            }
 
-static uint32_t addr_eq(const struct net_addr *a, const struct net_addr *b) {
-    return a->host == b->host && a->port == b->port;
-}
+            first[count] = i;
+            i += run;
+        }
 
-static uint32_t peer_find(const struct net_server *server, const struct net_addr *addr) {
-    for (uint32_t i = 0; i < server->max_clients; i++) {
-        if (server->peers[i].alive && addr_eq(&server->peers[i].addr, addr)) {
-            return i;
+        uint32_t done = 0;
+        while (done < count) {
+            const int n = sendmmsg(io->fd, msgs + done, count - done, 0);
+            stats->send_calls++;
+
+            if (n > 0) {
+                done += (uint32_t) n;
+                continue;
+            }
+
+            // no gso offload on the route, send the rest as plain datagrams
+            if (io->gso && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)) {
+                io->gso = false;
+                break;
+            }
+
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // full socket buffer, the rest would fail the same way. udp drops them like sendto would
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                done = count;
+                break;
+            }
+
+            // only msgs[done] failed, an unreachable or refused peer must not cost the others their datagrams
+            done++;
         }
-    }
 
-    return UINT32_MAX;
+        const uint32_t end = done < count ? first[done] : count_total;
+        stats->send_packets += end - sent;
+        sent = end;
+    }
 }
 
-static uint32_t peer_alloc(const struct net_server *server) {
-    for (uint32_t i = 0; i < server->max_clients; i++) {
-        if (!server->peers[i].alive) {
-            return i;
+// rouses the io thread if it sleeps, the caller published first so the thread sees the change either way
+static void io_wake(struct net_io *io) {
+    if (__atomic_load_n(&io->sleeping, __ATOMIC_SEQ_CST)) {
+        const uint64_t one = 1;
+        if (write(io->wake_fd, &one, sizeof(one)) < 0) {
+            // the counter is already non-zero, the thread wakes anyway
         }
     }
-
-    return UINT32_MAX;
 }
 
-struct net_server *net_server_create(const char *ip, const uint16_t port, uint32_t n) {
-    if (n < 1) {
-        n = 1;
-    }
+static void io_flush(struct net_io *io) {
+    if (io->threaded) {
+        if (io->out_write != io->out.head) {
+            __atomic_store_n(&io->out.head, io->out_write, __ATOMIC_SEQ_CST);
+            io_wake(io);
 
-    if (n > 1024) {
-        n = 1024;
-    }
+            const uint32_t depth = io->out_write - __atomic_load_n(&io->out.tail, __ATOMIC_ACQUIRE);
+            if (depth > io->stats.send_queue_max) {
+                io->stats.send_queue_max = depth;
+            }
+        }
 
-    struct net_server *server = calloc(1, sizeof(*server));
-    if (!server) {
-        return NULL;
+        return;
     }
 
-    server->peers = calloc(n, sizeof(*server->peers));
-    if (!server->peers) {
-        free(server);
-
-        return NULL;
+    uint8_t *bufs[NET_BATCH];
+    for (uint32_t i = 0; i < io->send_count; i++) {
+        bufs[i] = io->send_buf[i];
     }
 
-    server->fd = udp_sock(ip, port);
-    if (server->fd < 0) {
-        free(server->peers);
-        free(server);
+    io_sendmmsg(io, &io->stats, bufs, io->send_to, io->send_len, io->send_count);
+    io->send_count = 0;
+}
 
-        return NULL;
-    }
+// the next `len` byte datagram of the send batch, filled in by the caller
+static uint8_t *udp_reserve(struct net_io *io, const struct net_addr *to, const uint32_t len) {
+    if (io->threaded) {
+        if (io->out_write - io->out_tail == NET_RING) {
+            io_flush(io);
+            io->out_tail = __atomic_load_n(&io->out.tail, __ATOMIC_ACQUIRE);
+        }
 
-    server->max_clients = n;
-    server->n = 0;
-    server->last_sweep = net_time();
+        // the thread fell behind by a whole ring, udp would have dropped it in the kernel just the same
+        if (io->out_write - io->out_tail == NET_RING) {
+            io->stats.send_dropped++;
+            return io->spill;
+        }
 
-    return server;
-}
+        struct net_slot *slot = &io->out.slots[io->out_write++ & (NET_RING - 1)];
+        slot->addr = *to;
+        slot->len = len;
 
-void net_server_destroy(struct net_server *server) {
-    if (!server) {
-        return;
+        return slot->data;
     }
 
-    for (uint32_t i = 0; i < server->max_clients; i++) {
-        if (server->peers[i].alive) {
-            packet_send(server->fd, &server->peers[i].addr, PACKET_DISCONNECT);
-        }
+    if (io->send_count == NET_BATCH) {
+        io_flush(io);
     }
 
-    close(server->fd);
-    free(server->peers);
+    const uint32_t i = io->send_count++;
+    io->send_to[i] = *to;
+    io->send_len[i] = len;
 
-    free(server);
+    return io->send_buf[i];
 }
 
-uint32_t net_server_poll(struct net_server *server, struct net_event *event) {
-    uint8_t buf[HEADER + NET_PAYLOAD];
-    struct net_addr from;
-    const double t = net_time();
-    uint32_t type, id;
+static void udp_send(struct net_io *io, const struct net_addr *to, const void *data, const uint32_t len) {
+    memcpy(udp_reserve(io, to, len), data, len);
+}
 
-    if (t - server->last_sweep > 1.0) {
-        for (; server->sweep_index < server->max_clients; server->sweep_index++) {
-            id = server->sweep_index;
+// a datagram on behalf of a peer, counted in its stats
+static uint8_t *peer_reserve(struct net_io *io, const struct net_addr *to, struct net_peer_stats *stats,
+                             const uint32_t len) {
+    stats->packets_out++;
+    stats->bytes_out += len;
 
-            if (server->peers[id].alive && t - server->peers[id].last_recv > NET_TIMEOUT) {
-                server->peers[id].alive = false;
-                server->n--;
-                server->sweep_index++;
+    return udp_reserve(io, to, len);
+}
 
-                *event = (struct net_event){
-                    .type = NET_EVENT_DISCONNECT,
-                    .client_id = id,
-                };
+static void peer_send(struct net_io *io, const struct net_addr *to, struct net_peer_stats *stats, const void *data,
+                      const uint32_t len) {
+    memcpy(peer_reserve(io, to, stats, len), data, len);
+}
+
+// the counters only, the gauges do not add up
+static void stats_add(struct net_peer_stats *total, const struct net_peer_stats *s) {
+    total->packets_in += s->packets_in;
+    total->bytes_in += s->bytes_in;
+    total->packets_out += s->packets_out;
+    total->bytes_out += s->bytes_out;
+    total->retransmits += s->retransmits;
+    total->duplicates += s->duplicates;
+    total->out_of_order += s->out_of_order;
+    total->sequenced_dropped += s->sequenced_dropped;
+    total->send_dropped += s->send_dropped;
+    total->fragments_dropped += s->fragments_dropped;
+}
+
+// the datagram stays in the batch buffer until the next call, or in its ring slot until the next poll.
+// `at` is set to the receive time when the io thread took it off the socket
+static int udp_recv(struct net_io *io, struct net_addr *from, const uint8_t **data, double *at) {
+    if (io->threaded) {
+        if (io->in_read == io->in_end) {
+            io->in_end = __atomic_load_n(&io->in.head, __ATOMIC_ACQUIRE);
 
-                return 1;
+            if (io->in_read == io->in_end) {
+                return -1;
             }
         }
 
-        server->sweep_index = 0;
-        server->last_sweep = t;
-    }
+        const struct net_slot *slot = &io->in.slots[io->in_read++ & (NET_RING - 1)];
+        *from = slot->addr;
+        *data = slot->data;
+        *at = slot->time;
 
-    const int n = udp_recv(server->fd, &from, buf, sizeof(buf));
-    if (n < 0 || !packet_check(buf, n, &type)) {
-        return 0;
+        return (int) slot->len;
     }
 
-    if (type == PACKET_CONNECT) {
-        id = peer_find(server, &from);
-        if (id != UINT32_MAX) {
-            server->peers[id].last_recv = t;
-            send_acknowledgment(server->fd, &from, id);
-
-            return 0;
+    if (io->recv_next == io->recv_count) {
+        for (uint32_t i = 0; i < NET_BATCH; i++) {
+            io->recv_msgs[i] = (struct mmsghdr){
+                .msg_hdr = {
+                    .msg_name = &io->recv_addr[i],
+                    .msg_namelen = sizeof(io->recv_addr[i]),
+                    .msg_iov = &io->recv_iov[i],
+                    .msg_iovlen = 1,
+                },
+            };
         }
 
-        id = peer_alloc(server);
-        if (id == UINT32_MAX) {
-            return 0;
+        const int n = recvmmsg(io->fd, io->recv_msgs, NET_BATCH, MSG_DONTWAIT, NULL);
+        io->stats.recv_calls++;
+
+        io->recv_next = 0;
+        io->recv_count = n > 0 ? (uint32_t) n : 0;
+        io->stats.recv_packets += io->recv_count;
+
+        if (!io->recv_count) {
+            return -1;
         }
+    }
 
-        server->peers[id] = (struct net_peer){
-            .addr = from,
-            .alive = true,
-            .last_recv = t,
-        };
-        server->n++;
+    const uint32_t i = io->recv_next++;
+    const struct sockaddr_in *addr = &io->recv_addr[i];
 
-        send_acknowledgment(server->fd, &from, id);
+    *from = (struct net_addr){
+        .host = addr->sin_addr.s_addr,
+        .port = addr->sin_port,
+    };
+    *data = io->recv_buf[i];
 
-        *event = (struct net_event){
-            .type = NET_EVENT_CONNECT,
-            .client_id = id,
-            .len = 0,
-        };
+    return (int) io->recv_msgs[i].msg_len;
+}
 
-        return 1;
+// datagrams or batch records left that the next receive hands out without a syscall or a new ring head
+static bool io_pending(const struct net_io *io) {
+    return (io->threaded ? io->in_read != io->in_end : io->recv_next < io->recv_count) || io->unpack_len;
+}
+
+// called at the start of every poll, the slots read by the last one go back to the io thread,
+// except the one still being unpacked
+static void io_release(struct net_io *io) {
+    if (!io->threaded) {
+        return;
     }
 
+    const uint32_t done = io->in_read - (io->unpack_len ? 1 : 0);
+    const uint32_t tail = io->in.tail;
+    if (done == tail) {
+        return;
+    }
 
-    if (type == PACKET_DISCONNECT) {
-        id = peer_find(server, &from);
-        if (id == UINT32_MAX) {
-            return 0;
-        }
+    __atomic_store_n(&io->in.tail, done, __ATOMIC_SEQ_CST);
 
-        server->peers[id].alive = false;
-        server->n--;
+    // a full ring keeps the thread off the socket until it gets slots back
+    if (__atomic_load_n(&io->in.head, __ATOMIC_SEQ_CST) - tail == NET_RING) {
+        io_wake(io);
+    }
+}
 
-        *event = (struct net_event){
-            .type = NET_EVENT_DISCONNECT,
-            .client_id = id,
-            .len = 0,
-        };
+// fills free slots of the receive ring straight from the socket
+static uint32_t thread_recv(struct net_io *io, struct net_io_stats *stats, bool *stalled) {
+    struct mmsghdr msgs[NET_BATCH];
+    struct iovec iov[NET_BATCH];
+    struct sockaddr_in addrs[NET_BATCH];
+    uint64_t control[NET_BATCH][(CMSG_SPACE(sizeof(uint32_t)) + 7) / 8];
 
-        return 1;
+    const uint32_t head = io->in.head;
+    const uint32_t space = NET_RING - (head - __atomic_load_n(&io->in.tail, __ATOMIC_ACQUIRE));
+    const uint32_t count = space < NET_BATCH ? space : NET_BATCH;
+
+    if (!count) {
+        stats->recv_stalls += !*stalled;
+        *stalled = true;
+        return 0;
     }
+    *stalled = false;
 
+    for (uint32_t i = 0; i < count; i++) {
+        iov[i] = (struct iovec){
+            .iov_base = io->in.slots[(head + i) & (NET_RING - 1)].data,
+            .iov_len = DATAGRAM,
+        };
 
-    if (type == PACKET_DATA) {
-        id = peer_find(server, &from);
-        if (id == UINT32_MAX) {
-            return 0;
-        }
+        msgs[i] = (struct mmsghdr){
+            .msg_hdr = {
+                .msg_name = &addrs[i],
+                .msg_namelen = sizeof(addrs[i]),
+                .msg_iov = &iov[i],
+                .msg_iovlen = 1,
+                .msg_control = control[i],
+                .msg_controllen = sizeof(control[i]),
+            },
+        };
+    }
 
-        server->peers[id].last_recv = t;
+    const int n = recvmmsg(io->fd, msgs, count, MSG_DONTWAIT, NULL);
+    stats->recv_calls++;
+    if (n <= 0) {
+        return 0;
+    }
 
-        const uint32_t payload = (uint32_t) (n - HEADER);
+    const double t = net_time();
+    for (uint32_t i = 0; i < (uint32_t) n; i++) {
+        struct net_slot *slot = &io->in.slots[(head + i) & (NET_RING - 1)];
 
-        *event = (struct net_event){
-            .type = NET_EVENT_DATA,
-            .client_id = id,
-            .len = payload,
+        slot->addr = (struct net_addr){
+            .host = addrs[i].sin_addr.s_addr,
+            .port = addrs[i].sin_port,
         };
-        memcpy(event->data, buf + HEADER, payload);
+        slot->len = msgs[i].msg_len;
+        slot->time = t;
+
+        // a running total of what the kernel dropped on this socket
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t dropped;
+                memcpy(&dropped, CMSG_DATA(cm), sizeof(dropped));
+                stats->kernel_dropped = dropped;
+            }
+        }
+    }
 
-        return 1;
+    stats->recv_packets += (uint32_t) n;
+    __atomic_store_n(&io->in.head, head + (uint32_t) n, __ATOMIC_RELEASE);
+
+    const uint32_t depth = head + (uint32_t) n - __atomic_load_n(&io->in.tail, __ATOMIC_ACQUIRE);
+    if (depth > stats->recv_queue_max) {
+        stats->recv_queue_max = depth;
     }
 
-    return 0;
+    return (uint32_t) n;
 }
 
-void net_server_send(const struct net_server *server, uint32_t client_id, const void *data, uint32_t len) {
-    if (client_id >= server->max_clients || !server->peers[client_id].alive) {
-        return;
+// sends what the game published on the send ring, NET_BATCH at a time
+static uint32_t thread_send(struct net_io *io, struct net_io_stats *stats) {
+    uint8_t *bufs[NET_BATCH];
+
+    // the game's batch arrays sit idle while the thread runs, it builds its sendmmsg from them
+    const uint32_t tail = io->out.tail;
+    const uint32_t queued = __atomic_load_n(&io->out.head, __ATOMIC_ACQUIRE) - tail;
+    const uint32_t count = queued < NET_BATCH ? queued : NET_BATCH;
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct net_slot *slot = &io->out.slots[(tail + i) & (NET_RING - 1)];
+
+        bufs[i] = slot->data;
+        io->send_to[i] = slot->addr;
+        io->send_len[i] = slot->len;
     }
 
-    if (len > NET_PAYLOAD) {
-        len = NET_PAYLOAD;
+    if (count) {
+        io_sendmmsg(io, stats, bufs, io->send_to, io->send_len, count);
+        __atomic_store_n(&io->out.tail, tail + count, __ATOMIC_RELEASE);
     }
 
-    uint8_t buf[HEADER + NET_PAYLOAD];
-    packet_pack(buf, PACKET_DATA);
-    memcpy(buf + HEADER, data, len);
+    return count;
+}
 
-    udp_send(server->fd, &server->peers[client_id].addr, buf, HEADER + len);
+static void thread_share(struct net_io *io, const struct net_io_stats *stats) {
+    __atomic_store_n(&io->shared.recv_calls, stats->recv_calls, __ATOMIC_RELAXED);
+    __atomic_store_n(&io->shared.recv_packets, stats->recv_packets, __ATOMIC_RELAXED);
+    __atomic_store_n(&io->shared.send_calls, stats->send_calls, __ATOMIC_RELAXED);
+    __atomic_store_n(&io->shared.send_packets, stats->send_packets, __ATOMIC_RELAXED);
+    __atomic_store_n(&io->shared.recv_queue_max, stats->recv_queue_max, __ATOMIC_RELAXED);
+    __atomic_store_n(&io->shared.recv_stalls, stats->recv_stalls, __ATOMIC_RELAXED);
+    __atomic_store_n(&io->shared.kernel_dropped, stats->kernel_dropped, __ATOMIC_RELAXED);
 }
 
-void net_server_broadcast(const struct net_server *server, const void *data, uint32_t len) {
-    if (len > NET_PAYLOAD) len = NET_PAYLOAD;
+static void *io_thread(void *arg) {
+    struct net_io *io = arg;
+    // carries on from what the game counted before the thread took over
+    struct net_io_stats stats = io->stats;
+    bool stalled = false;
 
-    uint8_t buf[HEADER + NET_PAYLOAD];
-    packet_pack(buf, PACKET_DATA);
-    memcpy(buf + HEADER, data, len);
+    for (;;) {
+        const uint32_t moved = thread_send(io, &stats) + thread_recv(io, &stats, &stalled);
+        thread_share(io, &stats);
 
-    const uint32_t total = HEADER + len;
+        if (moved) {
+            continue;
+        }
 
-    for (uint32_t i = 0; i < server->max_clients; i++) {
-        if (server->peers[i].alive) {
-            udp_send(server->fd, &server->peers[i].addr, buf, total);
+        // the send ring is drained at this point, nothing the game queued before stopping is lost
+        if (__atomic_load_n(&io->stop, __ATOMIC_ACQUIRE)) {
+            break;
         }
-    }
-}
 
-struct net_client *net_client_create(const char *host, uint16_t port) {
-    struct net_client *client = calloc(1, sizeof(*client));
-    if (!client) {
-        return NULL;
+        // announce the sleep before the last look at both rings, io_wake checks in the opposite order
+        __atomic_store_n(&io->sleeping, true, __ATOMIC_SEQ_CST);
+
+        const bool full = io->in.head - __atomic_load_n(&io->in.tail, __ATOMIC_SEQ_CST) == NET_RING;
+        if (__atomic_load_n(&io->out.head, __ATOMIC_SEQ_CST) == io->out.tail) {
+            struct pollfd fds[2] = {
+                {.fd = io->wake_fd, .events = POLLIN},
+                {.fd = full ? -1 : io->fd, .events = POLLIN},
+            };
+
+            if (poll(fds, 2, 100) > 0 && fds[0].revents & POLLIN) {
+                uint64_t count;
+                if (read(io->wake_fd, &count, sizeof(count)) < 0) {
+                    // raced with another read, nothing to clear
+                }
+            }
+        }
+
+        __atomic_store_n(&io->sleeping, false, __ATOMIC_SEQ_CST);
     }
 
-    if (!resolve(host, port, &client->server)) {
-        free(client);
+    return NULL;
+}
 
-        return NULL;
+static bool io_start(struct net_io *io) {
+    if (io->threaded) {
+        return true;
     }
 
-    client->fd = udp_sock(NULL, 0);
-
-    if (client->fd < 0) {
-        free(client);
-        return NULL;
+    // the receive batch would be skipped once the rings take over
+    if (io_pending(io)) {
+        return false;
     }
 
-    client->connecting = true;
+    io_flush(io);
 
-    return client;
-}
+    io->in.slots = calloc(NET_RING, sizeof(*io->in.slots));
+    io->out.slots = calloc(NET_RING, sizeof(*io->out.slots));
+    io->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
-void net_client_destroy(struct net_client *client) {
-    if (!client) {
-        return;
+    if (io->in.slots && io->out.slots && io->wake_fd >= 0) {
+        const int on = 1;
+        setsockopt(io->fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+
+        io->threaded = true;
+        if (pthread_create(&io->thread, NULL, io_thread, io) == 0) {
+            return true;
+        }
+        io->threaded = false;
     }
 
-    if (client->connected) {
-        net_client_disconnect(client);
+    if (io->wake_fd >= 0) {
+        close(io->wake_fd);
     }
+    free(io->in.slots);
+    free(io->out.slots);
+    io->in.slots = NULL;
+    io->out.slots = NULL;
+    io->wake_fd = -1;
 
-    close(client->fd);
-    free(client);
+    return false;
 }
 
-void net_client_disconnect(struct net_client *client) {
-    if (client->connected) {
-        for (uint32_t i = 0; i < 3; i++) {
-            packet_send(client->fd, &client->server, PACKET_DISCONNECT);
+// stops the io thread once it sent everything queued
+static void io_destroy(struct net_io *io) {
+    if (io->threaded) {
+        io_flush(io);
+
+        __atomic_store_n(&io->stop, true, __ATOMIC_SEQ_CST);
+        const uint64_t one = 1;
+        if (write(io->wake_fd, &one, sizeof(one)) < 0) {
+            // already signalled
         }
+
+        pthread_join(io->thread, NULL);
+        close(io->wake_fd);
+        free(io->in.slots);
+        free(io->out.slots);
     }
 
-    client->connected = false;
-    client->connecting = false;
+    free(io);
 }
 
-uint32_t net_client_poll(struct net_client *client, struct net_event *event) {
-    uint8_t buf[HEADER + NET_PAYLOAD];
-    struct net_addr from;
-    const double t = net_time();
-    uint32_t type;
-
-    if (client->connecting && !client->connected && t - client->last_attempt > 1.0) {
-        packet_send(client->fd, &client->server, PACKET_CONNECT);
-        client->last_attempt = t;
+static const struct net_io_stats *io_stats(struct net_io *io) {
+    if (io->threaded) {
+        io->stats.recv_calls = __atomic_load_n(&io->shared.recv_calls, __ATOMIC_RELAXED);
+        io->stats.recv_packets = __atomic_load_n(&io->shared.recv_packets, __ATOMIC_RELAXED);
+        io->stats.send_calls = __atomic_load_n(&io->shared.send_calls, __ATOMIC_RELAXED);
+        io->stats.send_packets = __atomic_load_n(&io->shared.send_packets, __ATOMIC_RELAXED);
+        io->stats.recv_queue_max = __atomic_load_n(&io->shared.recv_queue_max, __ATOMIC_RELAXED);
+        io->stats.recv_stalls = __atomic_load_n(&io->shared.recv_stalls, __ATOMIC_RELAXED);
+        io->stats.kernel_dropped = __atomic_load_n(&io->shared.kernel_dropped, __ATOMIC_RELAXED);
+
+        io->stats.recv_queue = __atomic_load_n(&io->in.head, __ATOMIC_ACQUIRE) - io->in_read;
+        io->stats.send_queue = io->out_write - __atomic_load_n(&io->out.tail, __ATOMIC_ACQUIRE);
     }
 
-    const int n = udp_recv(client->fd, &from, buf, sizeof(buf));
+    return &io->stats;
+}
 
-    if (n < 0 || !packet_check(buf, n, &type) || !addr_eq(&from, &client->server)) {
-        return 0;
+// next record of the PACKET_BATCH being unpacked
+static bool unpack_next(struct net_io *io, uint32_t *type, const uint8_t **body, uint32_t *len) {
+    if (io->unpack_len < RECORD || (uint32_t) (io->unpack[1] | io->unpack[2] << 8) > io->unpack_len - RECORD) {
+        io->unpack_len = 0;
+        return false;
     }
 
+    *type = io->unpack[0];
+    *len = (uint32_t) (io->unpack[1] | io->unpack[2] << 8);
+    *body = io->unpack + RECORD;
 
-    if (type == PACKET_CONNECT_ACKNOWLEDGMENT) {
-        if (client->connected) {
-            return 0;
-        }
-
-        client->connected = true;
-        client->connecting = false;
-
-        client->id = n >= HEADER + 4
-                         ? (uint32_t) buf[5] | ((uint32_t) buf[6] << 8) | ((uint32_t) buf[7] << 16) | (
-                               (uint32_t) buf[8] << 24)
-                         : 0;
+    io->unpack += RECORD + *len;
+    io->unpack_len -= RECORD + *len;
 
-        *event = (struct net_event){
-            .type = NET_EVENT_CONNECT,
-            .client_id = client->id,
-        };
+    // only plain and sequenced data is ever coalesced
+    return *type == PACKET_DATA || *type == PACKET_SEQUENCED;
+}
 
-        return 1;
-    }
+static void packet_pack(uint8_t *buf, const uint32_t type) {
+    const uint32_t id = NET_PROTOCOL_ID;
+    buf[0] = (uint8_t) id;
+    buf[1] = (uint8_t) (id >> 8);
+    buf[2] = (uint8_t) (id >> 16);
+    buf[3] = (uint8_t) (id >> 24);
+    buf[4] = (uint8_t) type;
+}
+
+static uint32_t packet_check(const uint8_t *buf, const int n, uint32_t *type) {
+    if (n < HEADER) {
+        return 0;
+    }
+
+    const uint32_t id = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
+    if (id != NET_PROTOCOL_ID) {
+        return 0;
+    }
+
+    *type = buf[4];
+
+    return 1;
+}
+
+static void packet_send(struct net_io *io, const struct net_addr *to, const uint32_t type) {
+    uint8_t buf[HEADER];
+    packet_pack(buf, type);
+    udp_send(io, to, buf, HEADER);
+}
+
+static void send_acknowledgment(struct net_io *io, const struct net_addr *to, const uint32_t id) {
+    uint8_t buf[HEADER + 4];
+    packet_pack(buf, PACKET_CONNECT_ACKNOWLEDGMENT);
+    buf[5] = id & 0xff;
+    buf[6] = id >> 8 & 0xff;
+    buf[7] = id >> 16 & 0xff;
+    buf[8] = id >> 24 & 0xff;
+
+    udp_send(io, to, buf, HEADER + 4);
+}
+
+static void write_u16(uint8_t *buf, const uint16_t v) {
+    buf[0] = (uint8_t) v;
+    buf[1] = (uint8_t) (v >> 8);
+}
+
+static void write_u32(uint8_t *buf, const uint32_t v) {
+    buf[0] = (uint8_t) v;
+    buf[1] = (uint8_t) (v >> 8);
+    buf[2] = (uint8_t) (v >> 16);
+    buf[3] = (uint8_t) (v >> 24);
+}
+
+static uint16_t read_u16(const uint8_t *buf) {
+    return (uint16_t) (buf[0] | buf[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t *buf) {
+    return (uint32_t) buf[0] | (uint32_t) buf[1] << 8 | (uint32_t) buf[2] << 16 | (uint32_t) buf[3] << 24;
+}
+
+struct net_reliable_msg {
+    uint8_t *data;
+    uint16_t len;
+    // a fragment, the message goes on in the next sequence
+    bool more;
+    // send side: acknowledged, how often it went out and when it last did
+    bool acked;
+    uint8_t sends;
+    double sent;
+    // recv side: arrived and not delivered yet, data stays allocated until the slot is reused
+    bool present;
+};
+
+static void reliable_reset(struct net_reliable *rel) {
+    if (rel->send) {
+        for (uint32_t i = 0; i < NET_RELIABLE_QUEUE; i++) {
+            free(rel->send[i].data);
+        }
+    }
+
+    if (rel->recv) {
+        for (uint32_t i = 0; i < NET_RELIABLE_WINDOW; i++) {
+            free(rel->recv[i].data);
+        }
+    }
+
+    free(rel->send);
+    free(rel->recv);
+    free(rel->assembly);
+
+    *rel = (struct net_reliable){0};
+}
+
+static bool reliable_alloc(struct net_reliable *rel) {
+    if (rel->send) {
+        return true;
+    }
+
+    rel->send = calloc(NET_RELIABLE_QUEUE, sizeof(*rel->send));
+    rel->recv = calloc(NET_RELIABLE_WINDOW, sizeof(*rel->recv));
+    if (!rel->send || !rel->recv) {
+        reliable_reset(rel);
+        return false;
+    }
+
+    return true;
+}
+
+// messages over NET_RELIABLE_PAYLOAD take one sequence per fragment, all of them or none are queued
+static bool reliable_queue(struct net_reliable *rel, const uint8_t *data, const uint32_t len, const uint32_t max) {
+    const uint32_t count = len > NET_RELIABLE_PAYLOAD ? (len + NET_RELIABLE_PAYLOAD - 1) / NET_RELIABLE_PAYLOAD : 1;
+
+    if (len > max || count > NET_RELIABLE_QUEUE - (uint32_t) (uint16_t) (rel->send_next - rel->send_base)) {
+        return false;
+    }
+
+    if (!reliable_alloc(rel)) {
+        return false;
+    }
+
+    const uint16_t first = rel->send_next;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t offset = i * NET_RELIABLE_PAYLOAD;
+        const uint32_t size = len - offset < NET_RELIABLE_PAYLOAD ? len - offset : NET_RELIABLE_PAYLOAD;
+
+        struct net_reliable_msg *msg = &rel->send[rel->send_next % NET_RELIABLE_QUEUE];
+        uint8_t *copy = realloc(msg->data, size ? size : 1);
+        if (!copy) {
+            // nothing went out yet, the slots keep their buffers for the next try
+            rel->send_next = first;
+            return false;
+        }
+
+        memcpy(copy, data + offset, size);
+        *msg = (struct net_reliable_msg){
+            .data = copy,
+            .len = (uint16_t) size,
+            .more = i + 1 < count,
+        };
+        rel->send_next++;
+    }
+
+    return true;
+}
+
+static double reliable_rto(const struct net_reliable *rel) {
+    if (!rel->srtt) {
+        return NET_RTO_INIT;
+    }
+
+    const double rto = rel->srtt + 4.0 * rel->rttvar;
+
+    return rto < NET_RTO_MIN ? NET_RTO_MIN : rto > NET_RTO_MAX ? NET_RTO_MAX : rto;
+}
+
+static void stats_refresh(struct net_peer_stats *stats, const struct net_reliable *rel) {
+    stats->srtt = rel->srtt;
+    stats->rttvar = rel->rttvar;
+    stats->send_queue = (uint16_t) (rel->send_next - rel->send_base);
+}
+
+// rfc 6298 smoothing, only fed by messages that went out once so the sample is unambiguous
+static void reliable_rtt(struct net_reliable *rel, const double sample) {
+    if (!rel->srtt) {
+        rel->srtt = sample;
+        rel->rttvar = sample / 2.0;
+        return;
+    }
+
+    const double err = rel->srtt > sample ? rel->srtt - sample : sample - rel->srtt;
+    rel->rttvar = 0.75 * rel->rttvar + 0.25 * err;
+    rel->srtt = 0.875 * rel->srtt + 0.125 * sample;
+}
+
+// `ack` is the newest sequence the other side got, bit i of `bits` stands for ack - 1 - i
+static void reliable_ack(struct net_reliable *rel, const uint16_t ack, const uint32_t bits, const double t) {
+    if (!rel->send) {
+        return;
+    }
+
+    for (uint16_t seq = rel->send_base; seq != rel->send_next; seq++) {
+        struct net_reliable_msg *msg = &rel->send[seq % NET_RELIABLE_QUEUE];
+        const uint16_t back = (uint16_t) (ack - seq);
+
+        if (msg->acked || !msg->sends || back > NET_RELIABLE_WINDOW ||
+            (back && !(bits & (1u << (back - 1))))) {
+            continue;
+        }
+
+        msg->acked = true;
+        if (msg->sends == 1) {
+            reliable_rtt(rel, t - msg->sent);
+        }
+    }
+
+    while (rel->send_base != rel->send_next && rel->send[rel->send_base % NET_RELIABLE_QUEUE].acked) {
+        rel->send_base++;
+    }
+}
+
+// marks `seq` for the next ack, returns -1 to drop, 0 when buffered and 1 when it is next in order
+static int reliable_accept(struct net_reliable *rel, struct net_peer_stats *stats, const uint16_t seq, const bool more,
+                           const uint8_t *data, const uint32_t len) {
+    const uint16_t ahead = (uint16_t) (seq - rel->recv_next);
+
+    // older than anything undelivered is a duplicate, the sender only needs the ack again
+    if (ahead >= 0x8000) {
+        rel->ack_pending = true;
+        stats->duplicates++;
+        return -1;
+    }
+
+    if (ahead >= NET_RELIABLE_WINDOW) {
+        return -1;
+    }
+
+    const uint16_t top = (uint16_t) (seq + 1);
+    const uint16_t newer = (uint16_t) (top - rel->recv_top);
+    if (newer && newer < 0x8000) {
+        rel->recv_bits = newer > 32 ? 0 : (uint32_t) (((uint64_t) rel->recv_bits << 1 | 1) << (newer - 1));
+        rel->recv_top = top;
+    } else if (newer) {
+        // ahead < NET_RELIABLE_WINDOW keeps this inside the bitfield
+        rel->recv_bits |= 1u << ((uint16_t) (rel->recv_top - top) - 1);
+    }
+    rel->ack_pending = true;
+
+    if (!reliable_alloc(rel)) {
+        return -1;
+    }
+
+    struct net_reliable_msg *msg = &rel->recv[seq % NET_RELIABLE_WINDOW];
+
+    // a duplicate of one already buffered, recv_next included, which the ready list delivers
+    if (msg->present) {
+        stats->duplicates++;
+        return 0;
+    }
+
+    if (ahead == 0) {
+        rel->recv_next++;
+        rel->ready = rel->recv[rel->recv_next % NET_RELIABLE_WINDOW].present;
+
+        return 1;
+    }
+
+    uint8_t *copy = realloc(msg->data, len ? len : 1);
+    if (!copy) {
+        return -1;
+    }
+
+    memcpy(copy, data, len);
+    msg->data = copy;
+    msg->len = (uint16_t) len;
+    msg->more = more;
+    msg->present = true;
+    stats->out_of_order++;
+
+    return 0;
+}
+
+// hands out the buffered message at recv_next, the data stays valid until its slot is reused,
+// returns whether it is a fragment
+static bool reliable_next(struct net_reliable *rel, const uint8_t **data, uint32_t *len) {
+    struct net_reliable_msg *msg = &rel->recv[rel->recv_next % NET_RELIABLE_WINDOW];
+
+    *data = msg->data;
+    *len = msg->len;
+
+    msg->present = false;
+    rel->recv_next++;
+    rel->ready = rel->recv[rel->recv_next % NET_RELIABLE_WINDOW].present;
+
+    return msg->more;
+}
+
+// fragments arrive in order, they are appended until the last one completes the message.
+// true once `data` holds a whole message, which only points at the assembly buffer for fragmented ones
+static bool reliable_assemble(struct net_reliable *rel, const uint32_t max, const bool more, const uint8_t **data,
+                              uint32_t *len) {
+    if (!more && !rel->assembly_len && !rel->assembly_drop) {
+        return true;
+    }
+
+    const uint32_t need = rel->assembly_len + *len;
+
+    if (!rel->assembly_drop && need <= max && need > rel->assembly_cap) {
+        uint32_t cap = rel->assembly_cap ? rel->assembly_cap : NET_PAYLOAD;
+        while (cap < need) {
+            cap *= 2;
+        }
+
+        uint8_t *grown = realloc(rel->assembly, cap > max ? max : cap);
+        if (grown) {
+            rel->assembly = grown;
+            rel->assembly_cap = cap > max ? max : cap;
+        }
+    }
+
+    if (rel->assembly_drop || need > rel->assembly_cap) {
+        rel->assembly_drop = more;
+        rel->assembly_len = 0;
+
+        return false;
+    }
+
+    memcpy(rel->assembly + rel->assembly_len, *data, *len);
+    rel->assembly_len = need;
+
+    if (more) {
+        return false;
+    }
+
+    *data = rel->assembly;
+    *len = rel->assembly_len;
+    rel->assembly_len = 0;
+
+    return true;
+}
+
+// sends what is new or overdue inside the window, acks ride along or go out alone,
+// returns whether anything is still waiting for an ack
+static bool reliable_transmit(struct net_io *io, const struct net_addr *to, struct net_reliable *rel,
+                              struct net_peer_stats *stats, const double t) {
+    const double rto = reliable_rto(rel);
+    uint8_t buf[HEADER + NET_PAYLOAD];
+    bool carried = false;
+
+    for (uint16_t seq = rel->send_base; seq != rel->send_next &&
+                                        (uint16_t) (seq - rel->send_base) < NET_RELIABLE_WINDOW; seq++) {
+        struct net_reliable_msg *msg = &rel->send[seq % NET_RELIABLE_QUEUE];
+
+        // back off on every retransmit of the same message
+        const uint32_t shift = msg->sends > 5 ? 5 : msg->sends;
+        const double wait = rto * (double) (1u << shift) / 2.0;
+        if (msg->acked || (msg->sends && t - msg->sent < (wait > NET_RTO_MAX ? NET_RTO_MAX : wait))) {
+            continue;
+        }
+
+        packet_pack(buf, msg->more ? PACKET_RELIABLE_FRAGMENT : PACKET_RELIABLE);
+        write_u16(buf + HEADER, seq);
+        write_u16(buf + HEADER + 2, (uint16_t) (rel->recv_top - 1));
+        write_u32(buf + HEADER + 4, rel->recv_bits);
+        memcpy(buf + HEADER + 8, msg->data, msg->len);
+        peer_send(io, to, stats, buf, HEADER + 8 + msg->len);
+
+        stats->retransmits += msg->sends != 0;
+        if (msg->sends < UINT8_MAX) {
+            msg->sends++;
+        }
+        msg->sent = t;
+        carried = true;
+    }
+
+    if (rel->ack_pending && !carried) {
+        packet_pack(buf, PACKET_ACK);
+        write_u16(buf + HEADER, (uint16_t) (rel->recv_top - 1));
+        write_u32(buf + HEADER + 2, rel->recv_bits);
+        peer_send(io, to, stats, buf, HEADER + 6);
+    }
+    rel->ack_pending = false;
+
+    return rel->send_base != rel->send_next;
+}
+
+static void sequenced_write(uint8_t *body, struct net_sequenced *seq, const uint32_t channel, const void *data,
+                            const uint32_t len) {
+    body[0] = (uint8_t) channel;
+    write_u16(body + 1, seq->send[channel]++);
+    memcpy(body + 3, data, len);
+}
+
+static void outbox_flush(struct net_io *io, const struct net_addr *to, struct net_outbox *out,
+                         struct net_peer_stats *stats) {
+    if (out->count == 1) {
+        // a lone message goes out as its own packet, the packet header overwrites the record header
+        packet_pack(out->buf + RECORD, out->buf[HEADER]);
+        peer_send(io, to, stats, out->buf + RECORD, out->len - RECORD);
+    } else if (out->count) {
+        packet_pack(out->buf, PACKET_BATCH);
+        peer_send(io, to, stats, out->buf, out->len);
+    }
+
+    out->len = HEADER;
+    out->count = 0;
+}
+
+// room for a `len` byte message body, NULL when it has to go out as its own datagram
+static uint8_t *outbox_reserve(struct net_io *io, const struct net_addr *to, struct net_outbox *out,
+                               struct net_peer_stats *stats, const uint32_t type, const uint32_t len) {
+    if (len > NET_PAYLOAD - RECORD) {
+        return NULL;
+    }
+
+    if (!out->buf) {
+        out->buf = malloc(HEADER + NET_PAYLOAD);
+        if (!out->buf) {
+            return NULL;
+        }
+
+        out->len = HEADER;
+    }
+
+    if (out->len + RECORD + len > HEADER + NET_PAYLOAD) {
+        outbox_flush(io, to, out, stats);
+    }
+
+    uint8_t *record = out->buf + out->len;
+    record[0] = (uint8_t) type;
+    write_u16(record + 1, (uint16_t) len);
+
+    out->len += RECORD + len;
+    out->count++;
+
+    return record + RECORD;
+}
+
+// true when the datagram is the newest on its channel so far
+static bool sequenced_accept(struct net_sequenced *seq, struct net_peer_stats *stats, const uint8_t *body,
+                             const uint32_t len) {
+    if (len < 3 || body[0] >= NET_SEQUENCED_CHANNELS) {
+        return false;
+    }
+
+    const uint16_t got = read_u16(body + 1);
+    uint16_t *next = &seq->recv[body[0]];
+
+    if ((uint16_t) (got - *next) >= 0x8000) {
+        stats->sequenced_dropped++;
+        return false;
+    }
+
+    *next = (uint16_t) (got + 1);
+
+    return true;
+}
+
+struct net_fragment_slot {
+    // count chunks of NET_FRAGMENT_PAYLOAD bytes, then one bit per fragment that arrived
+    uint8_t *buf;
+    double started;
+    uint32_t size;
+    uint32_t last_len;
+    uint16_t id;
+    uint16_t count;
+    uint16_t received;
+    // still collecting, a finished slot keeps its buffer for the event pointing into it
+    bool partial;
+};
+
+struct net_fragments {
+    struct net_fragment_slot slots[NET_FRAGMENT_SLOTS];
+    // bytes held by partial messages
+    uint32_t bytes;
+    uint16_t send_id;
+};
+
+static void fragments_free(struct net_fragments **fragments) {
+    if (!*fragments) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < NET_FRAGMENT_SLOTS; i++) {
+        free((*fragments)->slots[i].buf);
+    }
+
+    free(*fragments);
+    *fragments = NULL;
+}
+
+static bool fragments_alloc(struct net_fragments **fragments) {
+    if (!*fragments) {
+        *fragments = calloc(1, sizeof(**fragments));
+    }
+
+    return *fragments != NULL;
+}
+
+static void fragment_drop(struct net_fragments *frags, struct net_fragment_slot *slot) {
+    frags->bytes -= slot->size;
+    slot->partial = false;
+}
+
+// the slot collecting message `id`, or a fresh one. stale messages go first, then the oldest
+// until the new one fits next to the rest in 2 * max bytes
+static struct net_fragment_slot *fragment_slot(struct net_fragments *frags, struct net_peer_stats *stats,
+                                               const uint16_t id, const uint16_t count, const uint32_t max,
+                                               const double t) {
+    for (uint32_t i = 0; i < NET_FRAGMENT_SLOTS; i++) {
+        struct net_fragment_slot *slot = &frags->slots[i];
+
+        if (slot->partial && slot->id == id && slot->count == count) {
+            return slot;
+        }
+
+        if (slot->partial && t - slot->started > NET_FRAGMENT_TIMEOUT) {
+            fragment_drop(frags, slot);
+            stats->fragments_dropped++;
+        }
+    }
+
+    const uint32_t size = (uint32_t) count * NET_FRAGMENT_PAYLOAD + (count + 7u) / 8u;
+
+    for (;;) {
+        struct net_fragment_slot *unused = NULL;
+        struct net_fragment_slot *oldest = NULL;
+
+        for (uint32_t i = 0; i < NET_FRAGMENT_SLOTS; i++) {
+            struct net_fragment_slot *slot = &frags->slots[i];
+
+            if (!slot->partial) {
+                unused = unused ? unused : slot;
+            } else if (!oldest || slot->started < oldest->started) {
+                oldest = slot;
+            }
+        }
+
+        if (unused && frags->bytes + size <= 2 * max) {
+            uint8_t *buf = realloc(unused->buf, size);
+            if (!buf) {
+                return NULL;
+            }
+
+            *unused = (struct net_fragment_slot){
+                .buf = buf,
+                .started = t,
+                .size = size,
+                .id = id,
+                .count = count,
+                .partial = true,
+            };
+            memset(buf + (uint32_t) count * NET_FRAGMENT_PAYLOAD, 0, (count + 7u) / 8u);
+            frags->bytes += size;
+
+            return unused;
+        }
+
+        if (!oldest) {
+            return NULL;
+        }
+
+        fragment_drop(frags, oldest);
+        stats->fragments_dropped++;
+    }
+}
+
+// true once the fragment completes its message, `data` then points into the slot until it is reused
+static bool fragment_accept(struct net_fragments **fragments, struct net_peer_stats *stats, const uint32_t max,
+                            const double t, const uint8_t *body, const uint32_t len, const uint8_t **data,
+                            uint32_t *size) {
+    if (len < 6) {
+        return false;
+    }
+
+    const uint16_t id = read_u16(body);
+    const uint16_t index = read_u16(body + 2);
+    const uint16_t count = read_u16(body + 4);
+    const uint32_t chunk = len - 6;
+
+    // only the last fragment may be short, and the message has to fit in max
+    if (index >= count || chunk > NET_FRAGMENT_PAYLOAD || (index + 1u < count && chunk != NET_FRAGMENT_PAYLOAD) ||
+        (uint32_t) (count - 1) * NET_FRAGMENT_PAYLOAD >= max) {
+        return false;
+    }
+
+    if (!fragments_alloc(fragments)) {
+        return false;
+    }
+
+    struct net_fragments *frags = *fragments;
+    struct net_fragment_slot *slot = fragment_slot(frags, stats, id, count, max, t);
+    if (!slot) {
+        return false;
+    }
+
+    uint8_t *seen = slot->buf + (uint32_t) count * NET_FRAGMENT_PAYLOAD;
+    if (seen[index / 8] & (1u << (index % 8))) {
+        return false;
+    }
+
+    seen[index / 8] |= (uint8_t) (1u << (index % 8));
+    memcpy(slot->buf + (uint32_t) index * NET_FRAGMENT_PAYLOAD, body + 6, chunk);
+    if (index + 1u == count) {
+        slot->last_len = chunk;
+    }
+
+    if (++slot->received < count) {
+        return false;
+    }
+
+    fragment_drop(frags, slot);
+
+    *data = slot->buf;
+    *size = (uint32_t) (count - 1) * NET_FRAGMENT_PAYLOAD + slot->last_len;
+
+    return *size <= max;
+}
+
+// one PACKET_FRAGMENT per NET_FRAGMENT_PAYLOAD bytes, written straight into the send batch
+static void fragment_send(struct net_io *io, const struct net_addr *to, struct net_fragments **fragments,
+                          struct net_peer_stats *stats, const uint8_t *data, const uint32_t len) {
+    if (!fragments_alloc(fragments)) {
+        stats->send_dropped++;
+        return;
+    }
+
+    const uint16_t id = (*fragments)->send_id++;
+    const uint32_t count = (len + NET_FRAGMENT_PAYLOAD - 1) / NET_FRAGMENT_PAYLOAD;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t offset = i * NET_FRAGMENT_PAYLOAD;
+        const uint32_t chunk = len - offset < NET_FRAGMENT_PAYLOAD ? len - offset : NET_FRAGMENT_PAYLOAD;
+
+        uint8_t *buf = peer_reserve(io, to, stats, HEADER + 6 + chunk);
+        packet_pack(buf, PACKET_FRAGMENT);
+        write_u16(buf + HEADER, id);
+        write_u16(buf + HEADER + 2, (uint16_t) i);
+        write_u16(buf + HEADER + 4, (uint16_t) count);
+        memcpy(buf + HEADER + 6, data + offset, chunk);
+    }
+}
+
+static uint32_t addr_hash(const struct net_addr *addr) {
+    const uint64_t key = (uint64_t) addr->host << 16 | addr->port;
+    return (uint32_t) ((key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static uint32_t peer_find(const struct net_server *server, const struct net_addr *addr) {
+    const uint32_t mask = server->table_mask;
+
+    for (uint32_t slot = addr_hash(addr) & mask; server->table[slot]; slot = (slot + 1) & mask) {
+        const uint32_t id = server->table[slot] - 1;
+        if (addr_eq(&server->peers[id].addr, addr)) {
+            return id;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static void peer_insert(const struct net_server *server, const uint32_t id) {
+    const uint32_t mask = server->table_mask;
+
+    uint32_t slot = addr_hash(&server->peers[id].addr) & mask;
+    while (server->table[slot]) {
+        slot = (slot + 1) & mask;
+    }
+
+    server->table[slot] = id + 1;
+}
+
+// backward shift deletion, keeps the probe chains intact without tombstones
+static void peer_remove(const struct net_server *server, const uint32_t id) {
+    const uint32_t mask = server->table_mask;
+
+    uint32_t slot = addr_hash(&server->peers[id].addr) & mask;
+    while (server->table[slot] != id + 1) {
+        slot = (slot + 1) & mask;
+    }
+
+    for (uint32_t next = (slot + 1) & mask; server->table[next]; next = (next + 1) & mask) {
+        const uint32_t home = addr_hash(&server->peers[server->table[next] - 1].addr) & mask;
+
+        // the entry may move back when the hole lies between its home slot and where it is now
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            server->table[slot] = server->table[next];
+            slot = next;
+        }
+    }
+
+    server->table[slot] = 0;
+}
+
+static uint32_t peer_alloc(struct net_server *server) {
+    if (!server->free_count) {
+        return UINT32_MAX;
+    }
+
+    return server->free_ids[--server->free_count];
+}
+
+static uint64_t timer_tick(const struct net_server *server, const double t) {
+    return (uint64_t) ((t - server->wheel_start) * NET_WHEEL_RATE);
+}
+
+static uint32_t timer_list(const struct net_server *server, const uint64_t expire) {
+    if (expire - server->wheel_tick < NET_WHEEL_SLOTS) {
+        return (uint32_t) (expire & (NET_WHEEL_SLOTS - 1));
+    }
+
+    return NET_WHEEL_SLOTS + (uint32_t) ((expire >> NET_WHEEL_BITS) & (NET_WHEEL_SLOTS - 1));
+}
+
+static void timer_link(struct net_server *server, const uint32_t id, uint64_t expire) {
+    struct net_peer *peer = &server->peers[id];
+
+    if (expire < server->wheel_tick) {
+        expire = server->wheel_tick;
+    }
+
+    peer->timer_expire = expire;
+    peer->timer_list = timer_list(server, expire);
+
+    uint32_t *head = &server->wheel[peer->timer_list];
+    peer->timer_prev = UINT32_MAX;
+    peer->timer_next = *head;
+    if (*head != UINT32_MAX) {
+        server->peers[*head].timer_prev = id;
+    }
+    *head = id;
+}
+
+static void timer_unlink(struct net_server *server, const uint32_t id) {
+    const struct net_peer *peer = &server->peers[id];
+
+    if (peer->timer_prev != UINT32_MAX) {
+        server->peers[peer->timer_prev].timer_next = peer->timer_next;
+    } else {
+        server->wheel[peer->timer_list] = peer->timer_next;
+    }
+
+    if (peer->timer_next != UINT32_MAX) {
+        server->peers[peer->timer_next].timer_prev = peer->timer_prev;
+    }
+}
+
+// armed once per connect, a receive only stores last_recv and the timer is re-armed from it when it fires
+static void timer_arm(struct net_server *server, const uint32_t id) {
+    timer_link(server, id, timer_tick(server, server->peers[id].last_recv + NET_TIMEOUT) + 1);
+}
+
+static void server_activate(struct net_server *server, const uint32_t id) {
+    struct net_reliable *rel = &server->peers[id].reliable;
+
+    if (!rel->active) {
+        rel->active = true;
+        rel->active_index = server->active_count;
+        server->active[server->active_count++] = id;
+    }
+}
+
+static void server_deactivate(struct net_server *server, const uint32_t id) {
+    struct net_reliable *rel = &server->peers[id].reliable;
+    const uint32_t last = server->active[--server->active_count];
+
+    server->active[rel->active_index] = last;
+    server->peers[last].reliable.active_index = rel->active_index;
+    rel->active = false;
+}
+
+static void server_queue(struct net_server *server, const uint32_t id) {
+    struct net_outbox *out = &server->peers[id].outbox;
+
+    if (!out->queued) {
+        out->queued = true;
+        server->queued[server->queued_count++] = id;
+    }
+}
+
+// cells are clamped this far from the origin, far enough for any map and safe to take the width of
+#define AOI_LIMIT (1 << 29)
+
+static int32_t aoi_coord(const double v) {
+    double c = v / NET_AOI_CELL;
+
+    // NaN lands on the lower edge too
+    if (!(c > -AOI_LIMIT)) {
+        c = -AOI_LIMIT;
+    } else if (c > AOI_LIMIT) {
+        c = AOI_LIMIT;
+    }
+
+    const int32_t i = (int32_t) c;
+
+    return i - (c < (double) i);
+}
+
+static uint32_t aoi_hash(const int32_t cx, const int32_t cy) {
+    return ((uint32_t) cx * 0x9e3779b1u ^ (uint32_t) cy * 0x85ebca6bu) >> (32 - NET_AOI_BITS);
+}
+
+static void aoi_unlink(struct net_server *server, const uint32_t id) {
+    struct net_peer *peer = &server->peers[id];
+
+    if (peer->aoi_prev != UINT32_MAX) {
+        server->peers[peer->aoi_prev].aoi_next = peer->aoi_next;
+    } else {
+        server->aoi[peer->aoi_bucket] = peer->aoi_next;
+    }
+
+    if (peer->aoi_next != UINT32_MAX) {
+        server->peers[peer->aoi_next].aoi_prev = peer->aoi_prev;
+    }
+
+    peer->aoi_linked = false;
+}
+
+static void aoi_link(struct net_server *server, const uint32_t id, const uint32_t bucket) {
+    struct net_peer *peer = &server->peers[id];
+    uint32_t *head = &server->aoi[bucket];
+
+    peer->aoi_bucket = bucket;
+    peer->aoi_prev = UINT32_MAX;
+    peer->aoi_next = *head;
+    if (*head != UINT32_MAX) {
+        server->peers[*head].aoi_prev = id;
+    }
+    *head = id;
+    peer->aoi_linked = true;
+}
+
+static void peer_release(struct net_server *server, const uint32_t id) {
+    struct net_reliable *rel = &server->peers[id].reliable;
+    struct net_outbox *out = &server->peers[id].outbox;
+
+    if (rel->active) {
+        server_deactivate(server, id);
+    }
+
+    if (rel->ready) {
+        for (uint32_t i = 0; i < server->ready_count; i++) {
+            if (server->ready[i] == id) {
+                server->ready[i] = server->ready[--server->ready_count];
+                break;
+            }
+        }
+    }
+
+    if (out->queued) {
+        for (uint32_t i = 0; i < server->queued_count; i++) {
+            if (server->queued[i] == id) {
+                server->queued[i] = server->queued[--server->queued_count];
+                break;
+            }
+        }
+    }
+
+    free(out->buf);
+    *out = (struct net_outbox){0};
+
+    fragments_free(&server->peers[id].fragments);
+    reliable_reset(rel);
+    timer_unlink(server, id);
+    peer_remove(server, id);
+    stats_add(&server->retired, &server->peers[id].stats);
+    if (server->peers[id].aoi_linked) {
+        aoi_unlink(server, id);
+    }
+
+    server->peers[id].alive = false;
+    server->free_ids[server->free_count++] = id;
+    server->n--;
+}
+
+struct net_server *net_server_create(const char *ip, const uint16_t port, uint32_t n, uint32_t max_message) {
+    if (n < 1) {
+        n = 1;
+    }
+
+    if (n > NET_MAX_CLIENTS) {
+        n = NET_MAX_CLIENTS;
+    }
+
+    if (!max_message) {
+        max_message = NET_MESSAGE_DEFAULT;
+    }
+
+    if (max_message < NET_PAYLOAD) {
+        max_message = NET_PAYLOAD;
+    }
+
+    if (max_message > NET_MESSAGE_LIMIT) {
+        max_message = NET_MESSAGE_LIMIT;
+    }
+
+    // at most half full so probe chains stay short
+    uint32_t table_size = 2;
+    while (table_size < n * 2) {
+        table_size *= 2;
+    }
+
+    struct net_server *server = calloc(1, sizeof(*server));
+    if (!server) {
+        return NULL;
+    }
+
+    server->peers = calloc(n, sizeof(*server->peers));
+    server->table = calloc(table_size, sizeof(*server->table));
+    server->free_ids = malloc(n * sizeof(*server->free_ids));
+    server->active = malloc(n * sizeof(*server->active));
+    server->ready = malloc(n * sizeof(*server->ready));
+    server->queued = malloc(n * sizeof(*server->queued));
+    if (!server->peers || !server->table || !server->free_ids || !server->active || !server->ready ||
+        !server->queued) {
+        free(server->peers);
+        free(server->table);
+        free(server->free_ids);
+        free(server->active);
+        free(server->ready);
+        free(server->queued);
+        free(server);
+
+        return NULL;
+    }
+
+    server->fd = udp_sock(ip, port);
+    server->io = server->fd < 0 ? NULL : io_create(server->fd);
+    if (!server->io) {
+        if (server->fd >= 0) {
+            close(server->fd);
+        }
+        free(server->peers);
+        free(server->table);
+        free(server->free_ids);
+        free(server->active);
+        free(server->ready);
+        free(server->queued);
+        free(server);
+
+        return NULL;
+    }
+
+    server->table_mask = table_size - 1;
+
+    // reversed so the lowest ids are handed out first
+    for (uint32_t i = 0; i < n; i++) {
+        server->free_ids[i] = n - 1 - i;
+    }
+    server->free_count = n;
+
+    server->max_clients = n;
+    server->n = 0;
+    server->max_message = max_message;
+    server->aoi_view_max = NET_AOI_VIEW;
+    memset(server->wheel, 0xff, sizeof(server->wheel));
+    server->wheel_start = net_time();
+
+    return server;
+}
+
+void net_server_destroy(struct net_server *server) {
+    if (!server) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < server->max_clients; i++) {
+        if (server->peers[i].alive) {
+            packet_send(server->io, &server->peers[i].addr, PACKET_DISCONNECT);
+            reliable_reset(&server->peers[i].reliable);
+            fragments_free(&server->peers[i].fragments);
+            free(server->peers[i].outbox.buf);
+        }
+    }
+
+    io_destroy(server->io);
+
+    close(server->fd);
+    free(server->peers);
+    free(server->table);
+    free(server->free_ids);
+    free(server->active);
+    free(server->ready);
+    free(server->queued);
+    free(server->aoi);
+
+    free(server);
+}
+
+// fills up to `max` disconnect views with peers that timed out, what does not fit waits in its slot
+static uint32_t server_expire(struct net_server *server, const double t, struct net_view *views, const uint32_t max) {
+    const uint64_t now = timer_tick(server, t);
+    uint32_t count = 0;
+
+    while (server->wheel_tick <= now) {
+        uint32_t *head = &server->wheel[server->wheel_tick & (NET_WHEEL_SLOTS - 1)];
+
+        while (*head != UINT32_MAX) {
+            const uint32_t id = *head;
+
+            if (t - server->peers[id].last_recv <= NET_TIMEOUT) {
+                timer_unlink(server, id);
+                timer_arm(server, id);
+                continue;
+            }
+
+            peer_release(server, id);
+
+            views[count++] = (struct net_view){
+                .type = NET_EVENT_DISCONNECT,
+                .client_id = id,
+            };
+
+            if (count == max) {
+                return count;
+            }
+        }
+
+        server->wheel_tick++;
+
+        // the upper slot that just came into range moves down to the lower level
+        if (!(server->wheel_tick & (NET_WHEEL_SLOTS - 1))) {
+            uint32_t *upper = &server->wheel[NET_WHEEL_SLOTS + ((server->wheel_tick >> NET_WHEEL_BITS) & (NET_WHEEL_SLOTS - 1))];
+            uint32_t id = *upper;
+
+            *upper = UINT32_MAX;
+            while (id != UINT32_MAX) {
+                const uint32_t next = server->peers[id].timer_next;
+                timer_link(server, id, server->peers[id].timer_expire);
+                id = next;
+            }
+        }
+    }
+
+    return count;
+}
+
+// -1 once the socket is empty, 0 for a datagram that is not an event
+// one message, `body` is everything after the packet header
+static int server_packet(struct net_server *server, const double t, const struct net_addr *from, const uint32_t type,
+                         const uint8_t *body, const uint32_t len, struct net_view *view) {
+    uint32_t id;
+
+    if (type == PACKET_CONNECT) {
+        id = peer_find(server, from);
+        if (id != UINT32_MAX) {
+            server->peers[id].last_recv = t;
+            send_acknowledgment(server->io, from, id);
+
+            return 0;
+        }
+
+        id = peer_alloc(server);
+        if (id == UINT32_MAX) {
+            return 0;
+        }
+
+        server->peers[id] = (struct net_peer){
+            .addr = *from,
+            .alive = true,
+            .last_recv = t,
+            .aoi_view = NET_AOI_VIEW,
+        };
+        peer_insert(server, id);
+        timer_arm(server, id);
+        server->n++;
+
+        send_acknowledgment(server->io, from, id);
+
+        *view = (struct net_view){
+            .type = NET_EVENT_CONNECT,
+            .client_id = id,
+        };
+
+        return 1;
+    }
+
+
+    if (type == PACKET_DISCONNECT) {
+        id = peer_find(server, from);
+        if (id == UINT32_MAX) {
+            return 0;
+        }
+
+        peer_release(server, id);
+
+        *view = (struct net_view){
+            .type = NET_EVENT_DISCONNECT,
+            .client_id = id,
+        };
+
+        return 1;
+    }
+
+
+    if (type == PACKET_DATA) {
+        id = peer_find(server, from);
+        if (id == UINT32_MAX) {
+            return 0;
+        }
+
+        server->peers[id].last_recv = t;
+
+        *view = (struct net_view){
+            .type = NET_EVENT_DATA,
+            .client_id = id,
+            .len = len,
+            .data = body,
+        };
+
+        return 1;
+    }
+
+    if (type == PACKET_RELIABLE || type == PACKET_RELIABLE_FRAGMENT || type == PACKET_ACK) {
+        id = peer_find(server, from);
+        if (id == UINT32_MAX) {
+            return 0;
+        }
+
+        struct net_reliable *rel = &server->peers[id].reliable;
+        server->peers[id].last_recv = t;
+
+        if (type == PACKET_ACK) {
+            if (len >= 6) {
+                reliable_ack(rel, read_u16(body), read_u32(body + 2), t);
+            }
+
+            return 0;
+        }
+
+        if (len < 8) {
+            return 0;
+        }
+
+        reliable_ack(rel, read_u16(body + 2), read_u32(body + 4), t);
+
+        const bool more = type == PACKET_RELIABLE_FRAGMENT;
+        const bool ready = rel->ready;
+        const int accepted = reliable_accept(rel, &server->peers[id].stats, read_u16(body), more, body + 8, len - 8);
+
+        server_activate(server, id);
+        if (!ready && rel->ready) {
+            server->ready[server->ready_count++] = id;
+        }
+
+        const uint8_t *data = body + 8;
+        uint32_t size = len - 8;
+        if (accepted < 1 || !reliable_assemble(rel, server->max_message, more, &data, &size)) {
+            return 0;
+        }
+
+        *view = (struct net_view){
+            .type = NET_EVENT_DATA,
+            .client_id = id,
+            .len = size,
+            .data = data,
+        };
+        server->io->hold = server->io->hold || data == rel->assembly;
+
+        return 1;
+    }
+
+    if (type == PACKET_FRAGMENT) {
+        id = peer_find(server, from);
+        if (id == UINT32_MAX) {
+            return 0;
+        }
+
+        struct net_peer *peer = &server->peers[id];
+        peer->last_recv = t;
+
+        *view = (struct net_view){
+            .type = NET_EVENT_DATA,
+            .client_id = id,
+        };
+        if (!fragment_accept(&peer->fragments, &peer->stats, server->max_message, t, body, len, &view->data,
+                             &view->len)) {
+            return 0;
+        }
+        server->io->hold = true;
+
+        return 1;
+    }
+
+    if (type == PACKET_SEQUENCED) {
+        id = peer_find(server, from);
+        if (id == UINT32_MAX) {
+            return 0;
+        }
+
+        struct net_peer *peer = &server->peers[id];
+        peer->last_recv = t;
+
+        if (!sequenced_accept(&peer->sequenced, &peer->stats, body, len)) {
+            return 0;
+        }
+
+        *view = (struct net_view){
+            .type = NET_EVENT_DATA,
+            .client_id = id,
+            .len = len - 3,
+            .data = body + 3,
+        };
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static int server_recv(struct net_server *server, const double t, struct net_view *view) {
+    struct net_io *io = server->io;
+    uint32_t type;
+
+    if (!io->unpack_len) {
+        const uint8_t *buf;
+        struct net_addr from;
+        double at = t;
+
+        const int n = udp_recv(io, &from, &buf, &at);
+        if (n < 0) {
+            return -1;
+        }
+
+        if (!packet_check(buf, n, &type)) {
+            return 0;
+        }
+
+        const uint32_t id = peer_find(server, &from);
+        if (id != UINT32_MAX) {
+            server->peers[id].stats.packets_in++;
+            server->peers[id].stats.bytes_in += (uint32_t) n;
+        }
+
+        if (type != PACKET_BATCH) {
+            return server_packet(server, at, &from, type, buf + HEADER, (uint32_t) (n - HEADER), view);
+        }
+
+        io->unpack = buf + HEADER;
+        io->unpack_len = (uint32_t) (n - HEADER);
+        io->unpack_from = from;
+        io->unpack_time = at;
+    }
+
+    const uint8_t *body;
+    uint32_t len;
+    if (!unpack_next(io, &type, &body, &len)) {
+        return 0;
+    }
+
+    return server_packet(server, io->unpack_time, &io->unpack_from, type, body, len, view);
+}
+
+// reliable messages that arrived ahead of a gap the last datagram filled
+static uint32_t server_deliver(struct net_server *server, struct net_view *view) {
+    while (server->ready_count) {
+        const uint32_t id = server->ready[server->ready_count - 1];
+        struct net_reliable *rel = &server->peers[id].reliable;
+        const uint8_t *data;
+        uint32_t len;
+
+        const bool more = reliable_next(rel, &data, &len);
+        if (!rel->ready) {
+            server->ready_count--;
+        }
+
+        if (reliable_assemble(rel, server->max_message, more, &data, &len)) {
+            *view = (struct net_view){
+                .type = NET_EVENT_DATA,
+                .client_id = id,
+                .len = len,
+                .data = data,
+            };
+            server->io->hold = server->io->hold || data == rel->assembly;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void server_service(struct net_server *server, const double t) {
+    for (uint32_t i = server->active_count; i-- > 0;) {
+        const uint32_t id = server->active[i];
+        struct net_peer *peer = &server->peers[id];
+
+        if (!reliable_transmit(server->io, &peer->addr, &peer->reliable, &peer->stats, t)) {
+            server_deactivate(server, id);
+        }
+    }
+
+    for (uint32_t i = 0; i < server->queued_count; i++) {
+        struct net_peer *peer = &server->peers[server->queued[i]];
+
+        outbox_flush(server->io, &peer->addr, &peer->outbox, &peer->stats);
+        peer->outbox.queued = false;
+    }
+    server->queued_count = 0;
+}
+
+static void view_to_event(const struct net_view *view, struct net_event *event) {
+    *event = (struct net_event){
+        .type = view->type,
+        .client_id = view->client_id,
+        .data = view->data,
+        .len = view->len,
+    };
+}
+
+uint32_t net_server_poll(struct net_server *server, struct net_event *event) {
+    const double t = net_time();
+    struct net_view view;
+
+    // the rest of a batch goes first, the slots it points into are still held
+    if (server->io->views_next < server->io->views_count) {
+        view_to_event(&server->io->views[server->io->views_next++], event);
+
+        return 1;
+    }
+
+    io_release(server->io);
+
+    // acknowledgments queued by the last poll go out before we wait on more input
+    if (!io_pending(server->io)) {
+        server_service(server, t);
+    }
+    io_flush(server->io);
+
+    if (server_expire(server, t, &view, 1) || server_deliver(server, &view) ||
+        server_recv(server, t, &view) > 0) {
+        view_to_event(&view, event);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint32_t server_batch(struct net_server *server) {
+    struct net_io *io = server->io;
+    const double t = net_time();
+
+    io_release(io);
+    server_service(server, t);
+    io_flush(io);
+    io->hold = false;
+
+    uint32_t count = server_expire(server, t, io->views, NET_BATCH);
+    const uint32_t expired = count;
+    while (count < NET_BATCH && !io->hold && server_deliver(server, &io->views[count])) {
+        count++;
+    }
+
+    // delivered messages point into reorder slots the next receive may reuse, they get a batch of their own
+    io->hold = io->hold || count > expired;
+
+    // stop when the received batch runs out once a view was handed out, a refill would overwrite what it points at
+    for (uint32_t i = 0; count < NET_BATCH && !io->hold; i++) {
+        if (i && count && !io_pending(io)) {
+            break;
+        }
+
+        const int n = server_recv(server, t, &io->views[count]);
+        if (n < 0) {
+            break;
+        }
+
+        count += (uint32_t) n;
+    }
+
+    return count;
+}
+
+uint32_t net_server_poll_batch(struct net_server *server, const struct net_view **views) {
+    struct net_io *io = server->io;
+
+    if (io->views_next == io->views_count) {
+        io->views_count = server_batch(server);
+        io->views_next = 0;
+    }
+
+    const uint32_t count = io->views_count - io->views_next;
+    *views = &io->views[io->views_next];
+    io->views_next = io->views_count;
+
+    return count;
+}
+
+const struct net_view *net_server_poll_view(struct net_server *server) {
+    struct net_io *io = server->io;
+
+    if (io->views_next == io->views_count) {
+        io->views_count = server_batch(server);
+        io->views_next = 0;
+    }
+
+    return io->views_next < io->views_count ? &io->views[io->views_next++] : NULL;
+}
+
+void net_server_send(struct net_server *server, const uint32_t client_id, const void *data, const uint32_t len) {
+    if (client_id >= server->max_clients || !server->peers[client_id].alive) {
+        return;
+    }
+
+    struct net_peer *peer = &server->peers[client_id];
+
+    if (len > server->max_message) {
+        peer->stats.send_dropped++;
+        return;
+    }
+
+    uint8_t *body = outbox_reserve(server->io, &peer->addr, &peer->outbox, &peer->stats, PACKET_DATA, len);
+    if (body) {
+        memcpy(body, data, len);
+        server_queue(server, client_id);
+
+        return;
+    }
+
+    // too big for a record, what is queued goes first to keep the order
+    if (peer->outbox.buf) {
+        outbox_flush(server->io, &peer->addr, &peer->outbox, &peer->stats);
+    }
+
+    if (len > NET_PAYLOAD) {
+        fragment_send(server->io, &peer->addr, &peer->fragments, &peer->stats, data, len);
+        return;
+    }
+
+    uint8_t buf[HEADER + NET_PAYLOAD];
+    packet_pack(buf, PACKET_DATA);
+    memcpy(buf + HEADER, data, len);
+
+    peer_send(server->io, &peer->addr, &peer->stats, buf, HEADER + len);
+}
+
+void net_server_broadcast(struct net_server *server, const void *data, const uint32_t len) {
+    for (uint32_t i = 0; i < server->max_clients; i++) {
+        if (server->peers[i].alive) {
+            net_server_send(server, i, data, len);
+        }
+    }
+}
+
+bool net_server_send_reliable(struct net_server *server, const uint32_t client_id, const void *data,
+                              const uint32_t len) {
+    if (client_id >= server->max_clients || !server->peers[client_id].alive) {
+        return false;
+    }
+
+    if (!reliable_queue(&server->peers[client_id].reliable, data, len, server->max_message)) {
+        server->peers[client_id].stats.send_dropped++;
+        return false;
+    }
+
+    server_activate(server, client_id);
+
+    return true;
+}
+
+void net_server_broadcast_reliable(struct net_server *server, const void *data, const uint32_t len) {
+    for (uint32_t i = 0; i < server->max_clients; i++) {
+        if (server->peers[i].alive) {
+            net_server_send_reliable(server, i, data, len);
+        }
+    }
+}
+
+bool net_server_send_sequenced(struct net_server *server, const uint32_t client_id, const uint32_t channel,
+                               const void *data, const uint32_t len) {
+    if (client_id >= server->max_clients || !server->peers[client_id].alive || channel >= NET_SEQUENCED_CHANNELS) {
+        return false;
+    }
+
+    struct net_peer *peer = &server->peers[client_id];
+
+    // not fragmented, a cut message would decode as garbage
+    if (len > NET_SEQUENCED_PAYLOAD) {
+        peer->stats.send_dropped++;
+        return false;
+    }
+
+    uint8_t *body = outbox_reserve(server->io, &peer->addr, &peer->outbox, &peer->stats, PACKET_SEQUENCED, 3 + len);
+    if (body) {
+        sequenced_write(body, &peer->sequenced, channel, data, len);
+        server_queue(server, client_id);
+
+        return true;
+    }
+
+    if (peer->outbox.buf) {
+        outbox_flush(server->io, &peer->addr, &peer->outbox, &peer->stats);
+    }
+
+    uint8_t buf[HEADER + NET_PAYLOAD];
+    packet_pack(buf, PACKET_SEQUENCED);
+    sequenced_write(buf + HEADER, &peer->sequenced, channel, data, len);
+
+    peer_send(server->io, &peer->addr, &peer->stats, buf, HEADER + 3 + len);
+
+    return true;
+}
+
+void net_server_broadcast_sequenced(struct net_server *server, const uint32_t channel, const void *data,
+                                    const uint32_t len) {
+    for (uint32_t i = 0; i < server->max_clients; i++) {
+        if (server->peers[i].alive) {
+            net_server_send_sequenced(server, i, channel, data, len);
+        }
+    }
+}
+
+bool net_server_set_position(struct net_server *server, const uint32_t client_id, const double x, const double y) {
+    if (client_id >= server->max_clients || !server->peers[client_id].alive) {
+        return false;
+    }
+
+    if (!server->aoi) {
+        server->aoi = malloc(NET_AOI_BUCKETS * sizeof(*server->aoi));
+        if (!server->aoi) {
+            return false;
+        }
+        memset(server->aoi, 0xff, NET_AOI_BUCKETS * sizeof(*server->aoi));
+    }
+
+    struct net_peer *peer = &server->peers[client_id];
+    const uint32_t bucket = aoi_hash(aoi_coord(x), aoi_coord(y));
+
+    peer->aoi_x = x;
+    peer->aoi_y = y;
+
+    // most moves stay inside the cell
+    if (peer->aoi_linked && peer->aoi_bucket == bucket) {
+        return true;
+    }
+
+    if (peer->aoi_linked) {
+        aoi_unlink(server, client_id);
+    }
+    aoi_link(server, client_id, bucket);
+
+    return true;
+}
+
+void net_server_set_view(struct net_server *server, const uint32_t client_id, const double view) {
+    if (client_id >= server->max_clients || !server->peers[client_id].alive || !(view >= 0.0)) {
+        return;
+    }
+
+    server->peers[client_id].aoi_view = view;
+    if (view > server->aoi_view_max) {
+        server->aoi_view_max = view;
+    }
+}
+
+enum {
+    AOI_UNRELIABLE,
+    AOI_RELIABLE,
+    AOI_SEQUENCED,
+};
+
+static void aoi_send(struct net_server *server, const uint32_t id, const uint32_t mode, const uint32_t channel,
+                     const void *data, const uint32_t len) {
+    if (mode == AOI_RELIABLE) {
+        net_server_send_reliable(server, id, data, len);
+    } else if (mode == AOI_SEQUENCED) {
+        net_server_send_sequenced(server, id, channel, data, len);
+    } else {
+        net_server_send(server, id, data, len);
+    }
+}
+
+static uint32_t aoi_visit(struct net_server *server, const uint32_t bucket, const double x, const double y,
+                          const double radius, const uint32_t mode, const uint32_t channel, const void *data,
+                          const uint32_t len) {
+    uint32_t sent = 0;
+
+    for (uint32_t id = server->aoi[bucket]; id != UINT32_MAX; id = server->peers[id].aoi_next) {
+        struct net_peer *peer = &server->peers[id];
+        if (peer->aoi_mark == server->aoi_mark) {
+            continue;
+        }
+        peer->aoi_mark = server->aoi_mark;
+
+        const double dx = peer->aoi_x - x;
+        const double dy = peer->aoi_y - y;
+        const double reach = radius + peer->aoi_view;
+
+        if (dx * dx + dy * dy <= reach * reach) {
+            aoi_send(server, id, mode, channel, data, len);
+            sent++;
+        }
+    }
+
+    return sent;
+}
+
+static void aoi_broadcast(struct net_server *server, const double x, const double y, double radius,
+                          const uint32_t mode, const uint32_t channel, const void *data, const uint32_t len) {
+    uint32_t sent = 0;
+
+    // NaN too
+    if (!(radius > 0.0)) {
+        radius = 0.0;
+    }
+
+    if (server->aoi) {
+        if (++server->aoi_mark == 0) {
+            for (uint32_t i = 0; i < server->max_clients; i++) {
+                server->peers[i].aoi_mark = 0;
+            }
+            server->aoi_mark = 1;
+        }
+
+        // cells any peer in reach can sit in, every bucket once when that is more than there are buckets
+        const double reach = radius + server->aoi_view_max;
+        const int32_t x0 = aoi_coord(x - reach);
+        const int32_t x1 = aoi_coord(x + reach);
+        const int32_t y0 = aoi_coord(y - reach);
+        const int32_t y1 = aoi_coord(y + reach);
+
+        if ((uint64_t) (x1 - x0 + 1) * (uint64_t) (y1 - y0 + 1) >= NET_AOI_BUCKETS) {
+            for (uint32_t b = 0; b < NET_AOI_BUCKETS; b++) {
+                sent += aoi_visit(server, b, x, y, radius, mode, channel, data, len);
+            }
+        } else {
+            for (int32_t cy = y0; cy <= y1; cy++) {
+                for (int32_t cx = x0; cx <= x1; cx++) {
+                    sent += aoi_visit(server, aoi_hash(cx, cy), x, y, radius, mode, channel, data, len);
+                }
+            }
+        }
+    }
+
+    struct net_aoi_stats *stats = &server->aoi_stats;
+    stats->broadcasts++;
+    stats->sent += sent;
+    stats->skipped += server->n - sent;
+    stats->bytes_sent += (uint64_t) sent * len;
+    stats->bytes_skipped += (uint64_t) (server->n - sent) * len;
+}
+
+void net_server_broadcast_near(struct net_server *server, const double x, const double y, const double radius,
+                               const void *data, const uint32_t len) {
+    aoi_broadcast(server, x, y, radius, AOI_UNRELIABLE, 0, data, len);
+}
+
+void net_server_broadcast_near_reliable(struct net_server *server, const double x, const double y,
+                                        const double radius, const void *data, const uint32_t len) {
+    aoi_broadcast(server, x, y, radius, AOI_RELIABLE, 0, data, len);
+}
+
+void net_server_broadcast_near_sequenced(struct net_server *server, const double x, const double y,
+                                         const double radius, const uint32_t channel, const void *data,
+                                         const uint32_t len) {
+    aoi_broadcast(server, x, y, radius, AOI_SEQUENCED, channel, data, len);
+}
+
+const struct net_aoi_stats *net_server_aoi_stats(const struct net_server *server) {
+    return &server->aoi_stats;
+}
+
+const struct net_peer_stats *net_server_peer_stats(struct net_server *server, const uint32_t client_id) {
+    if (client_id >= server->max_clients || !server->peers[client_id].alive) {
+        return NULL;
+    }
+
+    struct net_peer *peer = &server->peers[client_id];
+    stats_refresh(&peer->stats, &peer->reliable);
+
+    return &peer->stats;
+}
+
+void net_server_total_stats(const struct net_server *server, struct net_peer_stats *total) {
+    struct net_peer_stats gauges;
+    uint32_t sampled = 0;
+
+    *total = (struct net_peer_stats){0};
+    stats_add(total, &server->retired);
+
+    for (uint32_t i = 0; i < server->max_clients; i++) {
+        const struct net_peer *peer = &server->peers[i];
+        if (!peer->alive) {
+            continue;
+        }
+
+        stats_add(total, &peer->stats);
+        stats_refresh(&gauges, &peer->reliable);
+        total->send_queue += gauges.send_queue;
+        if (gauges.srtt) {
+            total->srtt += gauges.srtt;
+            total->rttvar += gauges.rttvar;
+            sampled++;
+        }
+    }
+
+    if (sampled) {
+        total->srtt /= sampled;
+        total->rttvar /= sampled;
+    }
+}
+
+void net_server_flush(struct net_server *server) {
+    server_service(server, net_time());
+    io_flush(server->io);
+}
+
+const struct net_io_stats *net_server_io_stats(const struct net_server *server) {
+    return io_stats(server->io);
+}
+
+bool net_server_start_thread(struct net_server *server) {
+    return io_start(server->io);
+}
+
+int net_server_fd(const struct net_server *server) {
+    return server->io->threaded ? -1 : server->io->fd;
+}
+
+struct net_client *net_client_create(const char *host, uint16_t port) {
+    struct net_client *client = calloc(1, sizeof(*client));
+    if (!client) {
+        return NULL;
+    }
+
+    if (!resolve(host, port, &client->server)) {
+        free(client);
+
+        return NULL;
+    }
+
+    client->fd = udp_sock(NULL, 0);
+    client->io = client->fd < 0 ? NULL : io_create(client->fd);
+
+    if (!client->io) {
+        if (client->fd >= 0) {
+            close(client->fd);
+        }
+        free(client);
+        return NULL;
+    }
+
+    client->connecting = true;
+
+    return client;
+}
+
+void net_client_destroy(struct net_client *client) {
+    if (!client) {
+        return;
+    }
+
+    if (client->connected) {
+        net_client_disconnect(client);
+    }
+
+    reliable_reset(&client->reliable);
+    fragments_free(&client->fragments);
+    free(client->outbox.buf);
+    io_destroy(client->io);
+    close(client->fd);
+    free(client);
+}
+
+void net_client_disconnect(struct net_client *client) {
+    if (client->connected) {
+        for (uint32_t i = 0; i < 3; i++) {
+            packet_send(client->io, &client->server, PACKET_DISCONNECT);
+        }
+
+        io_flush(client->io);
+    }
+
+    // what is left of the batch may point into the buffers freed below
+    client->io->views_count = client->io->views_next = 0;
+    reliable_reset(&client->reliable);
+    fragments_free(&client->fragments);
+    client->outbox.len = HEADER;
+    client->outbox.count = 0;
+    client->connected = false;
+    client->connecting = false;
+}
+
+static int client_packet(struct net_client *client, const double t, const uint32_t type, const uint8_t *body,
+                         const uint32_t len, struct net_view *view) {
+    if (type == PACKET_CONNECT_ACKNOWLEDGMENT) {
+        if (client->connected) {
+            return 0;
+        }
+
+        client->connected = true;
+        client->connecting = false;
+        reliable_reset(&client->reliable);
+        fragments_free(&client->fragments);
+        client->sequenced = (struct net_sequenced){0};
+        client->stats = (struct net_peer_stats){0};
+
+        client->id = len >= 4 ? read_u32(body) : 0;
+
+        *view = (struct net_view){
+            .type = NET_EVENT_CONNECT,
+            .client_id = client->id,
+        };
+
+        return 1;
+    }
 
     if (type == PACKET_DISCONNECT) {
         client->connected = false;
         client->connecting = false;
 
-        *event = (struct net_event){
+        *view = (struct net_view){
             .type = NET_EVENT_DISCONNECT,
             .client_id = client->id,
         };
@@ -464,14 +2562,77 @@ uint32_t net_client_poll(struct net_client *client, struct net_event *event) {
             return 0;
         }
 
-        const uint32_t payload = (uint32_t) (n - HEADER);
+        *view = (struct net_view){
+            .type = NET_EVENT_DATA,
+            .client_id = client->id,
+            .len = len,
+            .data = body,
+        };
+
+        return 1;
+    }
+
+    if ((type == PACKET_RELIABLE || type == PACKET_RELIABLE_FRAGMENT || type == PACKET_ACK) && client->connected) {
+        struct net_reliable *rel = &client->reliable;
+
+        if (type == PACKET_ACK) {
+            if (len >= 6) {
+                reliable_ack(rel, read_u16(body), read_u32(body + 2), t);
+            }
+
+            return 0;
+        }
+
+        if (len < 8) {
+            return 0;
+        }
+
+        reliable_ack(rel, read_u16(body + 2), read_u32(body + 4), t);
+
+        const bool more = type == PACKET_RELIABLE_FRAGMENT;
+        const uint8_t *data = body + 8;
+        uint32_t size = len - 8;
+        if (reliable_accept(rel, &client->stats, read_u16(body), more, data, size) < 1 ||
+            !reliable_assemble(rel, NET_MESSAGE_LIMIT, more, &data, &size)) {
+            return 0;
+        }
+
+        *view = (struct net_view){
+            .type = NET_EVENT_DATA,
+            .client_id = client->id,
+            .len = size,
+            .data = data,
+        };
+        client->io->hold = client->io->hold || data == rel->assembly;
+
+        return 1;
+    }
+
+    if (type == PACKET_FRAGMENT && client->connected) {
+        *view = (struct net_view){
+            .type = NET_EVENT_DATA,
+            .client_id = client->id,
+        };
+        if (!fragment_accept(&client->fragments, &client->stats, NET_MESSAGE_LIMIT, t, body, len, &view->data,
+                             &view->len)) {
+            return 0;
+        }
+        client->io->hold = true;
+
+        return 1;
+    }
+
+    if (type == PACKET_SEQUENCED && client->connected) {
+        if (!sequenced_accept(&client->sequenced, &client->stats, body, len)) {
+            return 0;
+        }
 
-        *event = (struct net_event){
+        *view = (struct net_view){
             .type = NET_EVENT_DATA,
             .client_id = client->id,
-            .len = payload,
+            .len = len - 3,
+            .data = body + 3,
         };
-        memcpy(event->data, buf + HEADER, payload);
 
         return 1;
     }
@@ -479,16 +2640,254 @@ uint32_t net_client_poll(struct net_client *client, struct net_event *event) {
     return 0;
 }
 
-void net_client_send(const struct net_client *client, const void *data, uint32_t len) {
+static int client_recv(struct net_client *client, const double t, struct net_view *view) {
+    struct net_io *io = client->io;
+    uint32_t type;
+
+    if (!io->unpack_len) {
+        const uint8_t *buf;
+        struct net_addr from;
+        double at = t;
+
+        const int n = udp_recv(io, &from, &buf, &at);
+        if (n < 0) {
+            return -1;
+        }
+
+        if (!packet_check(buf, n, &type) || !addr_eq(&from, &client->server)) {
+            return 0;
+        }
+
+        client->stats.packets_in++;
+        client->stats.bytes_in += (uint32_t) n;
+
+        if (type != PACKET_BATCH) {
+            return client_packet(client, at, type, buf + HEADER, (uint32_t) (n - HEADER), view);
+        }
+
+        io->unpack = buf + HEADER;
+        io->unpack_len = (uint32_t) (n - HEADER);
+        io->unpack_time = at;
+    }
+
+    const uint8_t *body;
+    uint32_t len;
+    if (!unpack_next(io, &type, &body, &len)) {
+        return 0;
+    }
+
+    return client_packet(client, io->unpack_time, type, body, len, view);
+}
+
+// connect attempts, reliable sends and acks, then everything queued goes out
+static void client_service(struct net_client *client, const double t) {
+
+    if (client->connecting && !client->connected && t - client->last_attempt > 1.0) {
+        packet_send(client->io, &client->server, PACKET_CONNECT);
+        client->last_attempt = t;
+    }
+
+    if (client->connected) {
+        reliable_transmit(client->io, &client->server, &client->reliable, &client->stats, t);
+        outbox_flush(client->io, &client->server, &client->outbox, &client->stats);
+    }
+
+    io_flush(client->io);
+}
+
+static uint32_t client_deliver(struct net_client *client, struct net_view *view) {
+    struct net_reliable *rel = &client->reliable;
+
+    while (rel->ready) {
+        const uint8_t *data;
+        uint32_t len;
+
+        const bool more = reliable_next(rel, &data, &len);
+        if (reliable_assemble(rel, NET_MESSAGE_LIMIT, more, &data, &len)) {
+            *view = (struct net_view){
+                .type = NET_EVENT_DATA,
+                .client_id = client->id,
+                .len = len,
+                .data = data,
+            };
+            client->io->hold = client->io->hold || data == rel->assembly;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t net_client_poll(struct net_client *client, struct net_event *event) {
+    const double t = net_time();
+    struct net_view view;
+
+    if (client->io->views_next < client->io->views_count) {
+        view_to_event(&client->io->views[client->io->views_next++], event);
+
+        return 1;
+    }
+
+    io_release(client->io);
+    client_service(client, t);
+
+    if (client_deliver(client, &view) || client_recv(client, t, &view) > 0) {
+        view_to_event(&view, event);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint32_t client_batch(struct net_client *client) {
+    struct net_io *io = client->io;
+    const double t = net_time();
+    uint32_t count = 0;
+
+    io_release(io);
+    client_service(client, t);
+    io->hold = false;
+
+    while (count < NET_BATCH && !io->hold && client_deliver(client, &io->views[count])) {
+        count++;
+    }
+
+    io->hold = io->hold || count;
+
+    for (uint32_t i = 0; count < NET_BATCH && !io->hold; i++) {
+        if (i && count && !io_pending(io)) {
+            break;
+        }
+
+        const int n = client_recv(client, t, &io->views[count]);
+        if (n < 0) {
+            break;
+        }
+
+        count += (uint32_t) n;
+    }
+
+    return count;
+}
+
+uint32_t net_client_poll_batch(struct net_client *client, const struct net_view **views) {
+    struct net_io *io = client->io;
+
+    if (io->views_next == io->views_count) {
+        io->views_count = client_batch(client);
+        io->views_next = 0;
+    }
+
+    const uint32_t count = io->views_count - io->views_next;
+    *views = &io->views[io->views_next];
+    io->views_next = io->views_count;
+
+    return count;
+}
+
+const struct net_view *net_client_poll_view(struct net_client *client) {
+    struct net_io *io = client->io;
+
+    if (io->views_next == io->views_count) {
+        io->views_count = client_batch(client);
+        io->views_next = 0;
+    }
+
+    return io->views_next < io->views_count ? &io->views[io->views_next++] : NULL;
+}
+
+void net_client_send(struct net_client *client, const void *data, const uint32_t len) {
     if (!client->connected) {
         return;
     }
 
-    if (len > NET_PAYLOAD) len = NET_PAYLOAD;
+    if (len > NET_MESSAGE_LIMIT) {
+        client->stats.send_dropped++;
+        return;
+    }
+
+    uint8_t *body = outbox_reserve(client->io, &client->server, &client->outbox, &client->stats, PACKET_DATA, len);
+    if (body) {
+        memcpy(body, data, len);
+        return;
+    }
+
+    if (client->outbox.buf) {
+        outbox_flush(client->io, &client->server, &client->outbox, &client->stats);
+    }
+
+    if (len > NET_PAYLOAD) {
+        fragment_send(client->io, &client->server, &client->fragments, &client->stats, data, len);
+        return;
+    }
 
     uint8_t buf[HEADER + NET_PAYLOAD];
 
     packet_pack(buf, PACKET_DATA);
     memcpy(buf + HEADER, data, len);
-    udp_send(client->fd, &client->server, buf, HEADER + len);
+    peer_send(client->io, &client->server, &client->stats, buf, HEADER + len);
+}
+
+bool net_client_send_reliable(struct net_client *client, const void *data, const uint32_t len) {
+    if (!client->connected) {
+        return false;
+    }
+
+    if (!reliable_queue(&client->reliable, data, len, NET_MESSAGE_LIMIT)) {
+        client->stats.send_dropped++;
+        return false;
+    }
+
+    return true;
+}
+
+bool net_client_send_sequenced(struct net_client *client, const uint32_t channel, const void *data,
+                               const uint32_t len) {
+    if (!client->connected || channel >= NET_SEQUENCED_CHANNELS) {
+        return false;
+    }
+
+    if (len > NET_SEQUENCED_PAYLOAD) {
+        client->stats.send_dropped++;
+        return false;
+    }
+
+    uint8_t *body = outbox_reserve(client->io, &client->server, &client->outbox, &client->stats, PACKET_SEQUENCED,
+                                   3 + len);
+    if (body) {
+        sequenced_write(body, &client->sequenced, channel, data, len);
+        return true;
+    }
+
+    if (client->outbox.buf) {
+        outbox_flush(client->io, &client->server, &client->outbox, &client->stats);
+    }
+
+    uint8_t buf[HEADER + NET_PAYLOAD];
+
+    packet_pack(buf, PACKET_SEQUENCED);
+    sequenced_write(buf + HEADER, &client->sequenced, channel, data, len);
+    peer_send(client->io, &client->server, &client->stats, buf, HEADER + 3 + len);
+
+    return true;
+}
+
+const struct net_peer_stats *net_client_peer_stats(struct net_client *client) {
+    stats_refresh(&client->stats, &client->reliable);
+
+    return &client->stats;
+}
+
+void net_client_flush(struct net_client *client) {
+    client_service(client, net_time());
+}
+
+const struct net_io_stats *net_client_io_stats(const struct net_client *client) {
+    return io_stats(client->io);
+}
+
+bool net_client_start_thread(struct net_client *client) {
+    return io_start(client->io);
 }
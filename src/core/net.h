@@ -9,6 +9,48 @@
 #define NET_PROTOCOL_ID 0x696969Eu
 // maximum payload size
 #define NET_PAYLOAD 1400
+// upper bound for the `n` passed to net_server_create
+#define NET_MAX_CLIENTS 65536
+// datagrams moved per recvmmsg / sendmmsg, -DNET_BATCH=1 gives one syscall per datagram
+#ifndef NET_BATCH
+#define NET_BATCH 64
+#endif
+// datagrams queued each way between the io thread and the game, a power of two
+#define NET_RING 1024
+// peer timeouts run on a two level timing wheel, one tick is 1 / NET_WHEEL_RATE seconds,
+// the upper level spans NET_WHEEL_SLOTS^2 ticks which must cover NET_TIMEOUT
+#define NET_WHEEL_RATE 16
+#define NET_WHEEL_BITS 6
+#define NET_WHEEL_SLOTS (1 << NET_WHEEL_BITS)
+// reliable-ordered messages in flight per peer, the width of the ack bitfield
+#define NET_RELIABLE_WINDOW 32
+// reliable messages queued per peer, in flight or waiting for the window
+#define NET_RELIABLE_QUEUE 256
+// seq, ack and ack bits go in front of a reliable payload
+#define NET_RELIABLE_PAYLOAD (NET_PAYLOAD - 8)
+// independent unreliable-sequenced streams per peer, channel and seq go in front of the payload
+#define NET_SEQUENCED_CHANNELS 16
+#define NET_SEQUENCED_PAYLOAD (NET_PAYLOAD - 3)
+// retransmit timeout bounds in seconds, NET_RTO_INIT until the first rtt sample
+#define NET_RTO_INIT 0.2
+#define NET_RTO_MIN 0.03
+#define NET_RTO_MAX 2.0
+// larger messages go out in fragments and arrive as one event, net_server_create takes the largest
+// it sends or accepts, 0 means NET_MESSAGE_DEFAULT. the client accepts up to NET_MESSAGE_LIMIT
+#define NET_MESSAGE_DEFAULT (64u * 1024u)
+#define NET_MESSAGE_LIMIT (1024u * 1024u)
+// message id, index and count go in front of every unreliable fragment
+#define NET_FRAGMENT_PAYLOAD (NET_PAYLOAD - 6)
+// messages reassembled at once per peer, a partial one is dropped after NET_FRAGMENT_TIMEOUT seconds
+// and all of them together hold at most 2 * max_message bytes
+#define NET_FRAGMENT_SLOTS 4
+#define NET_FRAGMENT_TIMEOUT 2.0
+// area of interest grid for broadcast_near, square cells of NET_AOI_CELL world units hashed into
+// NET_AOI_BUCKETS lists. a peer sees NET_AOI_VIEW units around its position until told otherwise
+#define NET_AOI_CELL 512.0
+#define NET_AOI_BITS 10
+#define NET_AOI_BUCKETS (1u << NET_AOI_BITS)
+#define NET_AOI_VIEW 1024.0
 
 enum {
     NET_EVENT_NONE,
@@ -22,34 +64,216 @@ struct net_addr {
     uint16_t port;
 };
 
+// data points into the receive or reassembly buffers, valid until the next poll on the same server or client
 struct net_event {
     uint32_t type;
     uint32_t client_id;
 
-    uint8_t data[NET_PAYLOAD];
+    const uint8_t *data;
 
     uint32_t len;
 };
 
+// one entry of a poll_batch, same lifetime as a net_event
+struct net_view {
+    uint32_t type;
+    uint32_t client_id;
+    uint32_t len;
+    const uint8_t *data;
+};
+
+// socket level counters, one call moves up to NET_BATCH datagrams
+struct net_io_stats {
+    uint64_t recv_calls;
+    uint64_t recv_packets;
+    uint64_t send_calls;
+    uint64_t send_packets;
+
+    // the rest is only counted with the io thread running.
+    // datagrams waiting in the rings right now and the deepest they got
+    uint32_t recv_queue;
+    uint32_t recv_queue_max;
+    uint32_t send_queue;
+    uint32_t send_queue_max;
+    // sends dropped on a full send ring, times the receive ring filled up and reading paused,
+    // and datagrams the kernel dropped on a full socket buffer
+    uint64_t send_dropped;
+    uint64_t recv_stalls;
+    uint64_t kernel_dropped;
+};
+
+// what broadcast_near saved against broadcasting to everyone connected
+struct net_aoi_stats {
+    uint64_t broadcasts;
+    // peers reached and connected peers left out, counted per broadcast
+    uint64_t sent;
+    uint64_t skipped;
+    uint64_t bytes_sent;
+    uint64_t bytes_skipped;
+};
+
+// batched socket io, defined in net.c
+struct net_io;
+struct net_reliable_msg;
+// unreliable fragments being reassembled, allocated on the first large message sent or received
+struct net_fragments;
+
+// reliable-ordered channel towards one endpoint, all zero is the initial state
+struct net_reliable {
+    // NET_RELIABLE_QUEUE and NET_RELIABLE_WINDOW entries, allocated on first use
+    struct net_reliable_msg *send;
+    struct net_reliable_msg *recv;
+
+    // oldest unacknowledged and next unused sequence
+    uint16_t send_base;
+    uint16_t send_next;
+    // next sequence to deliver, one past the newest received and whether the 32 before that arrived
+    uint16_t recv_next;
+    uint16_t recv_top;
+    uint32_t recv_bits;
+
+    // fragments of a large message collected until its last one, grows up to max_message
+    uint8_t *assembly;
+    uint32_t assembly_len;
+    uint32_t assembly_cap;
+    // the message outgrew max_message, the rest of its fragments are skipped
+    bool assembly_drop;
+
+    bool ack_pending;
+    // recv holds recv_next, delivered on the next poll
+    bool ready;
+    // listed in the server's active array
+    bool active;
+    uint32_t active_index;
+
+    // smoothed round trip time and its variation, 0 before the first sample
+    double srtt;
+    double rttvar;
+};
+
+// unreliable-sequenced streams, anything older than the newest seen on its channel is dropped
+struct net_sequenced {
+    uint16_t send[NET_SEQUENCED_CHANNELS];
+    // one past the newest sequence received
+    uint16_t recv[NET_SEQUENCED_CHANNELS];
+};
+
+// small unreliable messages coalesced into one datagram per peer and flush, allocated on first use
+struct net_outbox {
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t count;
+    // listed in the server's queued array
+    bool queued;
+};
+
+// counters kept for one peer, or for the client towards the server. datagrams and bytes are what went
+// over the wire after the handshake, headers included
+struct net_peer_stats {
+    uint64_t packets_in;
+    uint64_t bytes_in;
+    uint64_t packets_out;
+    uint64_t bytes_out;
+    // reliable messages sent again for want of an ack
+    uint64_t retransmits;
+    // reliable messages received a second time, and ones that arrived ahead of a gap and waited for it
+    uint64_t duplicates;
+    uint64_t out_of_order;
+    // sequenced messages older than the newest on their channel
+    uint64_t sequenced_dropped;
+    // sends given up on: over max_message, sequenced over NET_SEQUENCED_PAYLOAD, a full reliable queue
+    // or out of memory
+    uint64_t send_dropped;
+    // fragmented messages that timed out or were pushed out half assembled
+    uint64_t fragments_dropped;
+
+    // filled in when the stats are read: smoothed round trip time and its variation in seconds,
+    // 0 before the first sample, and reliable messages queued or waiting for an ack
+    double srtt;
+    double rttvar;
+    uint32_t send_queue;
+};
+
 struct net_peer {
     struct net_addr addr;
     double last_recv;
+
+    // timing wheel slot list, UINT32_MAX ends it
+    uint32_t timer_prev;
+    uint32_t timer_next;
+    // which wheel slot the peer sits in, the level is fixed when linked
+    uint32_t timer_list;
+    uint64_t timer_expire;
+
     // whether this peer is currently active or not
     bool alive;
+
+    // area of interest, listed in bucket aoi_bucket once it has a position, UINT32_MAX ends a list
+    bool aoi_linked;
+    uint32_t aoi_bucket;
+    uint32_t aoi_prev;
+    uint32_t aoi_next;
+    // the last query that looked at this peer, a bucket can hold several of the queried cells
+    uint32_t aoi_mark;
+    double aoi_x;
+    double aoi_y;
+    double aoi_view;
+
+    struct net_reliable reliable;
+    struct net_sequenced sequenced;
+    struct net_outbox outbox;
+    struct net_fragments *fragments;
+    struct net_peer_stats stats;
 };
 
 struct net_server {
     int fd;
+    struct net_io *io;
 
     struct net_peer *peers;
     uint32_t max_clients;
     uint32_t n;
-    double last_sweep;
-    uint32_t sweep_index;
+    uint32_t max_message;
+
+    // open addressing from peer address to id + 1, 0 marks an empty slot
+    uint32_t *table;
+    uint32_t table_mask;
+
+    // ids of dead peers, peer_alloc pops from the back
+    uint32_t *free_ids;
+    uint32_t free_count;
+
+    // heads of the peer lists due in each slot, the lower level first, then the upper level
+    // whose far timers are cascaded down
+    uint32_t wheel[2 * NET_WHEEL_SLOTS];
+    // next tick to expire, counted from wheel_start
+    uint64_t wheel_tick;
+    double wheel_start;
+
+    // peers with reliable messages in flight or acks to send
+    uint32_t *active;
+    uint32_t active_count;
+    // peers whose next reliable message arrived out of order and waits for delivery
+    uint32_t *ready;
+    uint32_t ready_count;
+    // peers with messages waiting in their outbox
+    uint32_t *queued;
+    uint32_t queued_count;
+
+    // heads of the area of interest buckets, allocated on the first position
+    uint32_t *aoi;
+    // the widest view any peer got, bounds the cells a query has to look at
+    double aoi_view_max;
+    uint32_t aoi_mark;
+    struct net_aoi_stats aoi_stats;
+
+    // counters of the peers that already left, for the totals
+    struct net_peer_stats retired;
 };
 
 struct net_client {
     int fd;
+    struct net_io *io;
 
     struct net_addr server;
 
@@ -59,18 +283,88 @@ struct net_client {
     uint32_t id;
 
     double last_attempt;
+
+    struct net_reliable reliable;
+    struct net_sequenced sequenced;
+    struct net_outbox outbox;
+    struct net_fragments *fragments;
+    struct net_peer_stats stats;
 };
 
-// `n` - max clients
-struct net_server *net_server_create(const char *ip, uint16_t port, uint32_t n);
+// `n` - max clients, `max_message` - largest message in bytes, clamped to [NET_PAYLOAD, NET_MESSAGE_LIMIT]
+struct net_server *net_server_create(const char *ip, uint16_t port, uint32_t n, uint32_t max_message);
 
 void net_server_destroy(struct net_server *server);
 
 uint32_t net_server_poll(struct net_server *server, struct net_event *event);
 
-void net_server_send(const struct net_server *server, uint32_t client_id, const void *data, uint32_t len);
+// everything one receive batch holds, returns the number of views, 0 once the socket is drained.
+// views net_server_poll_view did not hand out yet come first, a new batch is only read after them
+uint32_t net_server_poll_batch(struct net_server *server, const struct net_view **views);
+
+// the next view of the current batch, reading a new one once every view was handed out. NULL once drained.
+// a caller that stops early picks up where it left off, the views it did not take stay valid until then
+const struct net_view *net_server_poll_view(struct net_server *server);
+
+// unreliable and sequenced messages are appended to the peer's outbox and packed together
+// into datagrams of up to NET_PAYLOAD bytes, the receiver gets one event per message.
+// larger ones go out as fragments and are lost as a whole with any of them, over max_message they are dropped
+void net_server_send(struct net_server *server, uint32_t client_id, const void *data, uint32_t len);
+
+void net_server_broadcast(struct net_server *server, const void *data, uint32_t len);
+
+// delivered exactly once and in order, split into NET_RELIABLE_PAYLOAD byte fragments past that,
+// false over max_message or when the fragments do not fit in the peer's NET_RELIABLE_QUEUE
+bool net_server_send_reliable(struct net_server *server, uint32_t client_id, const void *data, uint32_t len);
+
+void net_server_broadcast_reliable(struct net_server *server, const void *data, uint32_t len);
+
+// dropped on arrival when a newer message on the same channel got there first,
+// up to NET_SEQUENCED_PAYLOAD bytes. larger ones are not sent and count as send_dropped, false then
+bool net_server_send_sequenced(struct net_server *server, uint32_t client_id, uint32_t channel, const void *data,
+                               uint32_t len);
+
+void net_server_broadcast_sequenced(struct net_server *server, uint32_t channel, const void *data, uint32_t len);
+
+// places a peer in the area of interest grid. it is only relinked when it moves into another bucket,
+// false when the grid could not be allocated
+bool net_server_set_position(struct net_server *server, uint32_t client_id, double x, double y);
+
+// how far a peer sees, NET_AOI_VIEW by default
+void net_server_set_view(struct net_server *server, uint32_t client_id, double view);
+
+// sends to every peer whose view overlaps the circle at x, y. peers without a position get nothing
+void net_server_broadcast_near(struct net_server *server, double x, double y, double radius, const void *data,
+                               uint32_t len);
+
+void net_server_broadcast_near_reliable(struct net_server *server, double x, double y, double radius,
+                                        const void *data, uint32_t len);
 
-void net_server_broadcast(const struct net_server *server, const void *data, uint32_t len);
+void net_server_broadcast_near_sequenced(struct net_server *server, double x, double y, double radius,
+                                         uint32_t channel, const void *data, uint32_t len);
+
+const struct net_aoi_stats *net_server_aoi_stats(const struct net_server *server);
+
+// NULL for ids that are not connected
+const struct net_peer_stats *net_server_peer_stats(struct net_server *server, uint32_t client_id);
+
+// the counters of every peer since the server started, those that left included. srtt and rttvar
+// are the mean over connected peers with a sample, send_queue the sum
+void net_server_total_stats(const struct net_server *server, struct net_peer_stats *total);
+
+// outboxes go out when a peer's datagram fills, at the start of the next poll or here,
+// once per tick is enough. reliable messages and their retransmits go out here too
+void net_server_flush(struct net_server *server);
+
+const struct net_io_stats *net_server_io_stats(const struct net_server *server);
+
+// opt-in, a thread of its own owns the socket from here on and moves datagrams through NET_RING deep
+// queues, so the kernel buffer keeps draining during long frames. polls and sends work as before,
+// call it before the first poll. false if the thread could not start, the server keeps working without it
+bool net_server_start_thread(struct net_server *server);
+
+// the socket to wait on for incoming datagrams, -1 once the io thread owns it
+int net_server_fd(const struct net_server *server);
 
 struct net_client *net_client_create(const char *host, uint16_t port);
 
@@ -80,6 +374,24 @@ void net_client_destroy(struct net_client *client);
 
 uint32_t net_client_poll(struct net_client *client, struct net_event *event);
 
-void net_client_send(const struct net_client *client, const void *data, uint32_t len);
+uint32_t net_client_poll_batch(struct net_client *client, const struct net_view **views);
+
+// disconnecting drops the views not handed out yet
+const struct net_view *net_client_poll_view(struct net_client *client);
+
+void net_client_send(struct net_client *client, const void *data, uint32_t len);
+
+bool net_client_send_reliable(struct net_client *client, const void *data, uint32_t len);
+
+bool net_client_send_sequenced(struct net_client *client, uint32_t channel, const void *data, uint32_t len);
+
+// counted from the last connect
+const struct net_peer_stats *net_client_peer_stats(struct net_client *client);
+
+void net_client_flush(struct net_client *client);
+
+const struct net_io_stats *net_client_io_stats(const struct net_client *client);
+
+bool net_client_start_thread(struct net_client *client);
 
 #endif /* NET_H */
@@ -42,9 +42,143 @@ static void buffers_init(struct render_context *r) {
 
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
     glEnableVertexAttribArray(1);
+
+    /* per instance stream, pointers are set per run in instance_attribs() */
+    for (GLuint i = 2; i <= 6; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+}
+
+static size_t stream_size_class(size_t bytes) {
+    size_t size = RENDER_STREAM_MIN_SIZE;
+    while (size < bytes) {
+        size *= 2;
+    }
+
+    return size;
+}
+
+static void stream_wait(struct render_context *r, struct render_stream_buffer *s, int frame) {
+    if (!s->fences[frame]) {
+        return;
+    }
+
+    /* only count it when the gpu is actually behind */
+    if (glClientWaitSync(s->fences[frame], 0, 0) == GL_TIMEOUT_EXPIRED) {
+        r->stats.fence_waits++;
+        while (glClientWaitSync(s->fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+        }
+    }
+
+    glDeleteSync(s->fences[frame]);
+    s->fences[frame] = NULL;
+}
+
+/* (re)creates the buffer with `size` bytes per region, binds it */
+static void stream_storage(struct render_context *r, struct render_stream_buffer *s, size_t size) {
+    if (s->vbo) {
+        for (int i = 0; i < RENDER_STREAM_FRAMES; i++) {
+            stream_wait(r, s, i);
+        }
+
+        if (s->mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            s->mapped = NULL;
+        }
+
+        glDeleteBuffers(1, &s->vbo);
+    }
+
+    s->size = size;
+    s->frame = 0;
+
+    glGenBuffers(1, &s->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+
+    if (s->persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size * RENDER_STREAM_FRAMES, NULL, flags);
+        s->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size * RENDER_STREAM_FRAMES, flags);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, size * RENDER_STREAM_FRAMES, NULL, GL_STREAM_DRAW);
+    }
+}
+
+static void stream_init(struct render_context *r, struct render_stream_buffer *s) {
+    *s = (struct render_stream_buffer){.persistent = GLAD_GL_VERSION_4_4};
+    stream_storage(r, s, RENDER_STREAM_MIN_SIZE);
+}
+
+static void stream_deinit(const struct render_stream_buffer *s) {
+    for (int i = 0; i < RENDER_STREAM_FRAMES; i++) {
+        if (s->fences[i]) glDeleteSync(s->fences[i]);
+    }
+
+    if (s->mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    glDeleteBuffers(1, &s->vbo);
 }
 
-static int program_init(const char *vert_path, const char *frag_path, GLuint *program) {
+/* returns `bytes` of writable memory in this frame's region, stream_unmap() before drawing.
+   *offset is where the data starts in the buffer, which stays bound */
+static void *stream_map(struct render_context *r, struct render_stream_buffer *s, size_t bytes, size_t *offset) {
+    if (bytes > s->size) {
+        stream_storage(r, s, stream_size_class(bytes));
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+    *offset = (size_t)s->frame * s->size;
+    r->stats.upload_bytes += bytes;
+
+    if (s->persistent) {
+        stream_wait(r, s, s->frame);
+        return s->mapped + *offset;
+    }
+
+    /* back at the first region the gpu may still read the others, orphan instead of waiting */
+    if (s->frame == 0) {
+        glBufferData(GL_ARRAY_BUFFER, s->size * RENDER_STREAM_FRAMES, NULL, GL_STREAM_DRAW);
+    }
+
+    return glMapBufferRange(GL_ARRAY_BUFFER, *offset, bytes,
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+static void stream_unmap(struct render_stream_buffer *s) {
+    if (!s->persistent) {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+}
+
+/* after the frame's draws, fences the region and moves on to the next */
+static void stream_end_frame(struct render_stream_buffer *s) {
+    if (s->persistent) {
+        s->fences[s->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    s->frame = (s->frame + 1) % RENDER_STREAM_FRAMES;
+}
+
+/* points the instance attributes at the run starting at `first`, `offset` is where the instances start */
+static void instance_attribs(size_t offset, size_t first) {
+    const GLsizei stride = sizeof(struct quad_instance);
+    const size_t base = offset + first * sizeof(struct quad_instance);
+
+    /* 2x2 part as one vec4, translation as a vec2 */
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void *)(base + offsetof(struct quad_instance, transform.a)));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride, (void *)(base + offsetof(struct quad_instance, transform.tx)));
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void *)(base + offsetof(struct quad_instance, color)));
+    /* uv_min and uv_size are adjacent, read as one vec4 */
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, stride, (void *)(base + offsetof(struct quad_instance, uv_min)));
+    glVertexAttribIPointer(6, 1, GL_INT, stride, (void *)(base + offsetof(struct quad_instance, slot)));
+}
+
+static int program_init(const char *vert_path, const char *frag_path, struct render_program *program) {
     int error = 0;
     int success;
     char info_log[512];
@@ -92,20 +226,25 @@ static int program_init(const char *vert_path, const char *frag_path, GLuint *pr
         goto end;
     }
 
-    *program = glCreateProgram();
-    glAttachShader(*program, vertex_id);
-    glAttachShader(*program, fragment_id);
-    glLinkProgram(*program);
+    program->id = glCreateProgram();
+    glAttachShader(program->id, vertex_id);
+    glAttachShader(program->id, fragment_id);
+    glLinkProgram(program->id);
 
-    glGetProgramiv(*program, GL_LINK_STATUS, &success);
+    glGetProgramiv(program->id, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(*program, 512, NULL, info_log);
+        glGetProgramInfoLog(program->id, 512, NULL, info_log);
         fprintf(stderr, "failed to link shaders: %s\n", info_log);
         error = 1;
         goto end;
     }
 
-    glUseProgram(*program);
+    /* -1 for uniforms a program does not have, gl ignores uploads to those */
+    program->u_proj = glGetUniformLocation(program->id, "u_proj");
+    program->u_textures = glGetUniformLocation(program->id, "u_textures");
+    program->proj_set = false;
+
+    glUseProgram(program->id);
 
 end:
     glDeleteShader(vertex_id);
@@ -116,6 +255,65 @@ end:
     return error;
 }
 
+/* u_textures[i] always samples texture unit i */
+static void program_samplers(const struct render_program *program) {
+    GLint units[RENDERER_TEXTURE_SLOTS];
+    for (int i = 0; i < RENDERER_TEXTURE_SLOTS; i++) {
+        units[i] = i;
+    }
+
+    glUseProgram(program->id);
+    glUniform1iv(program->u_textures, RENDERER_TEXTURE_SLOTS, units);
+}
+
+/* forget what is bound, anything outside renderer_draw may have changed it */
+static void state_reset(struct render_context *r) {
+    r->state.program = 0;
+    r->state.active_unit = 0;
+    for (int i = 0; i < RENDERER_TEXTURE_SLOTS; i++) {
+        r->state.textures[i] = 0;
+    }
+
+    r->quad_program.proj_set = false;
+    r->tex_program.proj_set = false;
+    r->text_program.proj_set = false;
+}
+
+static void state_use_program(struct render_context *r, const struct render_program *program) {
+    if (r->state.program == program->id) {
+        r->stats.program_skipped++;
+        return;
+    }
+
+    glUseProgram(program->id);
+    r->state.program = program->id;
+}
+
+static void state_bind_texture(struct render_context *r, int unit, GLuint tex) {
+    if (r->state.textures[unit] == tex) {
+        r->stats.texture_skipped++;
+        return;
+    }
+
+    if (r->state.active_unit != (GLenum)unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        r->state.active_unit = unit;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, tex);
+    r->state.textures[unit] = tex;
+}
+
+static void state_proj(struct render_context *r, struct render_program *program, const struct matrix *proj) {
+    if (program->proj_set) {
+        r->stats.proj_skipped++;
+        return;
+    }
+
+    glUniformMatrix4fv(program->u_proj, 1, GL_FALSE, proj->m);
+    program->proj_set = true;
+}
+
 static int font_init(struct render_context *r) {
     if (FT_Init_FreeType(&r->ft_lib)) {
         fprintf(stderr, "failed to init freetype\n");
@@ -131,6 +329,7 @@ static int font_init(struct render_context *r) {
 
 int renderer_init(struct render_context *r) {
     buffers_init(r);
+    stream_init(r, &r->instance_stream);
 
     if (program_init("quad.vert", "quad.frag", &r->quad_program)) {
         fprintf(stderr, "failed to init shaders!\n");
@@ -147,6 +346,13 @@ int renderer_init(struct render_context *r) {
         return 1;
     }
 
+    program_samplers(&r->tex_program);
+    program_samplers(&r->text_program);
+
+    r->quad_program.order = 0;
+    r->tex_program.order = 1;
+    r->text_program.order = 2;
+
     glEnable(GL_BLEND);
     //glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -167,18 +373,88 @@ int renderer_init(struct render_context *r) {
 }
 
 static void font_deinit(const struct render_context *r) {
-    FT_Done_FreeType(r->ft_lib);
     for (size_t i = 0; i < r->fonts_count; i++) {
-        if (r->fonts[i].chars) free(r->fonts[i].chars);
+        if (r->fonts[i].face) FT_Done_Face(r->fonts[i].face);
     }
     if (r->fonts) free(r->fonts);
+    FT_Done_FreeType(r->ft_lib);
+
+    for (int i = 0; i < r->glyph_pages_count; i++) {
+        const struct glyph_page *page = &r->glyph_pages[i];
+        glDeleteTextures(1, &page->tex);
+        free(page->pixels);
+
+        struct atlas_packer packer = page->packer;
+        atlas_packer_deinit(&packer);
+    }
+    free(r->glyphs);
+    free(r->glyph_table);
+
+    for (size_t i = 0; i < r->layouts_count; i++) {
+        free(r->layouts[i].text);
+        free(r->layouts[i].quads);
+    }
+    free(r->layouts);
+    free(r->layout_table);
+}
+
+static void textures_deinit(const struct render_context *r) {
+    for (size_t i = 0; i < r->atlas_pages_count; i++) {
+        struct atlas_page *page = &r->atlas_pages[i];
+        glDeleteTextures(1, &page->tex);
+        atlas_packer_deinit(&page->packer);
+    }
+    free(r->atlas_pages);
+
+    /* atlas entries share their page texture, which is gone already */
+    for (size_t i = 0; i < r->textures_count; i++) {
+        const struct texture_entry *entry = &r->textures[i];
+        if (!entry->atlas) {
+            glDeleteTextures(1, &entry->tex);
+        }
+    }
+    free(r->textures);
 }
 
 void renderer_deinit(const struct render_context *r) {
+    for (size_t i = 0; i < r->retained_count; i++) {
+        const struct retained_layer *layer = &r->retained[i];
+        glDeleteBuffers(1, &layer->vbo);
+        free(layer->runs);
+    }
+    free(r->retained);
+    free(r->retained_draws);
+
+    textures_deinit(r);
     free(r->quads);
+    free(r->keys);
+    free(r->transform_in);
+    free(r->runs);
+    stream_deinit(&r->instance_stream);
     font_deinit(r);
 }
 
+/* makes room for `needed` elements of `size` bytes, returns the (possibly moved) array or NULL */
+static void *grow(void *data, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) {
+        return data;
+    }
+
+    size_t new_cap = *capacity ? *capacity : 2;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+
+    void *new_data = realloc(data, new_cap * size);
+    if (!new_data) {
+        fprintf(stderr, "out of memory!\n");
+        return NULL;
+    }
+
+    *capacity = new_cap;
+    return new_data;
+}
+
 void renderer_push_quad(struct render_context *r, struct quad_data data) {
     if (r->quads_count + 1 > r->quads_capacity) {
         const size_t new_cap = r->quads_capacity ? r->quads_capacity * 2 : 2;
@@ -217,7 +493,7 @@ static struct vec2 anchoring_pos(struct vec2 pos, struct vec2 scale, int anchor)
     return anchor_pos;
 }
 
-void renderer_push_rect(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, struct color3 c, int anchor) {
+void renderer_push_rect(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, struct color3 c, int anchor, int layer) {
     struct vec2 anchor_pos = anchoring_pos(pos, scale, anchor);
 
     struct quad_data data = (struct quad_data){
@@ -226,12 +502,13 @@ void renderer_push_rect(struct render_context *r, struct vec2 pos, struct vec2 s
         .scale = scale,
         .rotation = rotation,
         .data.color = c,
+        .layer = layer,
     };
 
     renderer_push_quad(r, data);
 }
 
-void renderer_push_texture(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, texture_id texture, int anchor) {
+void renderer_push_texture(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, texture_id texture, int anchor, int layer) {
     struct vec2 anchor_pos = anchoring_pos(pos, scale, anchor);
 
     struct quad_data data = (struct quad_data){
@@ -239,359 +516,1396 @@ void renderer_push_texture(struct render_context *r, struct vec2 pos, struct vec
         .pos = anchor_pos,
         .scale = scale,
         .rotation = rotation,
-        .data.texture.tex_id = texture,
+        .layer = layer,
     };
 
+    if (texture >= 0 && (size_t)texture < r->textures_count) {
+        const struct texture_entry *entry = &r->textures[texture];
+        data.data.texture.tex = entry->tex;
+        data.data.texture.min = entry->uv_min;
+        data.data.texture.size = entry->uv_size;
+    }
+
     renderer_push_quad(r, data);
 }
 
-static void renderer_push_char(struct render_context *r, struct vec2 pos, struct vec2 scale, struct color3 text_color, struct font *font, int char_index) {
-    struct character *ch = &font->chars[char_index];
+/* decodes one utf-8 sequence and moves `s` past it, malformed input becomes U+FFFD */
+static uint32_t utf8_next(const char **s) {
+    static const uint32_t min_codepoint[] = {0, 0, 0x80, 0x800, 0x10000};
+    const uint8_t *p = (const uint8_t *)*s;
+
+    uint32_t codepoint;
+    int len;
+
+    if (p[0] < 0x80) {
+        codepoint = p[0];
+        len = 1;
+    } else if ((p[0] & 0xe0) == 0xc0) {
+        codepoint = p[0] & 0x1f;
+        len = 2;
+    } else if ((p[0] & 0xf0) == 0xe0) {
+        codepoint = p[0] & 0x0f;
+        len = 3;
+    } else if ((p[0] & 0xf8) == 0xf0) {
+        codepoint = p[0] & 0x07;
+        len = 4;
+    } else {
+        *s += 1;
+        return 0xfffd;
+    }
 
-    struct quad_data data = (struct quad_data){
-        .type = QUAD_TYPE_TEXT,
-        .pos = pos,
-        .scale = scale,
-        .rotation = 0.0f,
-        .data.text.tex_id = font->tex,
-        .data.text.min = (struct vec2){ch->u0, ch->v0},
-        .data.text.size = (struct vec2){ch->u1 - ch->u0, ch->v1 - ch->v0},
-        .data.text.color = text_color,
-    };
+    for (int i = 1; i < len; i++) {
+        /* also stops at the terminator of a cut off sequence */
+        if ((p[i] & 0xc0) != 0x80) {
+            *s += i;
+            return 0xfffd;
+        }
+        codepoint = codepoint << 6 | (p[i] & 0x3f);
+    }
+    *s += len;
 
-    renderer_push_quad(r, data);
+    /* overlong forms, surrogates and anything past unicode */
+    if (codepoint < min_codepoint[len] || (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff) {
+        return 0xfffd;
+    }
+
+    return codepoint;
 }
 
-static float measure_text(struct render_context *r, float pixel_height, font_id font, const char* text) {
-    struct font *f = &r->fonts[font];
+static size_t glyph_hash(font_id font, uint32_t codepoint, size_t capacity) {
+    const uint64_t key = (uint64_t)(uint32_t)font << 32 | codepoint;
+    return (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (capacity - 1);
+}
 
-    int font_pixel_size = f->font_size; 
-    float scale = pixel_height / (float)font_pixel_size;
+static void glyph_table_insert(struct render_context *r, size_t i) {
+    const size_t mask = r->glyph_table_capacity - 1;
 
-    float width = 0.0f;
-    for (const char* c = text; *c; c++) {
-        int char_index = (int)(*c - (char)f->char_range.x);
-        if (char_index < 0 || char_index >= f->char_range.y - f->char_range.x + 1)
-            continue;
+    size_t slot = glyph_hash(r->glyphs[i].font, r->glyphs[i].codepoint, r->glyph_table_capacity);
+    while (r->glyph_table[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    r->glyph_table[slot] = (uint32_t)i + 1;
+}
+
+/* reinserts every glyph, needed after the table grew or the glyph array was compacted */
+static void glyph_table_fill(struct render_context *r) {
+    memset(r->glyph_table, 0, r->glyph_table_capacity * sizeof(uint32_t));
+
+    for (size_t i = 0; i < r->glyphs_count; i++) {
+        glyph_table_insert(r, i);
+    }
+}
+
+static struct glyph *glyph_find(struct render_context *r, font_id font, uint32_t codepoint) {
+    if (!r->glyph_table_capacity) {
+        return NULL;
+    }
 
-        struct character *ch = &f->chars[char_index];
-        width += ch->advance * scale;
+    const size_t mask = r->glyph_table_capacity - 1;
+    for (size_t slot = glyph_hash(font, codepoint, r->glyph_table_capacity); r->glyph_table[slot]; slot = (slot + 1) & mask) {
+        struct glyph *g = &r->glyphs[r->glyph_table[slot] - 1];
+        if (g->font == font && g->codepoint == codepoint) {
+            return g;
+        }
     }
 
-    return width;
+    return NULL;
 }
 
-void renderer_push_text(struct render_context *r, struct vec2 pos, float pixel_height, struct color3 text_color,
-                        font_id font, const char *text, int anchor) {
-    struct font *f = &r->fonts[font];
+static void glyph_page_dirty(struct glyph_page *page, struct vec2i min, struct vec2i max) {
+    if (!page->dirty) {
+        page->dirty_min = min;
+        page->dirty_max = max;
+        page->dirty = true;
+        return;
+    }
 
-    int font_pixel_size = f->font_size;
-    float scale = pixel_height / (float)font_pixel_size;
+    if (min.x < page->dirty_min.x) page->dirty_min.x = min.x;
+    if (min.y < page->dirty_min.y) page->dirty_min.y = min.y;
+    if (max.x > page->dirty_max.x) page->dirty_max.x = max.x;
+    if (max.y > page->dirty_max.y) page->dirty_max.y = max.y;
+}
 
-    float pos_x = pos.x;
-    int baseline_y = pos.y;
-    
-    /* custom anchorin needed for font */
-    switch (anchor) {
-        case ANCHOR_TOP_LEFT:
-            baseline_y -= pixel_height;
-            break;
+static struct glyph_page *glyph_page_add(struct render_context *r) {
+    const int size = RENDERER_GLYPH_PAGE_SIZE;
+    struct glyph_page *page = &r->glyph_pages[r->glyph_pages_count];
 
-        case ANCHOR_CENTER: {
-            /* TODO: maybe some chaching */
-            float width = measure_text(r, pixel_height, font, text);
-            pos_x -= width * 0.5f;
-            break;
+    *page = (struct glyph_page){0};
+    page->pixels = calloc((size_t)size * size, 1);
+    if (!page->pixels || atlas_packer_init(&page->packer, size, size)) {
+        fprintf(stderr, "out of memory!\n");
+        free(page->pixels);
+        return NULL;
+    }
+
+    glGenTextures(1, &page->tex);
+    glBindTexture(GL_TEXTURE_2D, page->tex);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    /* zeroed so the padding between glyphs samples as empty */
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED, GL_UNSIGNED_BYTE, page->pixels);
+
+    r->glyph_pages_count++;
+
+    return page;
+}
+
+/* clears the least recently used page and forgets its glyphs. NULL when every
+   page was pushed this frame, since those uvs are already in the quad list, or
+   is pinned by a retained layer */
+static struct glyph_page *glyph_page_evict(struct render_context *r) {
+    int lru = -1;
+    for (int i = 0; i < r->glyph_pages_count; i++) {
+        if (!r->glyph_pages[i].pins && (lru < 0 || r->glyph_pages[i].last_used < r->glyph_pages[lru].last_used)) {
+            lru = i;
         }
+    }
 
-        /* default dont need to change anything */
-        case ANCHOR_BOTTOM_LEFT:
-        default:
-            break;
+    if (lru < 0 || r->glyph_pages[lru].last_used == r->frame) {
+        return NULL;
     }
+    struct glyph_page *page = &r->glyph_pages[lru];
 
-    for (const char* c = text; *c; c++) {
-        int char_index = (int)(*c - (char)f->char_range.x);
-        if (char_index < 0 || char_index >= f->char_range.y - f->char_range.x + 1)
-            continue;
+    size_t kept = 0;
+    for (size_t i = 0; i < r->glyphs_count; i++) {
+        if (r->glyphs[i].page != lru) {
+            r->glyphs[kept++] = r->glyphs[i];
+        }
+    }
+    r->glyphs_count = kept;
+    glyph_table_fill(r);
+    r->glyph_generation++;
 
-        struct character *ch = &f->chars[char_index];
+    const int size = RENDERER_GLYPH_PAGE_SIZE;
+    atlas_packer_reset(&page->packer);
+    memset(page->pixels, 0, (size_t)size * size);
+    glyph_page_dirty(page, (struct vec2i){0, 0}, (struct vec2i){size, size});
 
-        struct vec2 glyph_size = {
-            .x = ch->size.x * scale,
-            .y = ch->size.y * scale
-        };
+    r->glyph_evictions++;
 
-        struct vec2 glyph_pos = {
-            .x = pos_x + ch->bearing.x * scale + glyph_size.x * 0.5f,
-            .y = baseline_y - (ch->size.y - ch->bearing.y) * scale + glyph_size.y * 0.5f,
-        };
+    return page;
+}
 
-        renderer_push_char(r, glyph_pos, glyph_size, text_color, f, char_index);
+/* finds room for a `w` x `h` bitmap, opening or evicting a page when all are full */
+static int glyph_pack(struct render_context *r, int w, int h, struct vec2i *out) {
+    for (int i = r->glyph_pages_count - 1; i >= 0; i--) {
+        if (atlas_packer_pack(&r->glyph_pages[i].packer, w, h, out)) {
+            return i;
+        }
+    }
 
-        pos_x += ch->advance * scale;
+    struct glyph_page *page = r->glyph_pages_count < RENDERER_GLYPH_PAGES ? glyph_page_add(r) : glyph_page_evict(r);
+    if (!page || !atlas_packer_pack(&page->packer, w, h, out)) {
+        return -1;
     }
+
+    return (int)(page - r->glyph_pages);
 }
 
-void renderer_draw(struct render_context *r) {
-    glBindVertexArray(r->vao);
+static struct glyph *glyph_rasterize(struct render_context *r, font_id font, uint32_t codepoint) {
+    const FT_Face face = r->fonts[font].face;
+    struct glyph g = {
+        .font = font,
+        .codepoint = codepoint,
+        .page = -1,
+    };
 
-    struct matrix cam_m;
-    math_matrix_get_orthographic(r, &cam_m);
+    /* codepoints the font lacks load glyph 0, its own missing glyph box */
+    if (FT_Load_Glyph(face, FT_Get_Char_Index(face, codepoint), FT_LOAD_RENDER)) {
+        /* still cached, without pixels, so it is not retried every frame */
+        fprintf(stderr, "failed loading glyph U+%04X\n", (unsigned)codepoint);
+    } else {
+        g.advance = (int)(face->glyph->advance.x >> 6);
+
+        /* the sdf is built from the rendered bitmap, the outline sdf breaks on
+           overlapping contours. empty glyphs like space have nothing to render */
+        const FT_Bitmap *bitmap = &face->glyph->bitmap;
+        if (bitmap->width && bitmap->rows && !FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF)) {
+            g.size = (struct vec2i){(int)bitmap->width, (int)bitmap->rows};
+            g.bearing = (struct vec2i){face->glyph->bitmap_left, face->glyph->bitmap_top};
+        }
+    }
 
-    for (size_t i = 0; i < r->quads_count; i++) {
-        const struct quad_data *data = &r->quads[i];
+    if (g.size.x > 0 && g.size.y > 0) {
+        const int pad = RENDERER_GLYPH_PADDING;
+        const int page_size = RENDERER_GLYPH_PAGE_SIZE;
+        const FT_Bitmap *bitmap = &face->glyph->bitmap;
 
-        /* TODO: Make this clean */
-        struct matrix translate_m;
-        math_matrix_translate(&translate_m, data->pos.x, data->pos.y, 0.0f);
+        struct vec2i pos;
+        g.page = glyph_pack(r, g.size.x + pad * 2, g.size.y + pad * 2, &pos);
+        if (g.page < 0) {
+            return NULL;
+        }
 
-        struct matrix scale_m;
-        math_matrix_scale(&scale_m, data->scale.x, data->scale.y, 1.0f);
+        struct glyph_page *page = &r->glyph_pages[g.page];
+        pos.x += pad;
+        pos.y += pad;
 
-        struct matrix rotate_m;
-        math_matrix_rotate_2d(&rotate_m, data->rotation);
+        for (int y = 0; y < g.size.y; y++) {
+            memcpy(&page->pixels[(size_t)(pos.y + y) * page_size + pos.x], &bitmap->buffer[y * bitmap->pitch], g.size.x);
+        }
+        glyph_page_dirty(page, pos, (struct vec2i){pos.x + g.size.x, pos.y + g.size.y});
 
-        struct matrix scale_rot_m;
-        math_matrix_mul(&scale_rot_m, &scale_m, &rotate_m);
+        g.uv_min = (struct vec2){(float)pos.x / page_size, (float)pos.y / page_size};
+        g.uv_size = (struct vec2){(float)g.size.x / page_size, (float)g.size.y / page_size};
+    }
 
-        struct matrix m;
-        math_matrix_mul(&m, &translate_m, &scale_rot_m);
+    struct glyph *glyphs = grow(r->glyphs, &r->glyphs_capacity, r->glyphs_count + 1, sizeof(struct glyph));
+    if (!glyphs) {
+        return NULL;
+    }
+    r->glyphs = glyphs;
+    r->glyphs[r->glyphs_count++] = g;
+
+    /* keep the table at most half full so probes stay short */
+    if (r->glyphs_count * 2 > r->glyph_table_capacity) {
+        const size_t capacity = r->glyph_table_capacity ? r->glyph_table_capacity * 2 : 256;
+        uint32_t *table = realloc(r->glyph_table, capacity * sizeof(uint32_t));
+        if (!table) {
+            fprintf(stderr, "out of memory!\n");
+            r->glyphs_count--;
+            return NULL;
+        }
+        r->glyph_table = table;
+        r->glyph_table_capacity = capacity;
+        glyph_table_fill(r);
+    } else {
+        glyph_table_insert(r, r->glyphs_count - 1);
+    }
 
-        GLint uniform_matrix_model_loc;
-        GLint uniform_matrix_cam_loc;
+    r->glyphs_rasterized++;
 
-        switch (data->type) {
-            case QUAD_TYPE_RECT:
-                goto render_rect;
-            case QUAD_TYPE_TEXTURE:
-                if (data->data.texture.tex_id == CORE_RENDERER_QUAD_NO_TEXTURE) {
-                    goto render_rect;
-                }        
-                goto render_texture;
-            case QUAD_TYPE_TEXT:
-                goto render_text;
-            default:
-                goto render_rect;
-        }
-
-        GLint sampler_loc;
-
-        /* RECT */
-        render_rect:
-        glUseProgram(r->quad_program);
-        uniform_matrix_model_loc = glGetUniformLocation(r->quad_program, "u_model");
-        uniform_matrix_cam_loc = glGetUniformLocation(r->quad_program, "u_proj");
-
-        const GLint uniform_color_loc = glGetUniformLocation(r->quad_program, "u_color");
-        glUniform3f(uniform_color_loc, data->data.color.r, data->data.color.g, data->data.color.b);
-        goto render;
-
-        /* TEXTURE */
-        render_texture:
-        glUseProgram(r->tex_program);
-        uniform_matrix_model_loc = glGetUniformLocation(r->tex_program, "u_model");
-        uniform_matrix_cam_loc = glGetUniformLocation(r->tex_program, "u_proj");
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, data->data.texture.tex_id);
-        sampler_loc = glGetUniformLocation(r->tex_program, "u_texture");
-        glUniform1i(sampler_loc, 0);
-        goto render;
-
-        /* TEXT */
-        render_text:
-        glUseProgram(r->text_program);
-        uniform_matrix_model_loc = glGetUniformLocation(r->text_program, "u_model");
-        uniform_matrix_cam_loc = glGetUniformLocation(r->text_program, "u_proj");
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, data->data.text.tex_id);
-        sampler_loc = glGetUniformLocation(r->text_program, "u_texture");
-        glUniform1i(sampler_loc, 0);
-
-        GLint uniform_glyph_min_loc = glGetUniformLocation(r->text_program, "u_glyph_min");
-        GLint uniform_glyph_size_loc = glGetUniformLocation(r->text_program, "u_glyph_size");
-        GLint uniform_text_color_loc = glGetUniformLocation(r->text_program, "u_text_color");
-        glUniform2f(uniform_glyph_min_loc, data->data.text.min.x, data->data.text.min.y);
-        glUniform2f(uniform_glyph_size_loc, data->data.text.size.x, data->data.text.size.y);
-        glUniform3f(uniform_text_color_loc, data->data.text.color.r, data->data.text.color.g, data->data.text.color.b);
+    return &r->glyphs[r->glyphs_count - 1];
+}
 
-        glDepthMask(GL_FALSE);
-        goto render; /* In case for more labels */
+/* cached glyph for a codepoint, rasterized on the first call. NULL when there
+   is no room left this frame */
+static const struct glyph *glyph_get(struct render_context *r, font_id font, uint32_t codepoint) {
+    struct glyph *g = glyph_find(r, font, codepoint);
+    if (!g) {
+        g = glyph_rasterize(r, font, codepoint);
+    }
 
-        render:
-        /* Always Used Uniforms */
-        glUniformMatrix4fv(uniform_matrix_model_loc, 1, GL_FALSE, m.m);
-        glUniformMatrix4fv(uniform_matrix_cam_loc, 1, GL_FALSE, cam_m.m);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glDepthMask(GL_TRUE);
+    if (g && g->page >= 0) {
+        r->glyph_pages[g->page].last_used = r->frame;
     }
 
-    r->quads_count = 0;
+    return g;
 }
 
-texture_id renderer_load_texture(const char *path) {
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+/* uploads what was rasterized since the last draw, one sub image per page */
+static void glyph_pages_upload(struct render_context *r) {
+    bool uploaded = false;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    for (int i = 0; i < r->glyph_pages_count; i++) {
+        struct glyph_page *page = &r->glyph_pages[i];
+        if (!page->dirty) {
+            continue;
+        }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        const int w = page->dirty_max.x - page->dirty_min.x;
+        const int h = page->dirty_max.y - page->dirty_min.y;
 
-    stbi_set_flip_vertically_on_load(1);
+        glBindTexture(GL_TEXTURE_2D, page->tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, RENDERER_GLYPH_PAGE_SIZE);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, page->dirty_min.x);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, page->dirty_min.y);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, page->dirty_min.x, page->dirty_min.y, w, h, GL_RED, GL_UNSIGNED_BYTE,
+                        page->pixels);
 
-    int width, height, channels;
-    unsigned char *data = stbi_load(path, &width, &height, &channels, 0);
-    if (!data) {
-        fprintf(stderr, "failed to load texture: %s\n", path);
-        return -1;
+        r->stats.glyph_upload_bytes += (size_t)w * h;
+        page->dirty = false;
+        uploaded = true;
     }
 
-    const GLint format = channels == 4 ? GL_RGBA : channels == 1 ? GL_RED : GL_RGB;
-
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    stbi_image_free(data);
-
-    return (texture_id)texture;
+    if (uploaded) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
 }
 
-static uint8_t* font_get_atlas(const char* path, int font_size, struct vec2i char_range, int *width, int *height, struct font* font) {
-    if (!path) return NULL;
-
-    // TODO: make the loading chars not constant
-    font->char_range = char_range;
-    const int chars_count = font->char_range.y - font->char_range.x + 1;
-    if (chars_count < 0) return NULL;
+/* fnv-1a over the string, font and size */
+static uint64_t layout_hash(font_id font, float pixel_height, const char *text) {
+    uint64_t hash = 0xcbf29ce484222325ull;
 
-    font->chars = malloc(chars_count * sizeof(struct character));
+    for (const char *c = text; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+    }
 
-    const int char_len = font_size;
-    const int chars_per_line = 26;
+    uint32_t size_bits;
+    memcpy(&size_bits, &pixel_height, sizeof(size_bits));
+    hash = (hash ^ (uint32_t)font) * 0x100000001b3ull;
+    hash = (hash ^ size_bits) * 0x100000001b3ull;
 
-    *width = char_len * chars_per_line;
-    *height = char_len * ((chars_count + chars_per_line - 1) / chars_per_line);
+    return hash;
+}
 
-    font->atlas_width = *width;
-    font->atlas_height = *height;
+static void layout_table_insert(struct render_context *r, size_t i) {
+    const size_t mask = r->layout_table_capacity - 1;
 
-    uint8_t* data = calloc(*width * *height, sizeof(uint8_t));
-    if (!data) {
-        fprintf(stderr, "out of memory loading font: %s\n", path);
-        return NULL;
+    size_t slot = (size_t)r->layouts[i].hash & mask;
+    while (r->layout_table[slot]) {
+        slot = (slot + 1) & mask;
     }
+    r->layout_table[slot] = (uint32_t)i + 1;
+}
 
-    FT_Face face;
+/* reinserts every layout, needed after the table grew or a sweep compacted the layouts */
+static void layout_table_fill(struct render_context *r) {
+    memset(r->layout_table, 0, r->layout_table_capacity * sizeof(uint32_t));
 
-    FT_Error error = FT_New_Face(render_context.ft_lib, path, 0, &face);
-    if (error == FT_Err_Unknown_File_Format) {
-        fprintf(stderr, "unkown format: %s\n", path);
-        free(data);
-        return NULL;
+    for (size_t i = 0; i < r->layouts_count; i++) {
+        layout_table_insert(r, i);
     }
-    else if (error) {
-        fprintf(stderr, "faced unkown error when loading: %s\n", path);
-        free(data);
+}
+
+static struct text_layout *layout_find(struct render_context *r, uint64_t hash, font_id font, float pixel_height,
+                                       const char *text) {
+    if (!r->layout_table_capacity) {
         return NULL;
     }
 
-    FT_GlyphSlot slot = face->glyph;
-
-    error = FT_Set_Pixel_Sizes(face, 0, char_len);
-    int index = 0;
-    for (uint8_t c = font->char_range.x; c <= font->char_range.y; c++) {
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-            fprintf(stderr, "failed loading char: %c in: %s\n", c, path);
-            continue;
+    const size_t mask = r->layout_table_capacity - 1;
+    for (size_t slot = (size_t)hash & mask; r->layout_table[slot]; slot = (slot + 1) & mask) {
+        struct text_layout *layout = &r->layouts[r->layout_table[slot] - 1];
+        if (layout->hash == hash && layout->font == font && layout->pixel_height == pixel_height &&
+            strcmp(layout->text, text) == 0) {
+            return layout;
         }
+    }
 
-        FT_Render_Glyph(slot, FT_RENDER_MODE_SDF);
-
-        int cell_x = (index % chars_per_line) * char_len;
-        int cell_y = (index / chars_per_line) * char_len;
- 
-        // write character into buffer 
-        for (uint32_t y = 0; y < face->glyph->bitmap.rows; y++) {
-            for (uint32_t x = 0; x < face->glyph->bitmap.width; x++) { // probaly some move to right needed
-                int dst_x = cell_x + x;
-                int dst_y = cell_y + y;
+    return NULL;
+}
 
-                /* Overflow due to glyph being larger than cell in this case the 
-                    glyph will just be a little weird at the momemnt but it shouldnt 
-                    really be that visible */
-                if (dst_x >= *width) {
-                    continue;
-                }
-                if (dst_y >= *height) {
-                    continue;
-                }
+/* walks the string once and records its glyph quads relative to the baseline start */
+static bool layout_build(struct render_context *r, struct text_layout *layout) {
+    const float scale = layout->pixel_height / (float)r->fonts[layout->font].font_size;
+
+    size_t capacity = 0;
+    free(layout->quads);
+    layout->quads = NULL;
+    layout->quads_count = 0;
+    layout->pages = 0;
+    layout->complete = true;
+
+    float pos_x = 0.0f;
+    for (const char *c = layout->text; *c;) {
+        const struct glyph *g = glyph_get(r, layout->font, utf8_next(&c));
+        if (!g) {
+            layout->complete = false;
+            continue;
+        }
 
-                int dst_index = dst_y * (*width) + dst_x;
-                data[dst_index] = face->glyph->bitmap.buffer[y * face->glyph->bitmap.pitch + x];
+        if (g->page >= 0) {
+            struct quad_data *quads = grow(layout->quads, &capacity, layout->quads_count + 1, sizeof(struct quad_data));
+            if (!quads) {
+                return false;
             }
+            layout->quads = quads;
+
+            struct vec2 glyph_size = {
+                .x = g->size.x * scale,
+                .y = g->size.y * scale
+            };
+
+            layout->quads[layout->quads_count++] = (struct quad_data){
+                .type = QUAD_TYPE_TEXT,
+                .pos = {
+                    .x = pos_x + g->bearing.x * scale + glyph_size.x * 0.5f,
+                    .y = -(g->size.y - g->bearing.y) * scale + glyph_size.y * 0.5f,
+                },
+                .scale = glyph_size,
+                .rotation = 0.0f,
+                .data.text.tex = r->glyph_pages[g->page].tex,
+                .data.text.min = g->uv_min,
+                .data.text.size = g->uv_size,
+            };
+            layout->pages |= 1u << g->page;
         }
 
-        struct character *ch = &font->chars[index];
+        pos_x += g->advance * scale;
+    }
+
+    layout->width = pos_x;
+    /* after the walk, a page evicted for one of these glyphs held none of the others */
+    layout->glyph_generation = r->glyph_generation;
 
-        ch->size = (struct vec2i){face->glyph->bitmap.width, face->glyph->bitmap.rows};
-        ch->bearing = (struct vec2i){face->glyph->bitmap_left, face->glyph->bitmap_top};
-        ch->advance = face->glyph->advance.x >> 6;
+    return true;
+}
 
-        ch->u0 = (float)cell_x / *width;
-        ch->v0 = (float)cell_y / *height;
-        ch->u1 = (float)(cell_x + ch->size.x + 0.5f) / *width;
-        ch->v1 = (float)(cell_y + ch->size.y + 0.5f) / *height;
+static struct text_layout *layout_add(struct render_context *r, uint64_t hash, font_id font, float pixel_height,
+                                      const char *text) {
+    struct text_layout *layouts = grow(r->layouts, &r->layouts_capacity, r->layouts_count + 1,
+                                       sizeof(struct text_layout));
+    if (!layouts) {
+        return NULL;
+    }
+    r->layouts = layouts;
 
-        index++;
+    if ((r->layouts_count + 1) * 2 > r->layout_table_capacity) {
+        const size_t capacity = r->layout_table_capacity ? r->layout_table_capacity * 2 : 64;
+        uint32_t *table = realloc(r->layout_table, capacity * sizeof(uint32_t));
+        if (!table) {
+            fprintf(stderr, "out of memory!\n");
+            return NULL;
+        }
+        r->layout_table = table;
+        r->layout_table_capacity = capacity;
+        layout_table_fill(r);
     }
 
-    FT_Done_Face(face);
+    const size_t len = strlen(text);
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        fprintf(stderr, "out of memory!\n");
+        return NULL;
+    }
+    memcpy(copy, text, len + 1);
+
+    struct text_layout *layout = &r->layouts[r->layouts_count++];
+    *layout = (struct text_layout){
+        .hash = hash,
+        .font = font,
+        .pixel_height = pixel_height,
+        .text = copy,
+    };
+    layout_table_insert(r, r->layouts_count - 1);
 
-    return data;
+    return layout;
 }
 
-font_id renderer_load_font(struct render_context *r, const char *path, int font_size, struct vec2i char_range) {
-    if (r->fonts_count + 1 >= r->fonts_capacity) {
-        size_t new_cap = r->fonts_capacity *= 2;
-        struct font* new_data = realloc(r->fonts, new_cap * sizeof(struct font));
-        if (!new_data) {
-            fprintf(stderr, "failed pushing another element in font array!\n");
-            return -1;
+/* cached layout of a string, laid out again when new or when its glyphs moved */
+static const struct text_layout *layout_get(struct render_context *r, font_id font, float pixel_height,
+                                            const char *text) {
+    const uint64_t hash = layout_hash(font, pixel_height, text);
+
+    struct text_layout *layout = layout_find(r, hash, font, pixel_height, text);
+    if (layout && layout->complete && layout->glyph_generation == r->glyph_generation) {
+        /* keep the pages alive, the quads are about to be pushed */
+        for (int i = 0; i < r->glyph_pages_count; i++) {
+            if (layout->pages & (1u << i)) {
+                r->glyph_pages[i].last_used = r->frame;
+            }
         }
 
-        r->fonts_capacity = new_cap;
-        r->fonts = new_data;
+        layout->last_used = r->frame;
+        r->text_cache_hits++;
+        return layout;
     }
-    r->fonts_count++;
-    int font_index = r->fonts_count - 1;
-    r->fonts[font_index].font_size = font_size;
 
-    int width, height;
-    uint8_t* data = font_get_atlas(path, font_size, char_range, &width, &height, &r->fonts[font_index]);
-    if (!data) return -1;
+    if (!layout) {
+        layout = layout_add(r, hash, font, pixel_height, text);
+        if (!layout) {
+            return NULL;
+        }
+    }
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    r->text_cache_misses++;
+    layout->last_used = r->frame;
 
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    return layout_build(r, layout) ? layout : NULL;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+/* drops layouts that were not pushed for RENDERER_TEXT_CACHE_AGE frames */
+static void layouts_sweep(struct render_context *r) {
+    size_t kept = 0;
+    for (size_t i = 0; i < r->layouts_count; i++) {
+        struct text_layout *layout = &r->layouts[i];
+
+        if (r->frame - layout->last_used > RENDERER_TEXT_CACHE_AGE) {
+            free(layout->text);
+            free(layout->quads);
+            continue;
+        }
+
+        r->layouts[kept++] = *layout;
+    }
+
+    if (kept != r->layouts_count) {
+        r->layouts_count = kept;
+        layout_table_fill(r);
+    }
+}
+
+void renderer_push_text(struct render_context *r, struct vec2 pos, float pixel_height, struct color3 text_color,
+                        font_id font, const char *text, int anchor, int layer) {
+    if (font < 0 || (size_t)font >= r->fonts_count) {
+        return;
+    }
+
+    const struct text_layout *layout = layout_get(r, font, pixel_height, text);
+    if (!layout) {
+        return;
+    }
+
+    float pos_x = pos.x;
+    int baseline_y = pos.y;
+    
+    /* custom anchorin needed for font */
+    switch (anchor) {
+        case ANCHOR_TOP_LEFT:
+            baseline_y -= pixel_height;
+            break;
+
+        case ANCHOR_CENTER:
+            pos_x -= layout->width * 0.5f;
+            break;
+
+        /* default dont need to change anything */
+        case ANCHOR_BOTTOM_LEFT:
+        default:
+            break;
+    }
+
+    struct quad_data *quads = grow(r->quads, &r->quads_capacity, r->quads_count + layout->quads_count,
+                                   sizeof(struct quad_data));
+    if (!quads) {
+        return;
+    }
+    r->quads = quads;
+
+    for (size_t i = 0; i < layout->quads_count; i++) {
+        struct quad_data *data = &r->quads[r->quads_count++];
+
+        *data = layout->quads[i];
+        data->pos.x += pos_x;
+        data->pos.y += baseline_y;
+        data->data.text.color = text_color;
+        data->layer = layer;
+    }
+}
+
+/* which program draws a quad and the texture it samples, if any */
+static struct render_program *quad_program(struct render_context *r, const struct quad_data *data, GLuint *tex) {
+    switch (data->type) {
+        case QUAD_TYPE_TEXTURE:
+            if (!data->data.texture.tex) {
+                break;
+            }
+            *tex = data->data.texture.tex;
+            return &r->tex_program;
+
+        case QUAD_TYPE_TEXT:
+            *tex = data->data.text.tex;
+            return &r->text_program;
+
+        case QUAD_TYPE_RECT:
+        default:
+            break;
+    }
+
+    *tex = 0;
+    return &r->quad_program;
+}
+
+/* slot of `tex` in the run, -1 when the run has no free slot left */
+static int run_slot(struct quad_run *run, GLuint tex) {
+    for (int i = 0; i < run->textures_count; i++) {
+        if (run->textures[i] == tex) {
+            return i;
+        }
+    }
+
+    if (run->textures_count == RENDERER_TEXTURE_SLOTS) {
+        return -1;
+    }
+
+    run->textures[run->textures_count] = tex;
+    return run->textures_count++;
+}
+
+static int quad_layer(const struct quad_data *data) {
+    if (data->layer < RENDERER_LAYER_MIN) return RENDERER_LAYER_MIN;
+    if (data->layer > RENDERER_LAYER_MAX) return RENDERER_LAYER_MAX;
+    return data->layer;
+}
+
+static uint64_t quad_sort_key(struct render_context *r, const struct quad_data *data, uint32_t index) {
+    GLuint tex;
+    const struct render_program *program = quad_program(r, data, &tex);
+
+    const int layer = quad_layer(data);
+
+    return (uint64_t)(layer - RENDERER_LAYER_MIN) << 56
+         | (uint64_t)program->order << 54
+         | (uint64_t)(tex & 0x3fffff) << 32
+         | index;
+}
+
+/* lsd radix sort, stable. keys arrive in submission order so the low 32 bits
+   are already sorted and only the upper bytes need passes */
+static void sort_keys(struct quad_key *keys, struct quad_key *tmp, size_t n) {
+    struct quad_key *src = keys;
+    struct quad_key *dst = tmp;
+
+    for (int shift = 32; shift < 64; shift += 8) {
+        size_t counts[256] = {0};
+
+        for (size_t i = 0; i < n; i++) {
+            counts[(src[i].key >> shift) & 0xff]++;
+        }
+
+        /* every key has the same byte here, nothing would move */
+        if (counts[(src[0].key >> shift) & 0xff] == n) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            const size_t c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            dst[counts[(src[i].key >> shift) & 0xff]++] = src[i];
+        }
+
+        struct quad_key *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, n * sizeof(struct quad_key));
+    }
+}
+
+static bool build_keys(struct render_context *r) {
+    struct quad_key *keys = grow(r->keys, &r->keys_capacity, r->quads_count * 2, sizeof(struct quad_key));
+    if (!keys) {
+        return false;
+    }
+    r->keys = keys;
+
+    for (size_t i = 0; i < r->quads_count; i++) {
+        r->keys[i] = (struct quad_key){
+            .key = quad_sort_key(r, &r->quads[i], (uint32_t)i),
+            .index = (uint32_t)i,
+        };
+    }
+
+    sort_keys(r->keys, r->keys + r->quads_count, r->quads_count);
+
+    return true;
+}
+
+/* turns the sorted quad list into instances written to `out`, split into runs
+   wherever the layer or program changes or slots run out. layer splits let
+   retained layers be drawn in between */
+static bool build_runs(struct render_context *r, struct quad_instance *out) {
+    float *transform_in = grow(r->transform_in, &r->transform_in_capacity, r->quads_count * 5, sizeof(float));
+    if (!transform_in) {
+        return false;
+    }
+    r->transform_in = transform_in;
+
+    const size_t n = r->quads_count;
+    float *pos_x = transform_in;
+    float *pos_y = pos_x + n;
+    float *scale_x = pos_y + n;
+    float *scale_y = scale_x + n;
+    float *rotation = scale_y + n;
+
+    r->runs_count = 0;
+    struct quad_run *run = NULL;
+
+    for (size_t i = 0; i < r->quads_count; i++) {
+        const struct quad_data *data = &r->quads[r->keys[i].index];
+        struct quad_instance *inst = &out[i];
+
+        GLuint tex;
+        struct render_program *program = quad_program(r, data, &tex);
+        const int layer = quad_layer(data);
+
+        int slot = 0;
+        if (run && run->program == program && run->layer == layer && tex) {
+            slot = run_slot(run, tex);
+        }
+
+        if (!run || run->program != program || run->layer != layer || slot < 0) {
+            struct quad_run *runs = grow(r->runs, &r->runs_capacity, r->runs_count + 1, sizeof(struct quad_run));
+            if (!runs) {
+                return false;
+            }
+            r->runs = runs;
+
+            run = &r->runs[r->runs_count++];
+            run->program = program;
+            run->layer = layer;
+            run->first = i;
+            run->count = 0;
+            run->textures_count = 0;
+
+            slot = tex ? run_slot(run, tex) : 0;
+        }
+
+        run->count++;
+
+        pos_x[i] = data->pos.x;
+        pos_y[i] = data->pos.y;
+        scale_x[i] = data->scale.x;
+        scale_y[i] = data->scale.y;
+        rotation[i] = data->rotation;
+
+        inst->slot = slot;
+        inst->uv_min = (struct vec2){0.0f, 0.0f};
+        inst->uv_size = (struct vec2){1.0f, 1.0f};
+
+        switch (data->type) {
+            case QUAD_TYPE_TEXT:
+                inst->color = data->data.text.color;
+                inst->uv_min = data->data.text.min;
+                inst->uv_size = data->data.text.size;
+                break;
+
+            case QUAD_TYPE_TEXTURE:
+                inst->color = (struct color3){1.0f, 1.0f, 1.0f};
+                if (tex) {
+                    inst->uv_min = data->data.texture.min;
+                    inst->uv_size = data->data.texture.size;
+                }
+                break;
+
+            case QUAD_TYPE_RECT:
+            default:
+                inst->color = data->data.color;
+                break;
+        }
+    }
+
+    math_affine_batch(&out[0].transform, sizeof(struct quad_instance),
+                      pos_x, pos_y, scale_x, scale_y, rotation, n);
+
+    return true;
+}
+
+/* bounds of a unit quad after scale and rotation, without trig:
+   |cos| + |sin| <= sqrt(2) so rotated quads get a slightly larger box */
+static bool quad_visible(const struct quad_data *data, struct vec2 view_min, struct vec2 view_max) {
+    float hx = fabsf(data->scale.x) * 0.5f;
+    float hy = fabsf(data->scale.y) * 0.5f;
+
+    if (data->rotation != 0.0f) {
+        hx *= (float)M_SQRT2;
+        hy *= (float)M_SQRT2;
+    }
+
+    return data->pos.x + hx >= view_min.x && data->pos.x - hx <= view_max.x &&
+           data->pos.y + hy >= view_min.y && data->pos.y - hy <= view_max.y;
+}
+
+/* the screen view ignores the camera, for the ui layers */
+static void camera_view(const struct render_context *r, bool screen, struct vec2 *view_min, struct vec2 *view_max) {
+    const struct camera camera = screen ? (struct camera){{0.0f, 0.0f}, 1.0f} : r->camera;
+    const float half_w = (r->width / camera.zoom) * 0.5f;
+    const float half_h = (r->height / camera.zoom) * 0.5f;
+
+    *view_min = (struct vec2){camera.pos.x - half_w, camera.pos.y - half_h};
+    *view_max = (struct vec2){camera.pos.x + half_w, camera.pos.y + half_h};
+}
+
+/* drops quads outside the camera view, the rest keep their order */
+static void cull_quads(struct render_context *r) {
+    struct vec2 view_min, view_max, screen_min, screen_max;
+    camera_view(r, false, &view_min, &view_max);
+    camera_view(r, true, &screen_min, &screen_max);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < r->quads_count; i++) {
+        const bool screen = r->quads[i].layer >= RENDERER_LAYER_UI;
+        if (quad_visible(&r->quads[i], screen ? screen_min : view_min, screen ? screen_max : view_max)) {
+            r->quads[kept++] = r->quads[i];
+        }
+    }
+
+    r->stats.culled = r->quads_count - kept;
+    r->stats.quads = kept;
+    r->quads_count = kept;
+}
+
+void renderer_set_camera(struct render_context *r, struct vec2 pos, float zoom) {
+    r->camera.pos = pos;
+    if (zoom > 0.0f) {
+        r->camera.zoom = zoom;
+    }
+}
+
+static void retained_release(struct render_context *r, struct retained_layer *layer) {
+    for (int i = 0; i < r->glyph_pages_count; i++) {
+        if (layer->glyph_pages & (1u << i)) {
+            r->glyph_pages[i].pins--;
+        }
+    }
+
+    glDeleteBuffers(1, &layer->vbo);
+    free(layer->runs);
+    *layer = (struct retained_layer){0};
+}
+
+/* builds the quads recorded so far into `layer`, they are still in r->quads */
+static bool retained_build(struct render_context *r, struct retained_layer *layer) {
+    layer->quads_count = r->quads_count;
+    if (r->quads_count == 0) {
+        return true;
+    }
+
+    struct quad_instance *instances = malloc(r->quads_count * sizeof(struct quad_instance));
+    if (!instances) {
+        fprintf(stderr, "out of memory!\n");
+        return false;
+    }
+
+    if (!build_keys(r) || !build_runs(r, instances)) {
+        free(instances);
+        return false;
+    }
+
+    layer->runs = malloc(r->runs_count * sizeof(struct quad_run));
+    if (!layer->runs) {
+        fprintf(stderr, "out of memory!\n");
+        free(instances);
+        return false;
+    }
+    memcpy(layer->runs, r->runs, r->runs_count * sizeof(struct quad_run));
+    layer->runs_count = r->runs_count;
+
+    glGenBuffers(1, &layer->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, layer->vbo);
+    glBufferData(GL_ARRAY_BUFFER, r->quads_count * sizeof(struct quad_instance), instances, GL_STATIC_DRAW);
+    free(instances);
+
+    /* same conservative box as quad_visible */
+    layer->bounds_min = (struct vec2){INFINITY, INFINITY};
+    layer->bounds_max = (struct vec2){-INFINITY, -INFINITY};
+    for (size_t i = 0; i < r->quads_count; i++) {
+        const struct quad_data *data = &r->quads[i];
+        const float extent = data->rotation != 0.0f ? 0.5f * (float)M_SQRT2 : 0.5f;
+        const float hx = fabsf(data->scale.x) * extent;
+        const float hy = fabsf(data->scale.y) * extent;
+
+        layer->bounds_min.x = fminf(layer->bounds_min.x, data->pos.x - hx);
+        layer->bounds_min.y = fminf(layer->bounds_min.y, data->pos.y - hy);
+        layer->bounds_max.x = fmaxf(layer->bounds_max.x, data->pos.x + hx);
+        layer->bounds_max.y = fmaxf(layer->bounds_max.y, data->pos.y + hy);
+    }
+
+    /* glyph pages must outlive the layer's text, an evicted page would be refilled under it */
+    for (size_t i = 0; i < layer->runs_count; i++) {
+        const struct quad_run *run = &layer->runs[i];
+        if (run->program != &r->text_program) {
+            continue;
+        }
+
+        for (int t = 0; t < run->textures_count; t++) {
+            for (int p = 0; p < r->glyph_pages_count; p++) {
+                if (r->glyph_pages[p].tex == run->textures[t] && !(layer->glyph_pages & (1u << p))) {
+                    layer->glyph_pages |= 1u << p;
+                    r->glyph_pages[p].pins++;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool renderer_layer_begin(struct render_context *r, int id) {
+    if (r->recording) {
+        fprintf(stderr, "already recording a layer\n");
+        return false;
+    }
+
+    if (id >= 0 && ((size_t)id >= r->retained_count || !r->retained[id].used)) {
+        fprintf(stderr, "no layer with id %d\n", id);
+        return false;
+    }
+
+    r->recording_stash = r->quads;
+    r->recording_stash_count = r->quads_count;
+    r->recording_stash_capacity = r->quads_capacity;
+
+    r->quads = NULL;
+    r->quads_count = 0;
+    r->quads_capacity = 0;
+
+    r->recording = true;
+    r->recording_id = id;
+
+    return true;
+}
+
+int renderer_layer_end(struct render_context *r) {
+    if (!r->recording) {
+        fprintf(stderr, "no layer is recording\n");
+        return -1;
+    }
+
+    struct retained_layer layer = {.used = true};
+    const bool built = retained_build(r, &layer);
+
+    free(r->quads);
+    r->quads = r->recording_stash;
+    r->quads_count = r->recording_stash_count;
+    r->quads_capacity = r->recording_stash_capacity;
+    r->recording = false;
+
+    if (!built) {
+        retained_release(r, &layer);
+        return -1;
+    }
+
+    int id = r->recording_id;
+    if (id >= 0) {
+        retained_release(r, &r->retained[id]);
+    } else {
+        for (size_t i = 0; i < r->retained_count && id < 0; i++) {
+            if (!r->retained[i].used) {
+                id = (int)i;
+            }
+        }
+    }
+
+    if (id < 0) {
+        struct retained_layer *retained = grow(r->retained, &r->retained_capacity, r->retained_count + 1,
+                                               sizeof(struct retained_layer));
+        if (!retained) {
+            retained_release(r, &layer);
+            return -1;
+        }
+        r->retained = retained;
+        id = (int)r->retained_count++;
+    }
+
+    r->retained[id] = layer;
+
+    return id;
+}
+
+void renderer_layer_draw(struct render_context *r, int id, struct vec2 offset) {
+    if (id < 0 || (size_t)id >= r->retained_count || !r->retained[id].used) {
+        return;
+    }
+
+    struct retained_draw *draws = grow(r->retained_draws, &r->retained_draws_capacity, r->retained_draws_count + 1,
+                                       sizeof(struct retained_draw));
+    if (!draws) {
+        return;
+    }
+    r->retained_draws = draws;
+
+    r->retained_draws[r->retained_draws_count++] = (struct retained_draw){
+        .id = id,
+        .offset = offset,
+    };
+}
+
+void renderer_layer_free(struct render_context *r, int id) {
+    if (id < 0 || (size_t)id >= r->retained_count || !r->retained[id].used) {
+        return;
+    }
+
+    retained_release(r, &r->retained[id]);
+}
+
+static bool retained_visible(const struct retained_layer *layer, struct vec2 offset, struct vec2 view_min,
+                             struct vec2 view_max) {
+    return layer->bounds_max.x + offset.x >= view_min.x && layer->bounds_min.x + offset.x <= view_max.x &&
+           layer->bounds_max.y + offset.y >= view_min.y && layer->bounds_min.y + offset.y <= view_max.y;
+}
+
+/* culls whole layers, the visible ones count towards the drawn quads. a layer with both world
+   and ui runs is kept when either part of it could be seen */
+static void cull_retained(struct render_context *r) {
+    struct vec2 view_min, view_max, screen_min, screen_max;
+    camera_view(r, false, &view_min, &view_max);
+    camera_view(r, true, &screen_min, &screen_max);
+
+    for (size_t i = 0; i < r->retained_draws_count; i++) {
+        struct retained_draw *draw = &r->retained_draws[i];
+        const struct retained_layer *layer = &r->retained[draw->id];
+        bool world = false, screen = false;
+
+        for (size_t j = 0; j < layer->runs_count; j++) {
+            if (layer->runs[j].layer >= RENDERER_LAYER_UI) {
+                screen = true;
+            } else {
+                world = true;
+            }
+        }
+
+        draw->visible = (world && retained_visible(layer, draw->offset, view_min, view_max)) ||
+                        (screen && retained_visible(layer, draw->offset, screen_min, screen_max));
+
+        if (draw->visible) {
+            r->stats.quads += layer->quads_count;
+        } else {
+            r->stats.culled += layer->quads_count;
+        }
+    }
+}
+
+static void draw_run(struct render_context *r, const struct quad_run *run, size_t offset) {
+    for (int t = 0; t < run->textures_count; t++) {
+        state_bind_texture(r, t, run->textures[t]);
+    }
+
+    instance_attribs(offset, run->first);
+
+    if (run->program == &r->text_program) {
+        glDepthMask(GL_FALSE);
+    }
+
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, (GLsizei)run->count);
+    glDepthMask(GL_TRUE);
+    r->stats.draw_calls++;
+}
+
+/* draws the retained runs of layers `*next` to `up_to`, a layer at a time so they
+   interleave with the frame's runs. within a layer they go before the frame's quads */
+static void draw_retained(struct render_context *r, const struct matrix *cam_m, const struct matrix *screen_m,
+                          int *next, int up_to) {
+    while (*next <= up_to) {
+        int layer = up_to + 1;
+        for (size_t d = 0; d < r->retained_draws_count; d++) {
+            const struct retained_layer *retained = &r->retained[r->retained_draws[d].id];
+            for (size_t i = 0; i < retained->runs_count && r->retained_draws[d].visible; i++) {
+                const int run_layer = retained->runs[i].layer;
+                if (run_layer >= *next && run_layer < layer) {
+                    layer = run_layer;
+                }
+            }
+        }
+
+        if (layer > up_to) {
+            *next = up_to + 1;
+            return;
+        }
+
+        for (size_t d = 0; d < r->retained_draws_count; d++) {
+            const struct retained_draw *draw = &r->retained_draws[d];
+            const struct retained_layer *retained = &r->retained[draw->id];
+            if (!draw->visible) {
+                continue;
+            }
+
+            /* the offset goes into the projection, the instances stay as recorded */
+            struct matrix offset_m, proj;
+            math_matrix_translate(&offset_m, draw->offset.x, draw->offset.y, 0.0f);
+            math_matrix_mul(&proj, (struct matrix *)(layer >= RENDERER_LAYER_UI ? screen_m : cam_m), &offset_m);
+
+            glBindBuffer(GL_ARRAY_BUFFER, retained->vbo);
+
+            for (size_t i = 0; i < retained->runs_count; i++) {
+                const struct quad_run *run = &retained->runs[i];
+                if (run->layer != layer) {
+                    continue;
+                }
+
+                state_use_program(r, run->program);
+                glUniformMatrix4fv(run->program->u_proj, 1, GL_FALSE, proj.m);
+                run->program->proj_set = false;
+
+                draw_run(r, run, 0);
+            }
+        }
+
+        *next = layer + 1;
+    }
+}
+
+/* sorts the frame's quads and streams their instances, false leaves nothing to draw */
+static bool build_frame(struct render_context *r, size_t *offset) {
+    if (r->quads_count == 0 || !build_keys(r)) {
+        return false;
+    }
+
+    /* instances are built straight into the stream buffer */
+    struct quad_instance *instances = stream_map(r, &r->instance_stream,
+                                                 r->quads_count * sizeof(struct quad_instance), offset);
+    if (!instances) {
+        fprintf(stderr, "failed to map instance buffer\n");
+        return false;
+    }
+
+    const bool built = build_runs(r, instances);
+    stream_unmap(&r->instance_stream);
+
+    return built;
+}
+
+void renderer_draw(struct render_context *r) {
+    r->stats = (struct render_stats){0};
+
+    r->stats.glyphs_rasterized = r->glyphs_rasterized;
+    r->stats.glyph_evictions = r->glyph_evictions;
+    r->stats.text_cache_hits = r->text_cache_hits;
+    r->stats.text_cache_misses = r->text_cache_misses;
+    r->glyphs_rasterized = 0;
+    r->glyph_evictions = 0;
+    r->text_cache_hits = 0;
+    r->text_cache_misses = 0;
+
+    layouts_sweep(r);
+
+    glyph_pages_upload(r);
+    /* glyphs pushed from here on belong to the next frame */
+    r->frame++;
+
+    cull_quads(r);
+    cull_retained(r);
+
+    if (r->quads_count == 0 && r->retained_draws_count == 0) {
+        return;
+    }
+
+    state_reset(r);
+    glBindVertexArray(r->vao);
+
+    size_t offset = 0;
+    const bool streamed = build_frame(r, &offset);
+    if (!streamed) {
+        r->runs_count = 0;
+    }
+
+    struct matrix cam_m, screen_m;
+    math_matrix_get_orthographic(r, &cam_m);
+    math_matrix_get_screen_orthographic(r, &screen_m);
+
+    int next_retained = RENDERER_LAYER_MIN;
+    bool screen = false;
+
+    for (size_t i = 0; i < r->runs_count; i++) {
+        const struct quad_run *run = &r->runs[i];
+
+        if (next_retained <= run->layer) {
+            draw_retained(r, &cam_m, &screen_m, &next_retained, run->layer);
+            glBindBuffer(GL_ARRAY_BUFFER, r->instance_stream.vbo);
+        }
+
+        /* runs come sorted by layer, the projection switches once */
+        if (!screen && run->layer >= RENDERER_LAYER_UI) {
+            screen = true;
+            r->quad_program.proj_set = false;
+            r->tex_program.proj_set = false;
+            r->text_program.proj_set = false;
+        }
+
+        state_use_program(r, run->program);
+        state_proj(r, run->program, screen ? &screen_m : &cam_m);
+
+        draw_run(r, run, offset);
+    }
+
+    draw_retained(r, &cam_m, &screen_m, &next_retained, RENDERER_LAYER_MAX);
+
+    if (streamed) {
+        stream_end_frame(&r->instance_stream);
+    }
+
+    r->quads_count = 0;
+    r->retained_draws_count = 0;
+}
+
+static texture_id texture_add(struct render_context *r, struct texture_entry entry) {
+    struct texture_entry *textures = grow(r->textures, &r->textures_capacity, r->textures_count + 1,
+                                          sizeof(struct texture_entry));
+    if (!textures) {
+        return CORE_RENDERER_QUAD_NO_TEXTURE;
+    }
+    r->textures = textures;
+
+    r->textures[r->textures_count] = entry;
+    return (texture_id)r->textures_count++;
+}
+
+static GLuint texture_create(int width, int height, const uint8_t *pixels) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    return texture;
+}
+
+static struct atlas_page *atlas_page_add(struct render_context *r) {
+    struct atlas_page *pages = grow(r->atlas_pages, &r->atlas_pages_capacity, r->atlas_pages_count + 1,
+                                    sizeof(struct atlas_page));
+    if (!pages) {
+        return NULL;
+    }
+    r->atlas_pages = pages;
+
+    struct atlas_page *page = &r->atlas_pages[r->atlas_pages_count];
+    if (atlas_packer_init(&page->packer, RENDERER_ATLAS_SIZE, RENDERER_ATLAS_SIZE)) {
+        return NULL;
+    }
+
+    /* no mipmaps, they would bleed neighbouring images into each other */
+    page->tex = texture_create(RENDERER_ATLAS_SIZE, RENDERER_ATLAS_SIZE, NULL);
+    r->atlas_pages_count++;
+
+    return page;
+}
+
+/* copies the image with its edge pixels repeated into the padding around it */
+static uint8_t *atlas_extrude(const uint8_t *pixels, int width, int height) {
+    const int pad = RENDERER_ATLAS_PADDING;
+    const int out_w = width + pad * 2;
+    const int out_h = height + pad * 2;
+
+    uint8_t *out = malloc((size_t)out_w * out_h * 4);
+    if (!out) {
+        return NULL;
+    }
+
+    for (int y = 0; y < out_h; y++) {
+        int src_y = y - pad;
+        if (src_y < 0) src_y = 0;
+        if (src_y >= height) src_y = height - 1;
+
+        for (int x = 0; x < out_w; x++) {
+            int src_x = x - pad;
+            if (src_x < 0) src_x = 0;
+            if (src_x >= width) src_x = width - 1;
+
+            memcpy(&out[((size_t)y * out_w + x) * 4], &pixels[((size_t)src_y * width + src_x) * 4], 4);
+        }
+    }
+
+    return out;
+}
+
+/* packs into the newest page and opens a new one when that is full */
+static bool atlas_insert(struct render_context *r, const uint8_t *pixels, int width, int height,
+                         struct texture_entry *entry) {
+    const int pad = RENDERER_ATLAS_PADDING;
+    const int w = width + pad * 2;
+    const int h = height + pad * 2;
+
+    struct atlas_page *page = r->atlas_pages_count ? &r->atlas_pages[r->atlas_pages_count - 1] : NULL;
+    struct vec2i pos;
+
+    if (!page || !atlas_packer_pack(&page->packer, w, h, &pos)) {
+        page = atlas_page_add(r);
+        if (!page || !atlas_packer_pack(&page->packer, w, h, &pos)) {
+            return false;
+        }
+    }
+
+    uint8_t *extruded = atlas_extrude(pixels, width, height);
+    if (!extruded) {
+        fprintf(stderr, "out of memory!\n");
+        return false;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, page->tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, pos.x, pos.y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, extruded);
+    free(extruded);
 
-    free(data);
+    const float size = (float)RENDERER_ATLAS_SIZE;
+    entry->tex = page->tex;
+    entry->atlas = true;
+    entry->uv_min = (struct vec2){(pos.x + pad) / size, (pos.y + pad) / size};
+    entry->uv_size = (struct vec2){width / size, height / size};
 
-    r->fonts[font_index].tex = (texture_id)texture;
-    return (font_id)font_index;
+    return true;
 }
 
+texture_id renderer_create_texture(struct render_context *r, const uint8_t *pixels, int width, int height, bool atlas) {
+    if (width <= 0 || height <= 0) {
+        return CORE_RENDERER_QUAD_NO_TEXTURE;
+    }
+
+    struct texture_entry entry = {
+        .uv_min = {0.0f, 0.0f},
+        .uv_size = {1.0f, 1.0f},
+        .width = width,
+        .height = height,
+    };
+
+    if (!atlas || width > RENDERER_ATLAS_MAX_IMAGE || height > RENDERER_ATLAS_MAX_IMAGE ||
+        !atlas_insert(r, pixels, width, height, &entry)) {
+        entry.tex = texture_create(width, height, pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    return texture_add(r, entry);
+}
+
+texture_id renderer_load_texture(struct render_context *r, const char *path, bool atlas) {
+    stbi_set_flip_vertically_on_load(1);
+
+    int width, height, channels;
+    unsigned char *data = stbi_load(path, &width, &height, &channels, 4);
+    if (!data) {
+        fprintf(stderr, "failed to load texture: %s\n", path);
+        return CORE_RENDERER_QUAD_NO_TEXTURE;
+    }
+
+    const texture_id tex = renderer_create_texture(r, data, width, height, atlas);
+
+    stbi_image_free(data);
+
+    return tex;
+}
+
+font_id renderer_load_font(struct render_context *r, const char *path, int font_size) {
+    struct font *fonts = grow(r->fonts, &r->fonts_capacity, r->fonts_count + 1, sizeof(struct font));
+    if (!fonts) {
+        return -1;
+    }
+    r->fonts = fonts;
+
+    FT_Face face;
+
+    FT_Error error = FT_New_Face(r->ft_lib, path, 0, &face);
+    if (error == FT_Err_Unknown_File_Format) {
+        fprintf(stderr, "unkown format: %s\n", path);
+        return -1;
+    }
+    else if (error) {
+        fprintf(stderr, "faced unkown error when loading: %s\n", path);
+        return -1;
+    }
+
+    if (FT_Set_Pixel_Sizes(face, 0, font_size)) {
+        fprintf(stderr, "unsupported font size %d: %s\n", font_size, path);
+        FT_Done_Face(face);
+        return -1;
+    }
+
+    r->fonts[r->fonts_count] = (struct font){
+        .face = face,
+        .font_size = font_size,
+    };
+
+    return (font_id)r->fonts_count++;
+}
+
+void renderer_preload_glyphs(struct render_context *r, font_id font, struct vec2i range) {
+    if (font < 0 || (size_t)font >= r->fonts_count) {
+        return;
+    }
+
+    for (int c = range.x; c <= range.y; c++) {
+        glyph_get(r, font, (uint32_t)c);
+    }
+}
@@ -8,11 +8,41 @@
 #include FT_FREETYPE_H
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <math.h>
 
 #include "cmath.h"
+#include "atlas.h"
 
 #define CORE_RENDERER_QUAD_NO_TEXTURE (-1)
+/* textures bound at once per instanced draw, must match u_textures in the shaders */
+#define RENDERER_TEXTURE_SLOTS 8
+
+/* layers are drawn from lowest to highest, within a layer quads are grouped by
+   program (rects, textures, text) then texture, then kept in push order */
+#define RENDERER_LAYER_MIN (-128)
+#define RENDERER_LAYER_MAX 127
+#define RENDERER_LAYER_DEFAULT 0
+/* this layer and the ones above are in screen space, pixels around the screen center like
+   the mouse position. the camera neither moves nor zooms them */
+#define RENDERER_LAYER_UI 100
+
+/* loose textures are packed into pages this big */
+#define RENDERER_ATLAS_SIZE 2048
+/* images with a side larger than this get their own texture */
+#define RENDERER_ATLAS_MAX_IMAGE 512
+/* gutter around packed images, filled with their edge pixels against filtering bleed */
+#define RENDERER_ATLAS_PADDING 1
+
+/* sdf glyphs of all fonts share these pages, rasterized on first use */
+#define RENDERER_GLYPH_PAGE_SIZE 1024
+/* once this many pages are full the least recently used one is cleared for new glyphs,
+   at most 32 since text layouts keep a bit per page */
+#define RENDERER_GLYPH_PAGES 4
+#define RENDERER_GLYPH_PADDING 1
+
+/* laid out strings not pushed for this many frames are dropped from the cache */
+#define RENDERER_TEXT_CACHE_AGE 120
 
 struct color3 {
     float r;
@@ -20,6 +50,7 @@ struct color3 {
     float b;
 };
 
+/* index into render_context.textures */
 typedef GLint texture_id;
 typedef int font_id;
 
@@ -34,14 +65,17 @@ struct quad_data {
     
     union {   
         struct {
-            texture_id tex_id;
+            GLuint tex;
             struct vec2 min;
             struct vec2 size;
             struct color3 color;
         } text;
 
+        /* resolved from the texture_id at push time, tex is 0 for invalid ids */
         struct {
-            texture_id tex_id;
+            GLuint tex;
+            struct vec2 min;
+            struct vec2 size;
         } texture;
 
         struct color3 color;
@@ -50,13 +84,119 @@ struct quad_data {
     float rotation;
     struct vec2 scale;
     struct vec2 pos;
+    int layer;
+};
+
+/* layer(8) | program(2) | texture(22) | submission order(32) */
+struct quad_key {
+    uint64_t key;
+    uint32_t index;
+};
+
+/* per instance attributes streamed to the gpu, one per quad */
+struct quad_instance {
+    struct affine2d transform;
+    struct color3 color;
+    struct vec2 uv_min;
+    struct vec2 uv_size;
+    GLint slot;
+};
+
+/* a linked program and its uniform locations, resolved once in program_init */
+struct render_program {
+    GLuint id;
+    GLint u_proj;
+    GLint u_textures;
+    /* program field of the quad sort key */
+    uint32_t order;
+    /* projection already uploaded this frame */
+    bool proj_set;
+};
+
+/* gl state as last set by the renderer, reset every frame */
+struct render_state {
+    GLuint program;
+    GLenum active_unit;
+    GLuint textures[RENDERER_TEXTURE_SLOTS];
+};
+
+/* frames in flight for streamed vertex data */
+#define RENDER_STREAM_FRAMES 3
+/* smallest size class of a stream region, regions grow in powers of two from here */
+#define RENDER_STREAM_MIN_SIZE (64 * 1024)
+
+/* ring of RENDER_STREAM_FRAMES regions in one buffer, one region written per frame.
+   with gl 4.4 the buffer is persistently mapped and regions are guarded by fences,
+   on 3.3 regions are mapped unsynchronized and the buffer is orphaned on wrap around */
+struct render_stream_buffer {
+    GLuint vbo;
+    /* bytes per region */
+    size_t size;
+    /* region written this frame */
+    int frame;
+
+    bool persistent;
+    uint8_t *mapped;
+    GLsync fences[RENDER_STREAM_FRAMES];
 };
 
-struct character {
+/* per frame counters, valid after renderer_draw until the next one */
+struct render_stats {
+    /* quads drawn and quads dropped by the camera culling */
+    size_t quads;
+    size_t culled;
+    size_t draw_calls;
+    /* redundant calls the state tracker did not issue */
+    size_t program_skipped;
+    size_t texture_skipped;
+    size_t proj_skipped;
+    /* streamed to the gpu, and how often the cpu had to wait for a region */
+    size_t upload_bytes;
+    size_t fence_waits;
+    /* glyph cache misses, pages cleared to make room and bytes of dirty glyph rects uploaded */
+    size_t glyphs_rasterized;
+    size_t glyph_evictions;
+    size_t glyph_upload_bytes;
+    /* renderer_push_text calls that reused a cached layout and ones that laid out the string */
+    size_t text_cache_hits;
+    size_t text_cache_misses;
+};
+
+/* consecutive instances of one layer drawn with one program and one set of bound textures */
+struct quad_run {
+    struct render_program *program;
+    int layer;
+    size_t first;
+    size_t count;
+    GLuint textures[RENDERER_TEXTURE_SLOTS];
+    int textures_count;
+};
+
+struct glyph {
+    font_id font;
+    uint32_t codepoint;
+
     struct vec2i size;
     struct vec2i bearing;
-    uint32_t advance;
-    float u0, v0, u1, v1;
+    int advance;
+
+    struct vec2 uv_min;
+    struct vec2 uv_size;
+    int page; /* -1 for glyphs without pixels, like space */
+};
+
+struct glyph_page {
+    GLuint tex;
+    struct atlas_packer packer;
+
+    /* cpu copy of the page, the dirty rect is uploaded before the next draw */
+    uint8_t *pixels;
+    struct vec2i dirty_min;
+    struct vec2i dirty_max;
+    bool dirty;
+
+    uint32_t last_used; /* frame a glyph on this page was last pushed */
+    int pins; /* retained layers sampling this page, it is not evicted while they exist */
 };
 
 enum {
@@ -65,15 +205,66 @@ enum {
     ANCHOR_CENTER,
 };
 
+/* the glyph quads of a string at one font and size, relative to the start of
+   its baseline. color and layer are filled in when pushed */
+struct text_layout {
+    uint64_t hash;
+    font_id font;
+    float pixel_height;
+    char *text;
+
+    struct quad_data *quads;
+    size_t quads_count;
+    float width;
+
+    uint32_t pages; /* bit per glyph page the quads sample */
+    uint32_t glyph_generation; /* stale once a glyph page was evicted */
+    bool complete; /* false when a glyph found no room, laid out again next time */
+    uint32_t last_used;
+};
+
 struct font {
-    struct vec2i char_range; /* from this asci code to another all chars its tmp for more advanced loading */ 
-    struct character* chars; /* character data array as big as char_range.y - char_range.x */
-    texture_id tex;
-    int atlas_width;
-    int atlas_height;
+    FT_Face face; /* kept open, glyphs are rasterized when first pushed */
     int font_size;
 };
 
+/* where a texture_id lives, either a sub rectangle of an atlas page or a whole texture */
+struct texture_entry {
+    GLuint tex;
+    struct vec2 uv_min;
+    struct vec2 uv_size;
+    int width;
+    int height;
+    bool atlas;
+};
+
+struct atlas_page {
+    GLuint tex;
+    struct atlas_packer packer;
+};
+
+/* quads recorded once and kept in their own gpu buffer, replayed every frame
+   with renderer_layer_draw until recorded again or freed */
+struct retained_layer {
+    bool used;
+    GLuint vbo;
+    struct quad_run *runs;
+    size_t runs_count;
+    size_t quads_count;
+
+    /* around every quad, for culling the whole layer */
+    struct vec2 bounds_min;
+    struct vec2 bounds_max;
+
+    uint32_t glyph_pages; /* bit per glyph page pinned by this layer's text */
+};
+
+struct retained_draw {
+    int id;
+    struct vec2 offset;
+    bool visible;
+};
+
 struct camera {
     struct vec2 pos;
     float zoom;
@@ -85,23 +276,93 @@ struct render_context {
     GLFWwindow *window;
     struct camera camera;
 
+    /* Textures */
+    struct texture_entry *textures;
+    size_t textures_count;
+    size_t textures_capacity;
+
+    struct atlas_page *atlas_pages;
+    size_t atlas_pages_count;
+    size_t atlas_pages_capacity;
+
     /* Text */
     FT_Library ft_lib;
     struct font* fonts;
     size_t fonts_count;
     size_t fonts_capacity;
 
+    struct glyph *glyphs;
+    size_t glyphs_count;
+    size_t glyphs_capacity;
+
+    /* open addressing over (font, codepoint), holds glyph index + 1 and 0 for empty slots */
+    uint32_t *glyph_table;
+    size_t glyph_table_capacity;
+
+    struct glyph_page glyph_pages[RENDERER_GLYPH_PAGES];
+    int glyph_pages_count;
+
+    uint32_t glyph_generation;
+
+    struct text_layout *layouts;
+    size_t layouts_count;
+    size_t layouts_capacity;
+
+    /* same scheme as glyph_table, holds layout index + 1 */
+    uint32_t *layout_table;
+    size_t layout_table_capacity;
+
+    /* glyph and layout work happens while pushing, renderer_draw moves these into stats */
+    size_t glyphs_rasterized;
+    size_t glyph_evictions;
+    size_t text_cache_hits;
+    size_t text_cache_misses;
+
+    uint32_t frame;
+
     GLuint vao;
     GLuint vbo;
     GLuint ebo;
+    struct render_stream_buffer instance_stream;
+
+    struct render_program quad_program;
+    struct render_program tex_program;
+    struct render_program text_program;
 
-    GLuint quad_program;
-    GLuint tex_program;
-    GLuint text_program;
+    struct render_state state;
+    struct render_stats stats;
 
     struct quad_data *quads;
     size_t quads_count;
     size_t quads_capacity;
+
+    /* draw order, twice the quad count so the radix sort has scratch space */
+    struct quad_key *keys;
+    size_t keys_capacity;
+
+    /* pos x/y, scale x/y and rotation of the sorted quads, input of math_affine_batch */
+    float *transform_in;
+    size_t transform_in_capacity;
+
+    struct quad_run *runs;
+    size_t runs_count;
+    size_t runs_capacity;
+
+    /* Retained layers */
+    struct retained_layer *retained;
+    size_t retained_count;
+    size_t retained_capacity;
+
+    struct retained_draw *retained_draws;
+    size_t retained_draws_count;
+    size_t retained_draws_capacity;
+
+    /* while recording the pushed quads go to the layer, the frame's quads wait here */
+    bool recording;
+    int recording_id;
+    struct quad_data *recording_stash;
+    size_t recording_stash_count;
+    size_t recording_stash_capacity;
 };
 
 extern struct render_context render_context;
@@ -110,13 +371,33 @@ int renderer_init(struct render_context *r);
 void renderer_deinit(const struct render_context *r);
 
 void renderer_push_quad(struct render_context *r, struct quad_data data);
-void renderer_push_rect(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, struct color3 c, int anchor);
-void renderer_push_texture(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, texture_id texture, int anchor);
-void renderer_push_text(struct render_context *r, struct vec2 pos, float scale, struct color3 text_color, font_id font, const char* text, int anchor);
+void renderer_push_rect(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, struct color3 c, int anchor, int layer);
+void renderer_push_texture(struct render_context *r, struct vec2 pos, struct vec2 scale, float rotation, texture_id texture, int anchor, int layer);
+/* `text` is utf-8, glyphs missing from the cache are rasterized on the spot */
+void renderer_push_text(struct render_context *r, struct vec2 pos, float scale, struct color3 text_color, font_id font, const char* text, int anchor, int layer);
 
 void renderer_draw(struct render_context *r);
 
-texture_id renderer_load_texture(const char *path);
-font_id renderer_load_font(struct render_context *r, const char* path, int font_size, struct vec2i char_range);
+/* retained layers, for scenery that does not change between frames. everything pushed
+   between begin and end is recorded into the layer instead of the frame, end must come
+   before renderer_draw. `id` -1 records a new layer, otherwise replaces that one */
+bool renderer_layer_begin(struct render_context *r, int id);
+/* the recorded layer id, -1 on failure */
+int renderer_layer_end(struct render_context *r);
+/* draws the layer this frame moved by `offset`, sorted with the frame's quads by layer */
+void renderer_layer_draw(struct render_context *r, int id, struct vec2 offset);
+void renderer_layer_free(struct render_context *r, int id);
+
+/* `zoom` > 1 shows less of the world, ignored when <= 0 */
+void renderer_set_camera(struct render_context *r, struct vec2 pos, float zoom);
+
+/* `atlas` packs the image into a shared page so it batches with other textures,
+   images larger than RENDERER_ATLAS_MAX_IMAGE always get their own texture */
+texture_id renderer_load_texture(struct render_context *r, const char *path, bool atlas);
+/* `pixels` are rgba8, bottom row first */
+texture_id renderer_create_texture(struct render_context *r, const uint8_t *pixels, int width, int height, bool atlas);
+font_id renderer_load_font(struct render_context *r, const char* path, int font_size);
+/* rasterizes the codepoints from range.x to range.y now instead of when first pushed */
+void renderer_preload_glyphs(struct render_context *r, font_id font, struct vec2i range);
 
 #endif
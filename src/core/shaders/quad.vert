@@ -3,11 +3,17 @@
 layout (location = 0) in vec2 a_position;
 layout (location = 1) in vec2 a_texcoord;
 
-uniform mat4 u_model;
+/* per instance */
+layout (location = 2) in vec4 a_affine;      // columns (a, b) (c, d)
+layout (location = 3) in vec2 a_translate;
+layout (location = 4) in vec3 a_color;
+
 uniform mat4 u_proj;
 
 out vec3 out_color;
 
 void main() {
-    gl_Position = u_proj * u_model * vec4(a_position, 0.0, 1.0);
+    vec2 world = mat2(a_affine.xy, a_affine.zw) * a_position + a_translate;
+    gl_Position = u_proj * vec4(world, 0.0, 1.0);
+    out_color = a_color;
 } 
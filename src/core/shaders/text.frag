@@ -1,21 +1,33 @@
 #version 330 core
 
 in vec2 texcoord;
+in vec3 text_color;
+flat in int slot;
+
 out vec4 fragment_color;
 
-uniform sampler2D u_texture;
-uniform vec3 u_text_color;
+uniform sampler2D u_textures[8];
 
-uniform vec2 u_glyph_min;   // (u0, v0)
-uniform vec2 u_glyph_size;  // (u1-u0, v1-v0)
+/* glsl 330 only allows constant sampler indices */
+float sample_slot(int s, vec2 uv) {
+    switch (s) {
+        case 0: return texture(u_textures[0], uv).r;
+        case 1: return texture(u_textures[1], uv).r;
+        case 2: return texture(u_textures[2], uv).r;
+        case 3: return texture(u_textures[3], uv).r;
+        case 4: return texture(u_textures[4], uv).r;
+        case 5: return texture(u_textures[5], uv).r;
+        case 6: return texture(u_textures[6], uv).r;
+        default: return texture(u_textures[7], uv).r;
+    }
+}
 
 void main() {
-    vec2 atlasUV = u_glyph_min + vec2(texcoord.x, 1.0 - texcoord.y) * u_glyph_size;
-    float d = texture(u_texture, atlasUV).r;
+    float d = sample_slot(slot, texcoord);
 
     float aaf = fwidth(d);
     float alpha = smoothstep(0.5 - aaf, 0.5 + aaf, d);
 
-    fragment_color = vec4(u_text_color, alpha);
+    fragment_color = vec4(text_color, alpha);
 }
 
@@ -4,14 +4,24 @@
 layout (location = 0) in vec2 a_position;
 layout (location = 1) in vec2 a_texcoord;
 
-uniform mat4 u_model;
+/* per instance */
+layout (location = 2) in vec4 a_affine;      // columns (a, b) (c, d)
+layout (location = 3) in vec2 a_translate;
+layout (location = 4) in vec3 a_color;
+layout (location = 5) in vec4 a_uv_rect;   // (u0, v0, u1-u0, v1-v0)
+layout (location = 6) in int a_slot;
+
 uniform mat4 u_proj;
 
 out vec2 texcoord;
+out vec3 text_color;
+flat out int slot;
 
 void main() {
-    gl_Position = u_proj * u_model * vec4(a_position, 0.0, 1.0);
-    texcoord = a_texcoord;
+    vec2 world = mat2(a_affine.xy, a_affine.zw) * a_position + a_translate;
+    gl_Position = u_proj * vec4(world, 0.0, 1.0);
+    texcoord = a_uv_rect.xy + vec2(a_texcoord.x, 1.0 - a_texcoord.y) * a_uv_rect.zw;
+    text_color = a_color;
+    slot = a_slot;
 } 
 
-
@@ -2,13 +2,28 @@
 #version 330 core
 
 in vec2 texcoord;
+flat in int slot;
 
 out vec4 fragment_color;
 
-uniform sampler2D u_texture;
+uniform sampler2D u_textures[8];
+
+/* glsl 330 only allows constant sampler indices */
+vec4 sample_slot(int s, vec2 uv) {
+    switch (s) {
+        case 0: return texture(u_textures[0], uv);
+        case 1: return texture(u_textures[1], uv);
+        case 2: return texture(u_textures[2], uv);
+        case 3: return texture(u_textures[3], uv);
+        case 4: return texture(u_textures[4], uv);
+        case 5: return texture(u_textures[5], uv);
+        case 6: return texture(u_textures[6], uv);
+        default: return texture(u_textures[7], uv);
+    }
+}
 
 void main() {
-    vec4 tex_color = texture(u_texture, texcoord);
+    vec4 tex_color = sample_slot(slot, texcoord);
     fragment_color = vec4(tex_color.rgb * tex_color.a, tex_color.a);
     
     if (fragment_color.a <= 0.0) discard;
@@ -0,0 +1,237 @@
+#include "snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// worst case record: id gap, removed flag and every field changed by a full 32 bits
+#define RECORD_BYTES ((BITSTREAM_VAR_BITS + 31 + 1 + SNAPSHOT_FIELDS * (1 + BITSTREAM_VAR_BITS + 31) + 7) / 8)
+// tick, baseline and record count
+#define HEADER_BYTES 16
+
+// field deltas change sign, fold them so small negatives stay short
+static uint32_t zigzag(const uint32_t delta) {
+    return (delta << 1) ^ (0u - (delta >> 31));
+}
+
+static uint32_t unzigzag(const uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static bool reserve(struct snapshot *s, const uint32_t count) {
+    if (count <= s->cap) {
+        return true;
+    }
+
+    uint32_t cap = s->cap ? s->cap : 64;
+    while (cap < count) {
+        cap *= 2;
+    }
+
+    struct snapshot_entity *entities = realloc(s->entities, cap * sizeof(*entities));
+    if (!entities) {
+        return false;
+    }
+
+    s->entities = entities;
+    s->cap = cap;
+
+    return true;
+}
+
+void snapshot_history_deinit(struct snapshot_history *h) {
+    for (uint32_t i = 0; i < SNAPSHOT_HISTORY; i++) {
+        free(h->ticks[i].entities);
+        h->ticks[i] = (struct snapshot){0};
+    }
+}
+
+const struct snapshot *snapshot_find(const struct snapshot_history *h, const uint32_t tick) {
+    const struct snapshot *s = &h->ticks[tick & (SNAPSHOT_HISTORY - 1)];
+
+    return tick && s->tick == tick ? s : NULL;
+}
+
+struct snapshot *snapshot_begin(struct snapshot_history *h, const uint32_t tick) {
+    struct snapshot *s = &h->ticks[tick & (SNAPSHOT_HISTORY - 1)];
+    s->tick = tick;
+    s->count = 0;
+
+    return s;
+}
+
+bool snapshot_add(struct snapshot *s, const uint32_t id, const int32_t fields[SNAPSHOT_FIELDS]) {
+    if (!reserve(s, s->count + 1)) {
+        return false;
+    }
+
+    struct snapshot_entity *e = &s->entities[s->count++];
+    e->id = id;
+    memcpy(e->fields, fields, sizeof(e->fields));
+
+    return true;
+}
+
+static int entity_cmp(const void *a, const void *b) {
+    const uint32_t x = ((const struct snapshot_entity *) a)->id;
+    const uint32_t y = ((const struct snapshot_entity *) b)->id;
+
+    return (x > y) - (x < y);
+}
+
+void snapshot_end(struct snapshot *s) {
+    // an empty tick has no array yet
+    if (s->count < 2) {
+        return;
+    }
+
+    qsort(s->entities, s->count, sizeof(*s->entities), entity_cmp);
+}
+
+uint32_t snapshot_bound(const struct snapshot *baseline, const struct snapshot *s) {
+    return HEADER_BYTES + RECORD_BYTES * ((baseline ? baseline->count : 0) + s->count);
+}
+
+// one record per entity that appeared, changed or went away, in id order. counts them when `w` is NULL
+static uint32_t delta_records(const struct snapshot *baseline, const struct snapshot *s, struct bitstream *w) {
+    static const struct snapshot_entity none = {0};
+    const uint32_t base_count = baseline ? baseline->count : 0;
+    uint32_t records = 0;
+    uint32_t next = 0;
+    uint32_t b = 0;
+    uint32_t i = 0;
+
+    while (b < base_count || i < s->count) {
+        const struct snapshot_entity *old = b < base_count ? &baseline->entities[b] : NULL;
+        const struct snapshot_entity *cur = i < s->count ? &s->entities[i] : NULL;
+
+        if (old && (!cur || old->id < cur->id)) {
+            records++;
+            if (w) {
+                bitstream_write_var(w, old->id - next);
+                bitstream_write(w, 1, 1);
+            }
+            next = old->id + 1;
+            b++;
+            continue;
+        }
+
+        if (old && old->id == cur->id) {
+            b++;
+        } else {
+            old = &none;
+        }
+        i++;
+
+        if (old != &none && !memcmp(old->fields, cur->fields, sizeof(cur->fields))) {
+            continue;
+        }
+
+        records++;
+        if (w) {
+            bitstream_write_var(w, cur->id - next);
+            bitstream_write(w, 0, 1);
+
+            for (int f = 0; f < SNAPSHOT_FIELDS; f++) {
+                const uint32_t delta = (uint32_t) cur->fields[f] - (uint32_t) old->fields[f];
+
+                bitstream_write(w, delta != 0, 1);
+                if (delta) {
+                    bitstream_write_var(w, zigzag(delta));
+                }
+            }
+        }
+        next = cur->id + 1;
+    }
+
+    return records;
+}
+
+bool snapshot_encode(const struct snapshot *baseline, const struct snapshot *s, struct bitstream *w) {
+    // the decoder only looks that far back
+    if (baseline && (s->tick - baseline->tick == 0 || s->tick - baseline->tick >= SNAPSHOT_HISTORY)) {
+        baseline = NULL;
+    }
+
+    bitstream_write(w, s->tick, 32);
+    bitstream_write(w, baseline != NULL, 1);
+    if (baseline) {
+        bitstream_write(w, s->tick - baseline->tick, SNAPSHOT_HISTORY_BITS);
+    }
+
+    bitstream_write_var(w, delta_records(baseline, s, NULL));
+    delta_records(baseline, s, w);
+
+    return !w->error;
+}
+
+uint32_t snapshot_decode(struct snapshot_history *h, struct bitstream *r) {
+    const uint32_t tick = bitstream_read(r, 32);
+    const struct snapshot *base = NULL;
+
+    if (bitstream_read(r, 1)) {
+        const uint32_t back = bitstream_read(r, SNAPSHOT_HISTORY_BITS);
+        base = back ? snapshot_find(h, tick - back) : NULL;
+        if (!base) {
+            return 0;
+        }
+    }
+
+    const uint32_t records = bitstream_read_var(r);
+    const uint32_t base_count = base ? base->count : 0;
+    // every record takes at least 7 bits, anything claiming more is garbage
+    if (r->error || !tick || records > bitstream_remaining(r) / 7) {
+        return 0;
+    }
+
+    struct snapshot *out = snapshot_begin(h, tick);
+    out->tick = 0;
+    if (!reserve(out, base_count + records)) {
+        return 0;
+    }
+
+    uint64_t next = 0;
+    uint32_t b = 0;
+
+    for (uint32_t i = 0; i < records && !r->error; i++) {
+        const uint64_t id = next + bitstream_read_var(r);
+        if (id > UINT32_MAX) {
+            return 0;
+        }
+
+        while (b < base_count && base->entities[b].id < id) {
+            out->entities[out->count++] = base->entities[b++];
+        }
+
+        const struct snapshot_entity *old = b < base_count && base->entities[b].id == id ? &base->entities[b++] : NULL;
+        next = id + 1;
+
+        if (bitstream_read(r, 1)) {
+            // removed, it has to have been there
+            if (!old) {
+                return 0;
+            }
+            continue;
+        }
+
+        struct snapshot_entity *e = &out->entities[out->count++];
+        e->id = (uint32_t) id;
+
+        for (int f = 0; f < SNAPSHOT_FIELDS; f++) {
+            const uint32_t value = old ? (uint32_t) old->fields[f] : 0;
+            e->fields[f] = (int32_t) (bitstream_read(r, 1) ? value + unzigzag(bitstream_read_var(r)) : value);
+        }
+    }
+
+    while (b < base_count) {
+        out->entities[out->count++] = base->entities[b++];
+    }
+
+    if (r->error) {
+        out->count = 0;
+        return 0;
+    }
+
+    out->tick = tick;
+
+    return tick;
+}
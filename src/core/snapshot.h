@@ -0,0 +1,61 @@
+// world snapshots the server takes every tick, sent to each client as a delta against the last tick
+// that client acknowledged. entities and fields that did not change since then cost nothing, no net in here
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitstream.h"
+
+// quantized fields per entity, unused ones stay 0
+#define SNAPSHOT_FIELDS 4
+// ticks kept to delta against, older acks get a full snapshot
+#define SNAPSHOT_HISTORY_BITS 5
+#define SNAPSHOT_HISTORY (1u << SNAPSHOT_HISTORY_BITS)
+
+struct snapshot_entity {
+    uint32_t id;
+    int32_t fields[SNAPSHOT_FIELDS];
+};
+
+struct snapshot {
+    // 0 while the slot holds nothing, ticks count up from 1
+    uint32_t tick;
+    // sorted by id once snapshot_end ran
+    struct snapshot_entity *entities;
+    uint32_t count;
+    uint32_t cap;
+};
+
+// the server's recent ticks, or on a client the ones it decoded, slot tick % SNAPSHOT_HISTORY
+struct snapshot_history {
+    struct snapshot ticks[SNAPSHOT_HISTORY];
+};
+
+void snapshot_history_deinit(struct snapshot_history *h);
+
+// NULL once that tick is no longer held
+const struct snapshot *snapshot_find(const struct snapshot_history *h, uint32_t tick);
+
+// empties the slot of `tick` for snapshot_add, whatever it held is gone
+struct snapshot *snapshot_begin(struct snapshot_history *h, uint32_t tick);
+
+// false when out of memory, ids come in any order but only once per tick
+bool snapshot_add(struct snapshot *s, uint32_t id, const int32_t fields[SNAPSHOT_FIELDS]);
+
+// sorts the entities, call it before the first encode
+void snapshot_end(struct snapshot *s);
+
+// bytes snapshot_encode may need for `s` against `baseline`
+uint32_t snapshot_bound(const struct snapshot *baseline, const struct snapshot *s);
+
+// appends `s` as changes from `baseline`, or in full when baseline is NULL or not one of the
+// SNAPSHOT_HISTORY ticks before `s`. false if the stream ran out of room
+bool snapshot_encode(const struct snapshot *baseline, const struct snapshot *s, struct bitstream *w);
+
+// reads an encoded snapshot, applies it to the baseline it names and stores the result in `h`.
+// returns its tick, 0 when the baseline is no longer held or the data is malformed
+uint32_t snapshot_decode(struct snapshot_history *h, struct bitstream *r);
+
+#endif // SNAPSHOT_H
@@ -1,9 +1,12 @@
 local client = nil
 local physics = require('physics')
+local protocol = require('protocol')
 
 local local_id = nil
 local local_nickname = os.getenv("SAUSAGES_NICKNAME") or "Player"
 local players = {}
+-- what the server last sent of everyone's position
+local world = core.snapshot.new()
 
 local platform = { x = 0.0, y = -0.5, w = 800, h = 100 }
 
@@ -23,33 +26,22 @@ local function new_player(nickname)
     }
 end
 
-local function serialize_position(player)
-    return string.format("pos:%.4f,%.4f", player.x, player.y)
-end
-
-local function deserialize_message(data)
-    local id, msg_type, payload = data:match("^(%d+):(%w+):(.+)$")
-    if not id then
-        id, msg_type = data:match("^(%d+):(%w+):?$")
-        if not id then return nil end
-    end
-
-    id = tonumber(id)
-
-    if msg_type == "pos" then
-        local x, y = payload:match("^([^,]+),(.+)$")
-        return id, "pos", tonumber(x), tonumber(y)
-    elseif msg_type == "nickname" then
-        return id, "nickname", payload
-    elseif msg_type == "left" then
-        return id, "left", nil
-    end
-
-    return nil
-end
+-- reused for every message, sends copy out of them
+local writer = core.bitstream.writer()
+local reader = core.bitstream.reader()
+-- decoded messages land here, each one overwrites the fields it has
+local msg = {}
+-- outgoing messages, filled in before every send
+local pos = {}
+local ack = {}
 
 local image = core.load_texture("../test.png")
-local font = core.load_font("../AdwaitaSans-Regular.ttf", 48, {32, 128})
+local font = core.load_font("../AdwaitaSans-Regular.ttf", 48)
+
+-- the platform never moves, record it once and replay it every frame
+core.layer_begin()
+core.push_rect({platform.x, platform.y}, {platform.w, platform.h}, {0.3, 0.7, 0.3})
+local scenery = core.layer_end()
 
 function game_init()
     local ip = os.getenv("SAUSAGES_IP") or "127.0.0.1"
@@ -59,39 +51,54 @@ end
 
 local tick_rate = 1.0 / 120.0
 local accumulator = 0.0
+-- positions go out at a fixed rate instead of once per rendered frame
+local send_rate = 1.0 / 30.0
+local send_accumulator = 0.0
 
 function game_update(delta_time)
-    local ev = client:poll()
-    while ev do
-        if ev.type == core.net_event.connect then
-            local_id = ev.id
+    for event, client_id in client:events(reader) do
+        if event == core.net_event.connect then
+            local_id = client_id
             players[local_id] = new_player(local_nickname)
-            client:send("nickname:" .. local_nickname)
-        elseif ev.type == core.net_event.disconnect then
+            local nickname = { nickname = local_nickname }
+            client:send(protocol.write(writer, protocol.to_server, protocol.nickname, nickname), "reliable")
+        elseif event == core.net_event.disconnect then
             core.print("disconnected")
             local_id = nil
-        elseif ev.type == core.net_event.data then
-            local id, msg_type, a, b = deserialize_message(ev.data)
-
-            if id and id ~= local_id then
-                if msg_type == "pos" then
-                    if not players[id] then
-                        players[id] = new_player()
+        elseif event == core.net_event.data then
+            local msg_type, fields = protocol.read(reader, protocol.to_client, msg)
+
+            if msg_type == protocol.snapshot then
+                local tick = world:decode(reader)
+
+                -- a world too big for a sequenced message comes fragmented, an older one may arrive late
+                if tick and tick > (ack.tick or 0) then
+                    -- its own channel, a late ack must not make the server drop a newer position
+                    ack.tick = tick
+                    client:send(protocol.write(writer, protocol.to_server, protocol.ack, ack), "sequenced", 1)
+
+                    for id, x, y in world:entities(tick) do
+                        if id ~= local_id then
+                            if not players[id] then
+                                players[id] = new_player()
+                            end
+                            players[id].x = x
+                            players[id].y = y
+                        end
                     end
-                    players[id].x = a
-                    players[id].y = b
-                elseif msg_type == "nickname" then
-                    if not players[id] then
-                        players[id] = new_player(a)
-                    else
-                        players[id].nickname = a
-                    end
-                elseif msg_type == "left" then
-                    players[id] = nil
                 end
+            elseif not fields or fields.id == local_id then
+                -- malformed, or news about ourselves
+            elseif msg_type == protocol.nickname then
+                if not players[fields.id] then
+                    players[fields.id] = new_player(fields.nickname)
+                else
+                    players[fields.id].nickname = fields.nickname
+                end
+            elseif msg_type == protocol.left then
+                players[fields.id] = nil
             end
         end
-        ev = client:poll()
     end
 
     local local_player = players[local_id]
@@ -131,9 +138,17 @@ function game_update(delta_time)
         end
     end
 
-    client:send(serialize_position(local_player))
+    send_accumulator = send_accumulator + delta_time
+    if send_accumulator >= send_rate then
+        send_accumulator = send_accumulator % send_rate
+        -- a late position is worthless once a newer one arrived
+        pos.x = local_player.x
+        pos.y = local_player.y
+        client:send(protocol.write(writer, protocol.to_server, protocol.pos, pos), "sequenced")
+    end
+    client:flush()
 
-    core.push_rect({platform.x, platform.y}, {platform.w, platform.h}, {0.3, 0.7, 0.3})
+    core.layer_draw(scenery)
     for id, player in pairs(players) do
         core.push_texture({player.x, player.y}, {player_w, player_h}, image)
         core.push_text_ex(font, player.nickname, {player.x, player.y + 10}, 25, {1.0, 1.0, 1.0}, core.anchor.center)
@@ -0,0 +1,65 @@
+-- message layouts shared by client and server, every message starts with its type
+local protocol = {}
+
+protocol.type_bits = 3
+
+protocol.nickname = 0
+protocol.left = 1
+protocol.pos = 2
+protocol.ack = 3
+-- a core.snapshot follows the type, the positions of everyone
+protocol.snapshot = 4
+
+-- positions travel as quantized floats, steps of 1/128 of a pixel
+local coord = { "float", -4096.0, 4096.0, 20 }
+
+local function field(name, layout)
+    return { name, unpack(layout) }
+end
+
+-- what clients send, by type
+protocol.to_server = {
+    [protocol.nickname] = core.schema.new({
+        { "nickname", "string" },
+    }),
+    [protocol.pos] = core.schema.new({
+        field("x", coord),
+        field("y", coord),
+    }),
+    -- the tick of the last snapshot the client decoded
+    [protocol.ack] = core.schema.new({
+        { "tick", "varint" },
+    }),
+}
+
+-- what the server sends, by type
+protocol.to_client = {
+    [protocol.nickname] = core.schema.new({
+        { "id", "varint" },
+        { "nickname", "string" },
+    }),
+    [protocol.left] = core.schema.new({
+        { "id", "varint" },
+    }),
+}
+
+-- the type then the fields of `msg`, in the shared writer
+function protocol.write(writer, layouts, msg_type, msg)
+    return layouts[msg_type]:encode(writer:reset():uint(msg_type, protocol.type_bits), msg)
+end
+
+-- the type and the fields decoded into `msg`, `reader` is on the message as events(reader) hands it out.
+-- the fields are nil for a malformed message or a type without a layout, the reader is left right after
+-- the type for those
+function protocol.read(reader, layouts, msg)
+    local msg_type = reader:uint(protocol.type_bits)
+    local layout = layouts[msg_type]
+
+    if not layout then
+        return msg_type, nil
+    end
+
+    return msg_type, layout:decode(reader, msg)
+end
+
+return protocol
@@ -1,43 +1,141 @@
+local protocol = require('protocol')
+
 local server = nil
-local clients = {}  -- { [id] = { nickname = "name" } }
+local clients = {}  -- { [id] = { nickname = "name", x = 0, y = 0, acked = tick } }
+
+-- every player's position, sent to each client as changes since the tick it last acked
+local world = core.snapshot.new()
+local snapshot_rate = 1.0 / 30.0
+local snapshot_accumulator = 0.0
+
+-- SAUSAGES_NET_STATS names a file that gets every peer's traffic counters appended to it
+local stats_path = os.getenv("SAUSAGES_NET_STATS")
+local stats_rate = 10.0
+local stats_accumulator = 0.0
+local stats_fields = {
+    "packets_in", "bytes_in", "packets_out", "bytes_out", "retransmits", "duplicates", "out_of_order",
+    "sequenced_dropped", "send_dropped", "fragments_dropped", "srtt", "rttvar", "send_queue",
+}
+
+-- reused for every message, sends copy out of them
+local writer = core.bitstream.writer()
+local reader = core.bitstream.reader()
+
+-- decoded messages land here, each one overwrites the fields it has
+local msg = {}
+
+-- one line per peer and one for the totals, "<time> <id or all> name=value ..."
+local function write_stats()
+    local file = io.open(stats_path, "a")
+    if not file then
+        core.print("could not open " .. stats_path)
+        stats_path = nil
+        return
+    end
+
+    local function line(who, stats)
+        local parts = { os.time(), who }
+        for _, name in ipairs(stats_fields) do
+            table.insert(parts, name .. "=" .. stats[name])
+        end
+        file:write(table.concat(parts, " "), "\n")
+    end
+
+    line("all", server:stats())
+    for id in pairs(clients) do
+        local stats = server:stats(id)
+        if stats then
+            line(id, stats)
+        end
+    end
+
+    file:close()
+end
 
 function game_init()
     server = core.server.new(os.getenv("SAUSAGES_IP") or "127.0.0.1", 7777, 32)
+    if os.getenv("SAUSAGES_NET_THREAD") and not server:start_thread() then
+        core.print("network thread failed to start, polling the socket directly")
+    end
     core.print("server listening on 7777")
 end
 
 function game_update(dt)
-    local ev = server:poll()
-    while ev do
-        if ev.type == core.net_event.connect then
-            clients[ev.id] = { nickname = "Player" .. ev.id }
-            core.print(ev.id .. " joined the game")
-
-            for id, client in pairs(clients) do
-                if id ~= ev.id then
-                    server:send(ev.id, id .. ":nickname:" .. client.nickname)
+    for event, id in server:events(reader) do
+        if event == core.net_event.connect then
+            clients[id] = { nickname = "Player" .. id, acked = 0 }
+            core.print(id .. " joined the game")
+
+            for other, client in pairs(clients) do
+                if other ~= id then
+                    local nickname = { id = other, nickname = client.nickname }
+                    server:send(id, protocol.write(writer, protocol.to_client, protocol.nickname, nickname), "reliable")
                 end
             end
 
-        elseif ev.type == core.net_event.disconnect then
-            core.print(clients[ev.id].nickname .. " left the game")
-            server:broadcast(ev.id .. ":left:")
-            clients[ev.id] = nil
-        elseif ev.type == core.net_event.data then
-            local msg_type, payload = ev.data:match("^(%w+):(.+)$")
-
-            if msg_type == "nickname" then
-                clients[ev.id].nickname = payload
-                core.print(ev.id .. " set nickname to " .. payload)
-                server:broadcast(ev.id .. ":nickname:" .. payload)
-            elseif msg_type == "pos" then
-                for id, _ in pairs(clients) do
-                    server:send(id, ev.id .. ":pos:" .. payload)
-                end
+        elseif event == core.net_event.disconnect then
+            core.print(clients[id].nickname .. " left the game")
+            server:broadcast(protocol.write(writer, protocol.to_client, protocol.left, { id = id }), "reliable")
+            clients[id] = nil
+        elseif event == core.net_event.data then
+            local msg_type, fields = protocol.read(reader, protocol.to_server, msg)
+
+            if not fields then
+                -- malformed or of a type clients do not send
+            elseif msg_type == protocol.nickname then
+                clients[id].nickname = fields.nickname
+                core.print(id .. " set nickname to " .. fields.nickname)
+
+                local nickname = { id = id, nickname = fields.nickname }
+                server:broadcast(protocol.write(writer, protocol.to_client, protocol.nickname, nickname), "reliable")
+            elseif msg_type == protocol.pos then
+                clients[id].x = fields.x
+                clients[id].y = fields.y
+            elseif msg_type == protocol.ack then
+                clients[id].acked = math.max(clients[id].acked, fields.tick)
             end
         end
-        ev = server:poll()
     end
+
+    snapshot_accumulator = snapshot_accumulator + dt
+    if snapshot_accumulator >= snapshot_rate then
+        snapshot_accumulator = snapshot_accumulator % snapshot_rate
+
+        world:begin()
+        for id, client in pairs(clients) do
+            if client.x and client.y then
+                world:add(id, client.x, client.y)
+            end
+        end
+
+        -- clients that acked the same tick get the same bytes, encoded once
+        local acked = {}
+        for id, client in pairs(clients) do
+            acked[client.acked] = acked[client.acked] or {}
+            table.insert(acked[client.acked], id)
+        end
+
+        for tick, ids in pairs(acked) do
+            world:encode(writer:reset():uint(protocol.snapshot, protocol.type_bits), tick)
+
+            -- sequenced ones fit in a datagram, a bigger world goes out fragmented and may arrive out of order
+            local mode = writer:bytes() <= core.net_sequenced_payload and "sequenced" or "unreliable"
+            for _, id in ipairs(ids) do
+                server:send(id, writer, mode)
+            end
+        end
+    end
+
+    if stats_path then
+        stats_accumulator = stats_accumulator + dt
+        if stats_accumulator >= stats_rate then
+            stats_accumulator = stats_accumulator % stats_rate
+            write_stats()
+        end
+    end
+
+    -- sends are queued and leave in batches
+    server:flush()
 end
 
 function game_quit()
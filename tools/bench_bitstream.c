@@ -0,0 +1,187 @@
+/*
+ * message encode / decode benchmark, the position message as text against the bitstream, both through luajit
+ *
+ * usage:  bench_bitstream [messages]
+ *
+ * needs sausages.arc in the working directory, protocol.lua is required from it like the game does
+ *
+ * the text path is the script code from before core.bitstream: string.format into a fresh string,
+ * then the pattern match and tonumber per field the server ran on every message
+ *
+ * the bitstream path is the game's current one: protocol.write through the schema into a reused writer,
+ * protocol.read back out of a reader. the reader is reset onto the writer, the events loop hands it the
+ * received bytes the same way
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <luajit-2.1/lauxlib.h>
+#include <luajit-2.1/lua.h>
+#include <luajit-2.1/lualib.h>
+
+#include "../src/core/lua_api.h"
+
+#define BENCH_ROUNDS 10
+
+/* the same positions for both paths, `n` is set from C */
+static const char *bench_setup =
+    "protocol = require('protocol')\n"
+    "xs, ys = {}, {}\n"
+    "math.randomseed(1)\n"
+    "for i = 1, n do\n"
+    "    xs[i] = math.random(0, 159999) / 100 - 800\n"
+    "    ys[i] = math.random(0, 109999) / 100 - 1000\n"
+    "end\n";
+
+/* src/game/client.lua and server.lua before core.bitstream */
+static const char *bench_text =
+    "local function serialize_position(player)\n"
+    "    return string.format('pos:%.4f,%.4f', player.x, player.y)\n"
+    "end\n"
+    "\n"
+    "local player = {}\n"
+    "\n"
+    "function text_encode(rounds)\n"
+    "    local bytes = 0\n"
+    "    for r = 1, rounds do\n"
+    "        for i = 1, n do\n"
+    "            player.x, player.y = xs[i], ys[i]\n"
+    "            bytes = bytes + #serialize_position(player)\n"
+    "        end\n"
+    "    end\n"
+    "    return bytes\n"
+    "end\n"
+    "\n"
+    "function text_round_trip(rounds)\n"
+    "    local sink = 0\n"
+    "    for r = 1, rounds do\n"
+    "        for i = 1, n do\n"
+    "            player.x, player.y = xs[i], ys[i]\n"
+    "            local data = serialize_position(player)\n"
+    "            local msg_type, payload = data:match('^(%w+):(.+)$')\n"
+    "            if msg_type == 'pos' then\n"
+    "                local x, y = payload:match('^([^,]+),(.+)$')\n"
+    "                sink = sink + tonumber(x) + tonumber(y)\n"
+    "            end\n"
+    "        end\n"
+    "    end\n"
+    "    return sink\n"
+    "end\n";
+
+/* src/game/client.lua and server.lua now */
+static const char *bench_bits =
+    "local writer = core.bitstream.writer()\n"
+    "local reader = core.bitstream.reader()\n"
+    "local pos = {}\n"
+    "local msg = {}\n"
+    "max_error = 0\n"
+    "\n"
+    "function bits_encode(rounds)\n"
+    "    local bytes = 0\n"
+    "    for r = 1, rounds do\n"
+    "        for i = 1, n do\n"
+    "            pos.x, pos.y = xs[i], ys[i]\n"
+    "            bytes = bytes + protocol.write(writer, protocol.to_server, protocol.pos, pos):bytes()\n"
+    "        end\n"
+    "    end\n"
+    "    return bytes\n"
+    "end\n"
+    "\n"
+    "function bits_round_trip(rounds)\n"
+    "    local sink = 0\n"
+    "    for r = 1, rounds do\n"
+    "        for i = 1, n do\n"
+    "            pos.x, pos.y = xs[i], ys[i]\n"
+    "            protocol.write(writer, protocol.to_server, protocol.pos, pos)\n"
+    "            local msg_type, fields = protocol.read(reader:reset(writer), protocol.to_server, msg)\n"
+    "            if msg_type == protocol.pos and fields then\n"
+    "                sink = sink + fields.x + fields.y\n"
+    "                if r == 1 then\n"
+    "                    max_error = math.max(max_error, math.abs(fields.x - xs[i]), math.abs(fields.y - ys[i]))\n"
+    "                end\n"
+    "            end\n"
+    "        end\n"
+    "    end\n"
+    "    return sink\n"
+    "end\n";
+
+static double bench_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static int run(lua_State *L, const char *chunk) {
+    if (luaL_dostring(L, chunk) != 0) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/* calls the global `name` with BENCH_ROUNDS and reports its time, the result is the bytes written or a sink */
+static int bench(lua_State *L, const char *name, const size_t n, double *result) {
+    lua_getglobal(L, name);
+    lua_pushinteger(L, BENCH_ROUNDS);
+
+    const double start = bench_time();
+    if (lua_pcall(L, 1, 1, 0) != 0) {
+        fprintf(stderr, "%s: %s\n", name, lua_tostring(L, -1));
+        lua_pop(L, 1);
+
+        return -1;
+    }
+    const double seconds = bench_time() - start;
+
+    *result = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    printf("%-16s %10.1f ns/msg %10.2f M msg/s\n", name, seconds * 1e9 / ((double) n * BENCH_ROUNDS),
+           (double) n * BENCH_ROUNDS / seconds * 1e-6);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const size_t n = argc > 1 ? (size_t) atol(argv[1]) : 1000000;
+
+    lua_State *L = luaL_newstate();
+    if (!L) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    luaL_openlibs(L);
+    lua_api_init(L);
+
+    lua_pushinteger(L, (lua_Integer) n);
+    lua_setglobal(L, "n");
+
+    if (run(L, bench_setup) || run(L, bench_text) || run(L, bench_bits)) {
+        lua_close(L);
+        return 1;
+    }
+
+    double text_bytes, bits_bytes, sink;
+    if (bench(L, "text_encode", n, &text_bytes) || bench(L, "text_round_trip", n, &sink) ||
+        bench(L, "bits_encode", n, &bits_bytes) || bench(L, "bits_round_trip", n, &sink)) {
+        lua_close(L);
+        return 1;
+    }
+
+    lua_getglobal(L, "max_error");
+    /* quantized values must land within half a step, 20 bits over +-4096 */
+    printf("text %.1f bytes/msg, bits %.1f bytes/msg, max error %g, step %g\n",
+           text_bytes / ((double) n * BENCH_ROUNDS), bits_bytes / ((double) n * BENCH_ROUNDS), lua_tonumber(L, -1),
+           8192.0 / ((1 << 20) - 1));
+    lua_pop(L, 1);
+
+    lua_close(L);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * quad transform microbenchmark, 4x4 matrix chain against the 2d affine kernel
+ *
+ * usage:  bench_math [count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../src/core/cmath.h"
+
+#define BENCH_ROUNDS 10
+
+static double bench_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* what renderer_draw did per quad before the affine path */
+static void matrix_path(struct matrix *out, const float *px, const float *py,
+                        const float *sx, const float *sy, const float *rot, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        struct matrix translate_m, scale_m, rotate_m, scale_rot_m;
+
+        math_matrix_translate(&translate_m, px[i], py[i], 0.0f);
+        math_matrix_scale(&scale_m, sx[i], sy[i], 1.0f);
+        math_matrix_rotate_2d(&rotate_m, rot[i]);
+        math_matrix_mul(&scale_rot_m, &scale_m, &rotate_m);
+        math_matrix_mul(&out[i], &translate_m, &scale_rot_m);
+    }
+}
+
+static void report(const char *name, double seconds, size_t n) {
+    printf("%-10s %10.3f ms %12.1f M transforms/s\n", name, seconds * 1e3 / BENCH_ROUNDS,
+           (double) n * BENCH_ROUNDS / seconds * 1e-6);
+}
+
+int main(int argc, char **argv) {
+    const size_t n = argc > 1 ? (size_t) atol(argv[1]) : 1000000;
+
+    float *px = malloc(n * sizeof(float));
+    float *py = malloc(n * sizeof(float));
+    float *sx = malloc(n * sizeof(float));
+    float *sy = malloc(n * sizeof(float));
+    float *rot = malloc(n * sizeof(float));
+    struct matrix *matrices = malloc(n * sizeof(struct matrix));
+    struct affine2d *affines = malloc(n * sizeof(struct affine2d));
+
+    if (!px || !py || !sx || !sy || !rot || !matrices || !affines) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < n; i++) {
+        px[i] = (float) (rand() % 2000) - 1000.0f;
+        py[i] = (float) (rand() % 2000) - 1000.0f;
+        sx[i] = (float) (rand() % 100) + 1.0f;
+        sy[i] = (float) (rand() % 100) + 1.0f;
+        rot[i] = (float) (rand() % 7200) * 0.1f - 360.0f;
+    }
+
+#if defined(__AVX__)
+    printf("kernel: avx\n");
+#elif defined(__SSE2__)
+    printf("kernel: sse2\n");
+#else
+    printf("kernel: scalar\n");
+#endif
+
+    double start = bench_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        matrix_path(matrices, px, py, sx, sy, rot, n);
+    }
+    report("matrix", bench_time() - start, n);
+
+    start = bench_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (size_t i = 0; i < n; i++) {
+            affines[i] = math_affine_make((struct vec2){px[i], py[i]}, (struct vec2){sx[i], sy[i]}, rot[i]);
+        }
+    }
+    report("scalar", bench_time() - start, n);
+
+    start = bench_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        math_affine_batch(affines, sizeof(struct affine2d), px, py, sx, sy, rot, n);
+    }
+    report("batch", bench_time() - start, n);
+
+    /* both paths must agree, relative to the quad scale */
+    float max_err = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        const struct matrix *m = &matrices[i];
+        const struct affine2d *a = &affines[i];
+        const float scale = sx[i] > sy[i] ? sx[i] : sy[i];
+
+        const float err[] = {
+            m->m[0] - a->a, m->m[1] - a->b, m->m[4] - a->c, m->m[5] - a->d,
+            m->m[12] - a->tx, m->m[13] - a->ty,
+        };
+
+        for (size_t e = 0; e < sizeof(err) / sizeof(err[0]); e++) {
+            const float rel = fabsf(err[e]) / scale;
+            if (rel > max_err) max_err = rel;
+        }
+    }
+    printf("max error %g\n", max_err);
+
+    free(px);
+    free(py);
+    free(sx);
+    free(sy);
+    free(rot);
+    free(matrices);
+    free(affines);
+
+    return 0;
+}
@@ -0,0 +1,405 @@
+/*
+ * loopback network benchmark, one server and a set of clients on 127.0.0.1
+ *
+ * usage:  bench_net [clients] [packets] [port] [thread]
+ *
+ * thread 1 hands the server socket to the io thread, the frame run shows what that buys: clients keep
+ * sending while the server sits in a long frame, without the thread the kernel buffer overflows
+ *
+ * counts syscalls per datagram on both sides, build with -DNET_BATCH=1 in BENCH_FLAGS
+ * to compare against one recvfrom / sendto per datagram
+ *
+ * the tick run replays the game's position relay, every client sends its position and the server
+ * forwards it to everyone else, and counts how many datagrams those messages took
+ *
+ * the snapshot run sends every client a message too big for one datagram, the way a late joiner
+ * gets the full state, and checks it arrives whole
+ *
+ * the aoi run spreads the clients over a large map, every tick each one moves and its update goes
+ * out through broadcast_near, and reports the bytes that saved against broadcasting to everyone
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/core/net.h"
+
+#define BENCH_PAYLOAD 200
+#define BENCH_TICKS 100
+/* "pos:%.4f,%.4f" plus the id prefix the server adds */
+#define BENCH_POS 24
+#define BENCH_SNAPSHOT (16 * 1024)
+/* a slow server frame in microseconds and how many the frame run lasts */
+#define BENCH_FRAME 30000
+#define BENCH_FRAMES 20
+/* side of the square map the aoi run spreads clients over, in world units */
+#define BENCH_MAP 16384.0
+
+static double bench_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static uint32_t drain_server(struct net_server *server) {
+    struct net_event event;
+    uint32_t data = 0;
+
+    for (int idle = 0; idle < 50; idle++) {
+        while (net_server_poll(server, &event)) {
+            data += event.type == NET_EVENT_DATA;
+            idle = 0;
+        }
+    }
+
+    return data;
+}
+
+static uint32_t drain_clients(struct net_client **clients, uint32_t count) {
+    struct net_event event;
+    uint32_t data = 0;
+
+    for (uint32_t c = 0; c < count; c++) {
+        for (int idle = 0; idle < 50; idle++) {
+            while (net_client_poll(clients[c], &event)) {
+                data += event.type == NET_EVENT_DATA;
+                idle = 0;
+            }
+        }
+    }
+
+    return data;
+}
+
+// clients -> server, the server sees a steady mixed-peer stream
+static uint32_t bench_recv(struct net_server *server, struct net_client **clients, uint32_t count, uint32_t packets,
+                           const char *payload, bool batch) {
+    uint32_t delivered = 0;
+
+    for (uint32_t p = 0; p < packets; p++) {
+        for (uint32_t c = 0; c < count; c++) {
+            net_client_send(clients[c], payload, BENCH_PAYLOAD);
+            net_client_flush(clients[c]);
+        }
+
+        if (batch) {
+            const struct net_view *views;
+            uint32_t n;
+
+            while ((n = net_server_poll_batch(server, &views))) {
+                for (uint32_t i = 0; i < n; i++) {
+                    delivered += views[i].type == NET_EVENT_DATA;
+                }
+            }
+        } else {
+            struct net_event e;
+
+            while (net_server_poll(server, &e)) {
+                delivered += e.type == NET_EVENT_DATA;
+            }
+        }
+    }
+
+    return delivered + drain_server(server);
+}
+
+static void bench_tick(struct net_server *server, struct net_client **clients, uint32_t count) {
+    const struct net_io_stats before = *net_server_io_stats(server);
+    uint64_t messages = 0;
+    uint32_t delivered = 0;
+    char pos[BENCH_POS];
+    memset(pos, '1', sizeof(pos));
+
+    for (int tick = 0; tick < BENCH_TICKS; tick++) {
+        for (uint32_t c = 0; c < count; c++) {
+            net_client_send_sequenced(clients[c], 0, pos, sizeof(pos));
+            net_client_flush(clients[c]);
+        }
+
+        for (int idle = 0; idle < 50; idle++) {
+            const struct net_view *views;
+            const uint32_t n = net_server_poll_batch(server, &views);
+
+            for (uint32_t i = 0; i < n; i++) {
+                if (views[i].type != NET_EVENT_DATA) {
+                    continue;
+                }
+
+                for (uint32_t c = 0; c < count; c++) {
+                    if (clients[c]->id != views[i].client_id) {
+                        net_server_send_sequenced(server, clients[c]->id, views[i].client_id % NET_SEQUENCED_CHANNELS,
+                                                  views[i].data, views[i].len);
+                        messages++;
+                    }
+                }
+            }
+
+            idle = n ? 0 : idle;
+        }
+
+        net_server_flush(server);
+        delivered += drain_clients(clients, count);
+    }
+
+    const struct net_io_stats *after = net_server_io_stats(server);
+    const uint64_t datagrams = after->send_packets - before.send_packets;
+
+    printf("tick       %u clients: %.0f messages -> %.1f datagrams per tick, %u/%llu delivered\n", count,
+           (double) messages / BENCH_TICKS, (double) datagrams / BENCH_TICKS, delivered,
+           (unsigned long long) messages);
+}
+
+static void bench_aoi(struct net_server *server, struct net_client **clients, uint32_t count) {
+    const struct net_aoi_stats before = *net_server_aoi_stats(server);
+    double *x = malloc(count * sizeof(double));
+    double *y = malloc(count * sizeof(double));
+    uint32_t delivered = 0;
+    double query = 0.0;
+    char pos[BENCH_POS];
+    memset(pos, '1', sizeof(pos));
+
+    if (!x || !y) {
+        free(x);
+        free(y);
+        return;
+    }
+
+    srand(1);
+    for (uint32_t c = 0; c < count; c++) {
+        x[c] = (double) rand() / RAND_MAX * BENCH_MAP;
+        y[c] = (double) rand() / RAND_MAX * BENCH_MAP;
+        net_server_set_position(server, clients[c]->id, x[c], y[c]);
+    }
+
+    for (int tick = 0; tick < BENCH_TICKS; tick++) {
+        const double start = bench_time();
+
+        for (uint32_t c = 0; c < count; c++) {
+            /* a few units per tick, now and then across a cell edge */
+            x[c] += (double) (rand() % 17 - 8);
+            y[c] += (double) (rand() % 17 - 8);
+            net_server_set_position(server, clients[c]->id, x[c], y[c]);
+            net_server_broadcast_near_sequenced(server, x[c], y[c], 0.0, clients[c]->id % NET_SEQUENCED_CHANNELS, pos,
+                                                sizeof(pos));
+        }
+
+        query += bench_time() - start;
+        net_server_flush(server);
+        delivered += drain_clients(clients, count);
+    }
+
+    const struct net_aoi_stats *after = net_server_aoi_stats(server);
+    const uint64_t sent = after->bytes_sent - before.bytes_sent;
+    const uint64_t skipped = after->bytes_skipped - before.bytes_skipped;
+
+    printf("aoi        %u clients on %.0f^2: %.1f of %u peers per update, %u delivered, %.1f%% of broadcast bytes "
+           "saved, %.0f ns per update\n",
+           count, BENCH_MAP, (double) (after->sent - before.sent) / ((double) count * BENCH_TICKS), count, delivered,
+           sent + skipped ? 100.0 * (double) skipped / (double) (sent + skipped) : 0.0,
+           query * 1e9 / ((double) count * BENCH_TICKS));
+
+    free(x);
+    free(y);
+}
+
+static void bench_snapshot(struct net_server *server, struct net_client **clients, uint32_t count, uint32_t rounds) {
+    const struct net_io_stats before = *net_server_io_stats(server);
+    uint8_t *snapshot = malloc(BENCH_SNAPSHOT);
+    uint32_t delivered = 0;
+    uint32_t whole = 0;
+
+    if (!snapshot) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < BENCH_SNAPSHOT; i++) {
+        snapshot[i] = (uint8_t) (i * 7);
+    }
+
+    const double start = bench_time();
+    for (uint32_t r = 0; r < rounds; r++) {
+        net_server_broadcast(server, snapshot, BENCH_SNAPSHOT);
+        net_server_flush(server);
+
+        for (uint32_t c = 0; c < count; c++) {
+            for (int idle = 0; idle < 50; idle++) {
+                const struct net_view *views;
+                const uint32_t n = net_client_poll_batch(clients[c], &views);
+
+                for (uint32_t i = 0; i < n; i++) {
+                    if (views[i].type == NET_EVENT_DATA) {
+                        delivered++;
+                        whole += views[i].len == BENCH_SNAPSHOT && !memcmp(views[i].data, snapshot, BENCH_SNAPSHOT);
+                    }
+                }
+
+                idle = n ? 0 : idle;
+            }
+        }
+    }
+    const double seconds = bench_time() - start;
+
+    const struct net_io_stats *after = net_server_io_stats(server);
+    printf("snapshot   %u/%u delivered, %u intact, %.1f datagrams each, %.1f MiB/s\n", delivered, rounds * count,
+           whole, (double) (after->send_packets - before.send_packets) / (rounds * count),
+           (double) delivered * BENCH_SNAPSHOT / seconds / (1024.0 * 1024.0));
+
+    free(snapshot);
+}
+
+// every client streams while the server is stuck in its frame, then it drains everything at once
+static void bench_frame(struct net_server *server, struct net_client **clients, uint32_t count, const char *payload) {
+    const struct net_io_stats before = *net_server_io_stats(server);
+    uint32_t delivered = 0;
+    uint32_t sent = 0;
+
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        // spread over the frame the way real clients would send
+        for (int step = 0; step < 10; step++) {
+            for (uint32_t c = 0; c < count; c++) {
+                for (int p = 0; p < 8; p++) {
+                    net_client_send(clients[c], payload, BENCH_PAYLOAD);
+                    net_client_flush(clients[c]);
+                    sent++;
+                }
+            }
+            usleep(BENCH_FRAME / 10);
+        }
+
+        const struct net_view *views;
+        uint32_t n;
+        while ((n = net_server_poll_batch(server, &views))) {
+            for (uint32_t i = 0; i < n; i++) {
+                delivered += views[i].type == NET_EVENT_DATA;
+            }
+        }
+    }
+
+    const struct net_io_stats *after = net_server_io_stats(server);
+    printf("frame      %u/%u delivered over %d ms frames, queue max %u, stalls %llu, kernel dropped %llu\n",
+           delivered, sent, BENCH_FRAME / 1000, after->recv_queue_max,
+           (unsigned long long) (after->recv_stalls - before.recv_stalls),
+           (unsigned long long) (after->kernel_dropped - before.kernel_dropped));
+}
+
+static void report(const char *name, double seconds, uint32_t delivered, uint32_t sent, uint64_t calls,
+                   uint64_t packets) {
+    printf("%-11s %8u/%-8u %10.0f pkt/s %8.3f syscalls/pkt\n", name, delivered, sent, delivered / seconds,
+           packets ? (double) calls / (double) packets : 0.0);
+}
+
+int main(int argc, char **argv) {
+    const uint32_t count = argc > 1 ? (uint32_t) atoi(argv[1]) : 16;
+    const uint32_t packets = argc > 2 ? (uint32_t) atoi(argv[2]) : 256;
+    const uint16_t port = argc > 3 ? (uint16_t) atoi(argv[3]) : 7979;
+    const bool thread = argc > 4 && atoi(argv[4]) != 0;
+
+    struct net_server *server = net_server_create("127.0.0.1", port, count, 0);
+    struct net_client **clients = calloc(count, sizeof(*clients));
+    if (!server || !clients) {
+        fprintf(stderr, "failed to create server\n");
+        return 1;
+    }
+
+    if (thread && !net_server_start_thread(server)) {
+        fprintf(stderr, "failed to start the io thread\n");
+        return 1;
+    }
+
+    for (uint32_t c = 0; c < count; c++) {
+        clients[c] = net_client_create("127.0.0.1", port);
+        if (!clients[c]) {
+            fprintf(stderr, "failed to create client\n");
+            return 1;
+        }
+    }
+
+    struct net_event event;
+    const double deadline = bench_time() + 5.0;
+    for (uint32_t connected = 0; connected < count && bench_time() < deadline;) {
+        net_server_poll(server, &event);
+
+        connected = 0;
+        for (uint32_t c = 0; c < count; c++) {
+            net_client_poll(clients[c], &event);
+            connected += clients[c]->connected;
+        }
+    }
+
+    for (uint32_t c = 0; c < count; c++) {
+        if (!clients[c]->connected) {
+            fprintf(stderr, "client %u did not connect\n", c);
+            return 1;
+        }
+    }
+
+    char payload[BENCH_PAYLOAD];
+    memset(payload, 'x', sizeof(payload));
+
+    printf("NET_BATCH %d, %u clients, %u packets each, %d byte payloads, io thread %s\n", NET_BATCH, count, packets,
+           BENCH_PAYLOAD, thread ? "on" : "off");
+
+    struct net_io_stats before = *net_server_io_stats(server);
+    double start = bench_time();
+    uint32_t delivered = bench_recv(server, clients, count, packets, payload, false);
+    struct net_io_stats after = *net_server_io_stats(server);
+    report("recv", bench_time() - start, delivered, packets * count, after.recv_calls - before.recv_calls,
+           after.recv_packets - before.recv_packets);
+
+    // same stream through views into the receive batch, no payload copy
+    before = *net_server_io_stats(server);
+    start = bench_time();
+    delivered = bench_recv(server, clients, count, packets, payload, true);
+    after = *net_server_io_stats(server);
+    report("recv batch", bench_time() - start, delivered, packets * count, after.recv_calls - before.recv_calls,
+           after.recv_packets - before.recv_packets);
+
+    // server -> every client, one broadcast per tick
+    before = *net_server_io_stats(server);
+    start = bench_time();
+    delivered = 0;
+    for (uint32_t p = 0; p < packets; p++) {
+        net_server_broadcast(server, payload, sizeof(payload));
+        net_server_flush(server);
+
+        if (p % 16 == 15) {
+            delivered += drain_clients(clients, count);
+        }
+    }
+    delivered += drain_clients(clients, count);
+    after = *net_server_io_stats(server);
+    report("broadcast", bench_time() - start, delivered, packets * count, after.send_calls - before.send_calls,
+           after.send_packets - before.send_packets);
+
+    // server -> one client in bursts, equal sized datagrams to one peer ride a single gso send
+    before = *net_server_io_stats(server);
+    start = bench_time();
+    delivered = 0;
+    for (uint32_t p = 0; p < packets; p += 32) {
+        for (uint32_t i = p; i < p + 32 && i < packets; i++) {
+            net_server_send(server, 0, payload, sizeof(payload));
+        }
+        net_server_flush(server);
+
+        delivered += drain_clients(clients, 1);
+    }
+    after = *net_server_io_stats(server);
+    report("burst", bench_time() - start, delivered, packets, after.send_calls - before.send_calls,
+           after.send_packets - before.send_packets);
+
+    bench_tick(server, clients, count);
+    bench_snapshot(server, clients, count, packets / 16 ? packets / 16 : 1);
+    bench_aoi(server, clients, count);
+    bench_frame(server, clients, count, payload);
+
+    for (uint32_t c = 0; c < count; c++) {
+        net_client_destroy(clients[c]);
+    }
+    free(clients);
+    net_server_destroy(server);
+
+    return 0;
+}
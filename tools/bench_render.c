@@ -0,0 +1,183 @@
+/*
+ * headless renderer benchmark, runs on any EGL implementation (mesa llvmpipe is fine)
+ *
+ * usage:  bench_render [frames] [spread] [atlas]
+ *
+ * spread > 1 scatters the quads over a map that many screens wide, to measure culling
+ * atlas 0 gives every sprite texture its own gl texture instead of packing them
+ *
+ * needs sausages.arc in the working directory, same as the client
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <EGL/egl.h>
+
+#include "../src/core/renderer.h"
+
+#define BENCH_WIDTH 1280
+#define BENCH_HEIGHT 720
+/* distinct sprite images, more than fit in one run's texture slots */
+#define BENCH_TEXTURES 64
+
+static const size_t bench_counts[] = {10000, 50000, 100000};
+
+static double bench_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static int egl_init(void) {
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE,
+    };
+
+    static const EGLint pbuffer_attribs[] = {
+        EGL_WIDTH, BENCH_WIDTH,
+        EGL_HEIGHT, BENCH_HEIGHT,
+        EGL_NONE,
+    };
+
+    static const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+
+    /* no window system needed, let mesa pick its surfaceless platform */
+    setenv("EGL_PLATFORM", "surfaceless", 0);
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        fprintf(stderr, "failed to init egl\n");
+        return 1;
+    }
+
+    EGLConfig config;
+    EGLint n;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &n) || n < 1) {
+        fprintf(stderr, "no matching egl config\n");
+        return 1;
+    }
+
+    EGLSurface surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "failed to create gl 3.3 context\n");
+        return 1;
+    }
+
+    eglMakeCurrent(display, surface, surface, context);
+
+    if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+        fprintf(stderr, "failed to load gl\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static void bench_textures(struct render_context *r, texture_id *textures, bool atlas) {
+    unsigned char pixels[16 * 16 * 4];
+
+    for (int t = 0; t < BENCH_TEXTURES; t++) {
+        for (int i = 0; i < 16 * 16; i++) {
+            pixels[i * 4 + 0] = (unsigned char) (t * 37);
+            pixels[i * 4 + 1] = (unsigned char) (i + t * 11);
+            pixels[i * 4 + 2] = (unsigned char) (t * 5);
+            pixels[i * 4 + 3] = 255;
+        }
+
+        textures[t] = renderer_create_texture(r, pixels, 16, 16, atlas);
+    }
+}
+
+/* sprites with a rect behind every 4th one, roughly what a busy scene pushes */
+static void bench_push(struct render_context *r, size_t count, const texture_id *textures, float spread) {
+    for (size_t i = 0; i < count; i++) {
+        const struct vec2 pos = {
+            ((float) (i % 97) / 97.0f - 0.5f) * BENCH_WIDTH * spread,
+            ((float) (i % 53) / 53.0f - 0.5f) * BENCH_HEIGHT * spread,
+        };
+        const struct vec2 scale = {8.0f, 8.0f};
+        const float rotation = (float) (i % 360);
+
+        if (i % 4 == 0) {
+            renderer_push_rect(r, pos, scale, rotation, (struct color3){0.3f, 0.7f, 0.3f}, ANCHOR_CENTER, RENDERER_LAYER_DEFAULT);
+        } else {
+            renderer_push_texture(r, pos, scale, rotation, textures[i % BENCH_TEXTURES], ANCHOR_CENTER,
+                                  RENDERER_LAYER_DEFAULT);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const int frames = argc > 1 ? atoi(argv[1]) : 10;
+    const float spread = argc > 2 ? (float) atof(argv[2]) : 1.0f;
+    const bool atlas = argc > 3 ? atoi(argv[3]) != 0 : true;
+
+    if (egl_init()) {
+        return 1;
+    }
+
+    struct render_context *r = &render_context;
+    *r = (struct render_context){.width = BENCH_WIDTH, .height = BENCH_HEIGHT};
+    glViewport(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+
+    if (renderer_init(r)) {
+        fprintf(stderr, "failed to init renderer\n");
+        return 1;
+    }
+
+    texture_id textures[BENCH_TEXTURES];
+    bench_textures(r, textures, atlas);
+
+    printf("%s, %s\n", (const char *) glGetString(GL_RENDERER), (const char *) glGetString(GL_VERSION));
+    printf("instance stream: %s\n", r->instance_stream.persistent ? "persistent mapped" : "orphaned");
+    printf("%d textures, %zu atlas pages\n", BENCH_TEXTURES, r->atlas_pages_count);
+    printf("%10s %12s %12s %8s %8s %8s %10s %6s\n", "quads", "frame ms", "quads/ms", "culled", "draws", "skipped",
+           "upload KiB", "waits");
+
+    for (size_t c = 0; c < sizeof(bench_counts) / sizeof(bench_counts[0]); c++) {
+        const size_t count = bench_counts[c];
+
+        /* warm up so buffer growth is not measured */
+        bench_push(r, count, textures, spread);
+        renderer_draw(r);
+        glFinish();
+
+        double total = 0.0;
+        for (int f = 0; f < frames; f++) {
+            const double start = bench_time();
+
+            bench_push(r, count, textures, spread);
+            glClear(GL_COLOR_BUFFER_BIT);
+            renderer_draw(r);
+            glFinish();
+
+            total += bench_time() - start;
+        }
+
+        const struct render_stats *stats = &r->stats;
+        const size_t skipped = stats->program_skipped + stats->texture_skipped + stats->proj_skipped;
+
+        const double ms = total / frames * 1e3;
+        printf("%10zu %12.3f %12.1f %8zu %8zu %8zu %10zu %6zu\n", count, ms, (double) count / ms, stats->culled,
+               stats->draw_calls, skipped, stats->upload_bytes / 1024, stats->fence_waits);
+    }
+
+    renderer_deinit(r);
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * snapshot delta benchmark, bytes each client receives per second for a simulated world
+ *
+ * usage:  bench_snapshot [loss percent] [rtt ticks]
+ *
+ * players idle, walk or fall the way the game's do and the server snapshots them at 30 hz. every client
+ * gets the world as a delta against the last tick it acked, acks come back rtt ticks later and
+ * snapshots and acks are lost at the given rate. compared against the text position relay the game
+ * used before and against full snapshots. payload bytes only, net headers are the same for all three
+ *
+ * every decoded snapshot is checked against what the server encoded
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/core/snapshot.h"
+
+#define BENCH_RATE 30
+#define BENCH_SECONDS 10
+/* what the lua binding quantizes positions to */
+#define BENCH_SCALE 100.0
+
+static const uint32_t bench_players[] = {8, 32, 128};
+
+enum {
+    PLAYER_IDLE,
+    PLAYER_WALK,
+    PLAYER_FALL,
+};
+
+struct player {
+    int state;
+    double x;
+    double y;
+    double vx;
+    double vy;
+};
+
+struct bench_client {
+    struct snapshot_history history;
+    uint32_t acked;
+    /* acks on their way back, by the tick they arrive */
+    uint32_t ack_at[64];
+    uint32_t ack_tick[64];
+};
+
+static double bench_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static double uniform(void) {
+    return (double) rand() / ((double) RAND_MAX + 1.0);
+}
+
+/* most players stand around, some walk along the platform, a few are in the air */
+static void player_step(struct player *p, const double dt) {
+    if (uniform() < 1.0 / 60.0) {
+        const double r = uniform();
+        p->state = r < 0.5 ? PLAYER_IDLE : r < 0.85 ? PLAYER_WALK : PLAYER_FALL;
+        p->vx = (uniform() - 0.5) * 400.0;
+        p->vy = p->state == PLAYER_FALL ? 200.0 : 0.0;
+    }
+
+    switch (p->state) {
+    case PLAYER_WALK:
+        p->x += p->vx * dt;
+        break;
+    case PLAYER_FALL:
+        p->vy -= 300.0 * dt;
+        p->x += p->vx * dt;
+        p->y += p->vy * dt;
+        break;
+    default:
+        break;
+    }
+}
+
+static bool same(const struct snapshot *a, const struct snapshot *b) {
+    return a && b && a->count == b->count && !memcmp(a->entities, b->entities, a->count * sizeof(*a->entities));
+}
+
+static void bench(const uint32_t count, const uint32_t loss, const uint32_t rtt) {
+    struct player *players = calloc(count, sizeof(*players));
+    struct bench_client *clients = calloc(count, sizeof(*clients));
+    struct snapshot_history *world = calloc(1, sizeof(*world));
+    uint8_t *buf = NULL;
+    uint32_t cap = 0;
+
+    if (!players || !clients || !world) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        players[i].x = (uniform() - 0.5) * 800.0;
+        players[i].y = 65.5;
+    }
+
+    uint64_t text_bytes = 0;
+    uint64_t full_bytes = 0;
+    uint64_t delta_bytes = 0;
+    uint64_t decoded = 0;
+    uint64_t mismatches = 0;
+    double encode_time = 0.0;
+
+    const uint32_t ticks = BENCH_RATE * BENCH_SECONDS;
+    for (uint32_t tick = 1; tick <= ticks; tick++) {
+        struct snapshot *s = snapshot_begin(world, tick);
+
+        for (uint32_t i = 0; i < count; i++) {
+            player_step(&players[i], 1.0 / BENCH_RATE);
+
+            const int32_t fields[SNAPSHOT_FIELDS] = {
+                (int32_t) (players[i].x * BENCH_SCALE), (int32_t) (players[i].y * BENCH_SCALE),
+            };
+            snapshot_add(s, i, fields);
+        }
+        snapshot_end(s);
+
+        /* the relay sent every other player's "id:pos:x,y" to everyone */
+        for (uint32_t i = 0; i < count; i++) {
+            char text[64];
+            text_bytes += (uint64_t) snprintf(text, sizeof(text), "%u:pos:%.4f,%.4f", i, players[i].x,
+                                              players[i].y) * (count - 1);
+        }
+
+        if (snapshot_bound(NULL, s) > cap) {
+            cap = snapshot_bound(NULL, s) * 2;
+            buf = realloc(buf, cap);
+        }
+
+        struct bitstream w;
+        bitstream_writer(&w, buf, cap);
+        snapshot_encode(NULL, s, &w);
+        full_bytes += (uint64_t) bitstream_bytes(&w) * count;
+
+        for (uint32_t c = 0; c < count; c++) {
+            struct bench_client *client = &clients[c];
+
+            for (uint32_t a = 0; a < 64; a++) {
+                if (client->ack_at[a] == tick && client->ack_tick[a] > client->acked) {
+                    client->acked = client->ack_tick[a];
+                }
+            }
+
+            const struct snapshot *baseline = snapshot_find(world, client->acked);
+            if (snapshot_bound(baseline, s) > cap) {
+                cap = snapshot_bound(baseline, s) * 2;
+                buf = realloc(buf, cap);
+            }
+
+            const double start = bench_time();
+            bitstream_writer(&w, buf, cap);
+            snapshot_encode(baseline, s, &w);
+            const uint32_t len = bitstream_bytes(&w);
+            encode_time += bench_time() - start;
+            delta_bytes += len;
+
+            if ((uint32_t) rand() % 100 < loss) {
+                continue;
+            }
+
+            struct bitstream r;
+            bitstream_reader(&r, buf, len);
+
+            const uint32_t got = snapshot_decode(&client->history, &r);
+            if (!got) {
+                /* only happens when the baseline was lost on the client side */
+                continue;
+            }
+
+            decoded++;
+            mismatches += !same(snapshot_find(&client->history, got), s);
+
+            if ((uint32_t) rand() % 100 >= loss) {
+                client->ack_at[tick % 64] = tick + rtt;
+                client->ack_tick[tick % 64] = got;
+            }
+        }
+    }
+
+    const double per = (double) count * BENCH_SECONDS;
+    printf("%8u %12.0f %12.0f %12.0f %8.1fx %10.2f %8llu %10llu\n", count, text_bytes / per, full_bytes / per,
+           delta_bytes / per, delta_bytes ? (double) text_bytes / (double) delta_bytes : 0.0,
+           encode_time * 1e6 / ((double) ticks * count), (unsigned long long) decoded,
+           (unsigned long long) mismatches);
+
+    for (uint32_t c = 0; c < count; c++) {
+        snapshot_history_deinit(&clients[c].history);
+    }
+    snapshot_history_deinit(world);
+    free(world);
+    free(clients);
+    free(players);
+    free(buf);
+}
+
+int main(int argc, char **argv) {
+    const uint32_t loss = argc > 1 ? (uint32_t) atoi(argv[1]) : 5;
+    const uint32_t rtt = argc > 2 ? (uint32_t) atoi(argv[2]) : 3;
+
+    /* acks in flight live in a 64 tick ring */
+    if (rtt >= 64) {
+        fprintf(stderr, "rtt must be below 64 ticks\n");
+        return 1;
+    }
+
+    srand(1);
+
+    printf("%u hz, %u%% loss, acks back after %u ticks, bytes per client per second\n", BENCH_RATE, loss, rtt);
+    printf("%8s %12s %12s %12s %9s %10s %8s %10s\n", "players", "text relay", "full", "delta", "saved",
+           "encode us", "decoded", "mismatches");
+
+    for (size_t i = 0; i < sizeof(bench_players) / sizeof(bench_players[0]); i++) {
+        bench(bench_players[i], loss, rtt);
+    }
+
+    return 0;
+}